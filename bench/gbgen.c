@@ -0,0 +1,234 @@
+/**
+ * \defgroup gbgen gbgen
+ * Synthetic object generator for the linker benchmark. It writes object
+ * files through the functions of the object file module, with a
+ * configurable number of sections, global and external symbols and
+ * relocations per file, so that the phases of gbld can be timed on inputs
+ * much larger than the demos.
+ * \addtogroup gbgen
+ * \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/errors.h"
+#include "../common/utils.h"
+#include "../common/objfile.h"
+
+#define MAX_PADDING 64  /**< Maximum number of bytes after the relocations of
+                         * a section */
+
+static int           num_files = 64;
+static int           num_sections = 32;
+static int           num_globals = 32;
+static int           num_externs = 32;
+static int           num_relocs = 128;
+static unsigned long seed = 1;
+static const char*   out_dir = ".";
+
+static void usage();
+static int  parse_args(int argc, char* argv[]);
+static int  next_random(int range);
+static void write_file(int file_id);
+
+int main(int argc, char* argv[])
+{
+    int i;
+
+    esetprogram("gbgen");
+    if (!parse_args(argc, argv))
+    {
+        usage();
+        return 1;
+    }
+
+    /* An extern names a global of another file, each one at most once */
+    if (num_files < 2)
+        num_externs = 0;
+    else if (num_externs > (num_files - 1) * num_globals)
+        num_externs = (num_files - 1) * num_globals;
+    if (num_globals + num_externs == 0)
+        num_relocs = 0;
+
+    for (i = 0; i < num_files; ++i)
+        write_file(i);
+
+    return errors() ? 1 : 0;
+}
+
+void usage()
+{
+    puts("Usage: gbgen [options]");
+    puts("Options:");
+    puts("  -o <dir>        Directory of the object files (default .)");
+    puts("  -files <n>      Number of object files (default 64)");
+    puts("  -sections <n>   Sections per file (default 32)");
+    puts("  -globals <n>    Global symbols per file (default 32)");
+    puts("  -externs <n>    External symbols per file (default 32)");
+    puts("  -relocs <n>     Relocations per file (default 128)");
+    puts("  -seed <n>       Seed of the random generator (default 1)");
+}
+
+/*========================================================================*//**
+ * Read the command line
+ *
+ * \return 0 if it is invalid
+ *//*=========================================================================*/
+int parse_args(int argc, char* argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+
+        if (i + 1 == argc)
+            return 0;
+        ++i;
+        if (strcmp(arg, "-o") == 0)
+            out_dir = argv[i];
+        else if (strcmp(arg, "-files") == 0)
+            num_files = atoi(argv[i]);
+        else if (strcmp(arg, "-sections") == 0)
+            num_sections = atoi(argv[i]);
+        else if (strcmp(arg, "-globals") == 0)
+            num_globals = atoi(argv[i]);
+        else if (strcmp(arg, "-externs") == 0)
+            num_externs = atoi(argv[i]);
+        else if (strcmp(arg, "-relocs") == 0)
+            num_relocs = atoi(argv[i]);
+        else if (strcmp(arg, "-seed") == 0)
+            seed = strtoul(argv[i], NULL, 10);
+        else
+            return 0;
+    }
+
+    return num_files >= 0 && num_sections > 0 && num_globals >= 0
+           && num_externs >= 0 && num_relocs >= 0;
+}
+
+/*========================================================================*//**
+ * Linear congruential generator, so that the objects only depend on the seed
+ *
+ * \return a number in [0, range[
+ *//*=========================================================================*/
+int next_random(int range)
+{
+    seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+    return range > 0 ? (int)((seed >> 8) % (unsigned long)range) : 0;
+}
+
+/*========================================================================*//**
+ * Write one object file. Every section holds its share of the relocations
+ * of the file as "ld hl,nn" instructions, followed by random data. The
+ * globals are spread over the sections.
+ *
+ * \param file_id: index of the file, part of its name and of its symbols
+ *//*=========================================================================*/
+void write_file(int file_id)
+{
+    section_entry_t* sects;
+    block_header_t   header;
+    symbol_entry_t   sym;
+    reloc_entry_t    reloc;
+    char*            name;
+    FILE*            file;
+    int              i, j;
+
+    name = (char*)mmalloc(strlen(out_dir) + 16);
+    sprintf(name, "%s/bench%04d.o", out_dir, file_id);
+    file = fopen(name, "wb");
+    if (file == NULL)
+        err(F, "unable to create '%s'", name);
+    set_outfile(file);
+    write_obj_header();
+
+    sects = (section_entry_t*)mmalloc(num_sections * sizeof(section_entry_t));
+    header.type = sections;
+    header.num_entries = num_sections;
+    write_block_header(&header);
+    for (i = 0; i < num_sections; ++i)
+    {
+        int slots = num_relocs / num_sections + (i < num_relocs % num_sections);
+
+        sects[i].id = i;
+        sects[i].type = rom;
+        sects[i].offset = 0;
+        sects[i].bank_num = ANY_BANK;
+        sects[i].align = 0;
+        sects[i].flags = 0;
+        sects[i].data_size = 3 * slots + 1 + next_random(MAX_PADDING);
+        sects[i].data = (unsigned char*)mmalloc(sects[i].data_size);
+        for (j = 0; j < sects[i].data_size; ++j)
+            sects[i].data[j] = next_random(0x80);
+        for (j = 0; j < slots; ++j)
+        {
+            sects[i].data[3 * j] = 0x21;  /* ld hl,nn */
+            sects[i].data[3 * j + 1] = 0;
+            sects[i].data[3 * j + 2] = 0;
+        }
+        write_section_entry(&sects[i]);
+        write_block(sects[i].data, sects[i].data_size);
+    }
+
+    if (num_globals + num_externs > 0)
+    {
+        header.type = symbols;
+        header.num_entries = num_globals + num_externs;
+        write_block_header(&header);
+    }
+    for (i = 0; i < num_globals; ++i)
+    {
+        section_entry_t* sect = &sects[i % num_sections];
+
+        memset(&sym, 0, sizeof(symbol_entry_t));
+        sym.sym_id = i;
+        sprintf((char*)sym.id, "g%d_%d", file_id, i);
+        sym.section_id = sect->id;
+        sym.offset = next_random(sect->data_size);
+        sym.type = _global;
+        write_symbol_entry(&sym);
+    }
+    for (i = 0; i < num_externs; ++i)
+    {
+        int other = (file_id + 1 + i % (num_files - 1)) % num_files;
+
+        memset(&sym, 0, sizeof(symbol_entry_t));
+        sym.sym_id = num_globals + i;
+        sprintf((char*)sym.id, "g%d_%d", other, i / (num_files - 1));
+        sym.type = _extern;
+        write_symbol_entry(&sym);
+    }
+
+    if (num_relocs > 0)
+    {
+        header.type = relocations;
+        header.num_entries = num_relocs;
+        write_block_header(&header);
+    }
+    for (i = 0; i < num_sections; ++i)
+    {
+        int slots = num_relocs / num_sections + (i < num_relocs % num_sections);
+
+        for (j = 0; j < slots; ++j)
+        {
+            reloc.sym_id = next_random(num_globals + num_externs);
+            reloc.section_id = i;
+            reloc.offset = 3 * j + 1;
+            reloc.flags = absolute;
+            reloc.addend = 0;
+            write_reloc_entry(&reloc);
+        }
+        free(sects[i].data);
+    }
+
+    write_obj_end();
+    fclose(file);
+    free(sects);
+    free(name);
+}
+
+/**
+ * \} gbgen
+ */
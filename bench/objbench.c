@@ -0,0 +1,250 @@
+/**
+ * \defgroup objbench objbench
+ * Microbenchmark of the object file module: writes an object carrying a
+ * given amount of section data, with symbols and relocations in proportion,
+ * then reads it back a number of times, fully and with the data of the
+ * sections loaded on demand, and prints the throughput of each pass.
+ * \addtogroup objbench
+ * \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../common/errors.h"
+#include "../common/utils.h"
+#include "../common/objfile.h"
+
+#define RELOC_SPACING 16    /**< bytes of section data per relocation */
+
+static int         size_kb = 1024;
+static int         num_sections = 256;
+static int         iterations = 20;
+static const char* out_name = "objbench.o";
+
+static void   usage();
+static int    parse_args(int argc, char* argv[]);
+static void   write_object();
+static void   read_object(int lazy);
+static void   report(const char* pass, clock_t start);
+
+int main(int argc, char* argv[])
+{
+    clock_t start;
+    int i;
+
+    esetprogram("objbench");
+    if (!parse_args(argc, argv))
+    {
+        usage();
+        return 1;
+    }
+
+    printf("%d KB of section data in %d sections, %d iterations\n", size_kb,
+           num_sections, iterations);
+
+    start = clock();
+    for (i = 0; i < iterations; ++i)
+        write_object();
+    report("write", start);
+
+    start = clock();
+    for (i = 0; i < iterations; ++i)
+        read_object(0);
+    report("read", start);
+
+    start = clock();
+    for (i = 0; i < iterations; ++i)
+        read_object(1);
+    report("read, data on demand", start);
+
+    remove(out_name);
+    return errors() ? 1 : 0;
+}
+
+void usage()
+{
+    puts("Usage: objbench [options]");
+    puts("Options:");
+    puts("  -o <file>         Object file written and read (default objbench.o)");
+    puts("  -size <KB>        Section data of the object (default 1024)");
+    puts("  -sections <n>     Number of sections (default 256)");
+    puts("  -iterations <n>   Writes and reads of each pass (default 20)");
+}
+
+/*========================================================================*//**
+ * Read the command line
+ *
+ * \return 0 if it is invalid
+ *//*=========================================================================*/
+int parse_args(int argc, char* argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+
+        if (i + 1 == argc)
+            return 0;
+        ++i;
+        if (strcmp(arg, "-o") == 0)
+            out_name = argv[i];
+        else if (strcmp(arg, "-size") == 0)
+            size_kb = atoi(argv[i]);
+        else if (strcmp(arg, "-sections") == 0)
+            num_sections = atoi(argv[i]);
+        else if (strcmp(arg, "-iterations") == 0)
+            iterations = atoi(argv[i]);
+        else
+            return 0;
+    }
+
+    return size_kb > 0 && num_sections > 0 && iterations > 0;
+}
+
+/*========================================================================*//**
+ * Write the object: the section data is split evenly among the sections,
+ * each one defining a symbol and holding a relocation every RELOC_SPACING
+ * bytes
+ *//*=========================================================================*/
+void write_object()
+{
+    block_header_t  header;
+    section_entry_t sect;
+    symbol_entry_t  sym;
+    reloc_entry_t   reloc;
+    long            total = (long)size_kb * 1024;
+    FILE*           file;
+    int             i, j;
+
+    if (!(file = fopen(out_name, "wb")))
+        err(F, "unable to create '%s'", out_name);
+    set_outfile(file);
+    write_obj_header();
+
+    header.type = sections;
+    header.num_entries = num_sections;
+    write_block_header(&header);
+    memset(&sect, 0, sizeof(section_entry_t));
+    sect.data = (unsigned char*)mmalloc(total / num_sections + 1);
+    for (i = 0; i < num_sections; ++i)
+    {
+        sect.id = i;
+        sect.type = rom;
+        sect.bank_num = ANY_BANK;
+        sect.data_size = total / num_sections + (i < total % num_sections);
+        for (j = 0; j < sect.data_size; ++j)
+            sect.data[j] = (unsigned char)(i + j);
+        write_section_entry(&sect);
+        write_block(sect.data, sect.data_size);
+    }
+    free(sect.data);
+
+    header.type = symbols;
+    header.num_entries = num_sections;
+    write_block_header(&header);
+    memset(&sym, 0, sizeof(symbol_entry_t));
+    for (i = 0; i < num_sections; ++i)
+    {
+        sym.sym_id = i;
+        sprintf((char*)sym.id, "sym%d", i);
+        sym.section_id = i;
+        sym.type = _global;
+        write_symbol_entry(&sym);
+    }
+
+    header.type = relocations;
+    header.num_entries = 0;
+    for (i = 0; i < num_sections; ++i)
+        header.num_entries += (total / num_sections - 2) / RELOC_SPACING;
+    write_block_header(&header);
+    for (i = 0; i < num_sections; ++i)
+    {
+        for (j = 0; j < (total / num_sections - 2) / RELOC_SPACING; ++j)
+        {
+            reloc.sym_id = (i + j) % num_sections;
+            reloc.section_id = i;
+            reloc.offset = j * RELOC_SPACING;
+            reloc.flags = absolute;
+            reloc.addend = j & 0xFF;
+            write_reloc_entry(&reloc);
+        }
+    }
+
+    write_obj_end();
+    fclose(file);
+}
+
+/*========================================================================*//**
+ * Read the object back, block by block
+ *
+ * \param lazy: non-zero to read the section headers first and their data
+ * afterwards, as gbld does when discarding unused sections
+ *//*=========================================================================*/
+void read_object(int lazy)
+{
+    section_entry_t** sects;
+    block_header_t*   header;
+    FILE*             file;
+    long              end;
+    int               num_sects = 0;
+    int               i;
+
+    if (!(file = fopen(out_name, "rb")))
+        err(F, "unable to open '%s'", out_name);
+    fseek(file, 0, SEEK_END);
+    end = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    set_infile(file);
+    read_obj_header(end);
+
+    sects = (section_entry_t**)mmalloc(sizeof(section_entry_t*)
+                                       * num_sections);
+    while ((header = read_block_header()) != NULL)
+    {
+        for (i = 0; i < header->num_entries; ++i)
+        {
+            if (header->type == sections && num_sects < num_sections)
+                sects[num_sects++] = lazy ? read_section_header()
+                                          : read_section_entry();
+            else if (header->type == sections)
+                err(F, "unexpected section in '%s'", out_name);
+            else if (header->type == symbols)
+                free(read_symbol_entry());
+            else
+                free(read_reloc_entry());
+        }
+        free(header);
+    }
+
+    for (i = 0; i < num_sects; ++i)
+    {
+        if (lazy)
+            read_section_data(sects[i]);
+        free(sects[i]->data);
+        free(sects[i]);
+    }
+    free(sects);
+    fclose(file);
+}
+
+/*========================================================================*//**
+ * Print the throughput of a pass, in MB of section data per second of CPU
+ *//*=========================================================================*/
+void report(const char* pass, clock_t start)
+{
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double mb = (double)size_kb * iterations / 1024;
+
+    if (seconds > 0)
+        printf("%-24s %10.3f ms %10.1f MB/s\n", pass, seconds * 1000,
+               mb / seconds);
+    else
+        printf("%-24s %10.3f ms %10s MB/s\n", pass, 0.0, "-");
+}
+
+/**
+ * \} objbench
+ */
@@ -0,0 +1,41 @@
+# Time the encoding and decoding of objects, then generate the synthetic
+# objects and time their link, first plainly, then with the optional passes
+# which walk the section and symbol lists
+file(REMOVE_RECURSE ${DIR})
+file(MAKE_DIRECTORY ${DIR})
+
+message(STATUS "objbench")
+execute_process(
+    COMMAND ${OBJBENCH} -o ${DIR}/objbench.o
+    RESULT_VARIABLE result
+)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "objbench failed")
+endif()
+
+message(STATUS "Generating ${FILES} objects: ${SECTIONS} sections, "
+               "${GLOBALS} globals, ${EXTERNS} externs, ${RELOCS} relocations")
+execute_process(
+    COMMAND ${GBGEN} -o ${DIR} -files ${FILES} -sections ${SECTIONS}
+            -globals ${GLOBALS} -externs ${EXTERNS} -relocs ${RELOCS}
+    RESULT_VARIABLE result
+)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "gbgen failed")
+endif()
+
+file(GLOB objects ${DIR}/*.o)
+list(SORT objects)
+
+foreach(passes "" "--gc-sections;--fold-sections;--keep=g0_0")
+    string(REPLACE ";" " " args "${passes}")
+    message(STATUS "gbld ${args}")
+    execute_process(
+        COMMAND ${GBLD} -ftime-report -mcartridge=mbc5 -mrom-size=8192
+                ${passes} ${objects} -o ${DIR}/bench.gb
+        RESULT_VARIABLE result
+    )
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "gbld failed")
+    endif()
+endforeach()
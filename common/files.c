@@ -50,6 +50,8 @@ void file_add(const char* name)
         nf->file.type = I;
     else if (strcmp(p, ".s") == 0 || strcmp(p, ".S") == 0)
         nf->file.type = S;
+    else if (strcmp(p, ".a") == 0 || strcmp(p, ".A") == 0)
+        nf->file.type = A;
     else
         nf->file.type = O;
 
@@ -76,28 +78,41 @@ void file_first()
  *//*=========================================================================*/
 void file_set_attr(filetype_t type, int tmp)
 {
-    char* p = cur->file.name;
+    file_set_type(&cur->file, type, tmp);
+}
+
+
+/*========================================================================*//**
+ * Change the attributes of any file of the list, as file_set_attr() does for
+ * the current one
+ *
+ * \param file: a file returned by file_next()
+ * \param type: the new file type
+ * \param tmp: non-zero marks the file as a temporary file
+ *//*=========================================================================*/
+void file_set_type(sourcefile_t* file, filetype_t type, int tmp)
+{
+    char* p = file->name;
     while (*p)
         ++p;
-    while (*p != '.' && p != cur->file.name)
+    while (*p != '.' && p != file->name)
         --p;
 
     if (*p == '.')
         *p = 0;
 
-    cur->file.name = (char*)mrealloc(cur->file.name,
-                                     strlen(cur->file.name) + 3);
+    file->name = (char*)mrealloc(file->name, strlen(file->name) + 3);
 
-    p = cur->file.name;
+    p = file->name;
     while (*p != 0)
         ++p;
 
     *p++ = '.';
-    *p++ = "ciso"[type];
+    *p++ = "cisoa"[type];
     *p = 0;
 
-    cur->file.type = type;
-    cur->file.tmp = tmp;
+    file->type = type;
+    file->tmp = tmp;
 }
 
 
@@ -14,7 +14,8 @@ typedef enum
     C,      /**< c source file, .c extension required */
     I,      /**< preprocessed c source file, .i extension required */
     S,      /**< assembly source file, .s extension required */
-    O       /**< object file (default) */
+    O,      /**< object file (default) */
+    A       /**< archive of object files, .a extension required */
 } filetype_t;
 
 typedef struct
@@ -29,6 +30,7 @@ typedef struct
 void            file_add(const char* name);
 void            file_first();
 void            file_set_attr(filetype_t type, int tmp);
+void            file_set_type(sourcefile_t* file, filetype_t type, int tmp);
 sourcefile_t*   file_next();
 const char*     file_name();
 int             file_count();
@@ -1,5 +1,7 @@
 #include "gbmmap.h"
 
+#include <string.h>
+
 #include "../common/errors.h"
 
 static int num_rom_banks = 2;
@@ -16,33 +18,111 @@ static cartridge_t cartridge =
     {'O', 'U', 'T', '.', 'G', 'B', ' ', ' ', ' ', ' ', ' '}
 };
 
+/** Names of the cartridge types, as accepted by -mcartridge= */
+static const struct
+{
+    const char*      name;
+    cartridge_type_t type;
+} cartridge_names[] =
+{
+    { "rom",                    rom_only },
+    { "mbc1",                   mbc1 },
+    { "mbc1+ram",               mbc1_ram },
+    { "mbc1+ram+battery",       mbc1_ram_battery },
+    { "mbc3+timer+battery",     mbc3_timer_battery },
+    { "mbc3+timer+ram+battery", mbc3_timer_ram_battery },
+    { "mbc3",                   mbc3 },
+    { "mbc3+ram",               mbc3_ram },
+    { "mbc3+ram+battery",       mbc3_ram_battery },
+    { "mbc5",                   mbc5 },
+    { "mbc5+ram",               mbc5_ram },
+    { "mbc5+ram+battery",       mbc5_ram_battery },
+    { "mbc5+rumble",            mbc5_rumble },
+    { "mbc5+rumble+ram",        mbc5_rumble_ram },
+    { "mbc5+rumble+ram+battery",mbc5_rumble_ram_battery }
+};
+
+#define NUM_CARTRIDGE_NAMES \
+    (sizeof(cartridge_names) / sizeof(cartridge_names[0]))
+
 void set_cartridge(cartridge_t cart)
 {
     int romsize;
+    rom_size_t max_rom = _32K;
+    int max_ram_banks = 0;
+    int has_ram = 0;
 
     if (cart.gb_type == dmg)
         num_wram_banks = 2;
 
-    if (cart.cart_type == rom_only)
+    switch (cart.cart_type)
     {
-        if (cart.rom_size != _32K)
-            err(F, "ROM size too big for this type of cartridge");
-        if (cart.ram_size != no_ram)
-            err(F, "RAM size too big for this type of cartridge");
-    }
-    else
-        err(F, "unknwon cartridge type");
+        case rom_only:
+            break;
 
-    romsize = 0x8000 << (int)cart.rom_size;
-    num_rom_banks = romsize / ROM_BANK_SIZE;
+        case mbc1_ram:
+        case mbc1_ram_battery:
+            has_ram = 1;
+            /* fall through */
+        case mbc1:
+            max_rom = _2M;
+            max_ram_banks = 4;
+            /* The upper bank bits select either large ROM or RAM banks */
+            if (cart.rom_size > _512K && cart.ram_size == ram_32K)
+                ccerr(F, "MBC1 cannot handle both more than 512 KB of ROM and "
+                         "32 KB of RAM");
+            break;
+
+        case mbc3_timer_ram_battery:
+        case mbc3_ram:
+        case mbc3_ram_battery:
+            has_ram = 1;
+            /* fall through */
+        case mbc3_timer_battery:
+        case mbc3:
+            max_rom = _2M;
+            max_ram_banks = 4;
+            break;
+
+        case mbc5_ram:
+        case mbc5_ram_battery:
+        case mbc5_rumble_ram:
+        case mbc5_rumble_ram_battery:
+            has_ram = 1;
+            /* fall through */
+        case mbc5:
+        case mbc5_rumble:
+            max_rom = _8M;
+            max_ram_banks = 16;
+            break;
+
+        default:
+            ccerr(F, "unknwon cartridge type");
+    }
 
     switch(cart.ram_size)
     {
+        case ram_32K:  num_ram_banks = 4;  break;
+        case ram_64K:  num_ram_banks = 8;  break;
+        case ram_128K: num_ram_banks = 16; break;
         /* In order to make .org work we need a RAM slot even if there
          is no ram */
+        case ram_8K:
         case no_ram:
         default: num_ram_banks = 1;
     }
+
+    if (cart.rom_size > max_rom)
+        ccerr(F, "ROM size too big for this type of cartridge");
+    if (has_ram && cart.ram_size == no_ram)
+        ccerr(F, "this type of cartridge requires a RAM size");
+    if (cart.ram_size != no_ram && (!has_ram || num_ram_banks > max_ram_banks))
+        ccerr(F, "RAM size too big for this type of cartridge");
+
+    romsize = 0x8000 << (int)cart.rom_size;
+    num_rom_banks = romsize / ROM_BANK_SIZE;
+
+    cartridge = cart;
 }
 
 cartridge_t get_cartridge()
@@ -50,6 +130,71 @@ cartridge_t get_cartridge()
     return cartridge;
 }
 
+/*========================================================================*//**
+ * Find a cartridge type given its name
+ *
+ * \param name: cartridge type name, e.g. "mbc5+ram+battery"
+ * \return the cartridge type, -1 if the name is unknown
+ *//*=========================================================================*/
+int mmap_cartridge_type(const char* name)
+{
+    unsigned i;
+    for (i = 0; i < NUM_CARTRIDGE_NAMES; ++i)
+    {
+        if (strcmp(name, cartridge_names[i].name) == 0)
+            return cartridge_names[i].type;
+    }
+    return -1;
+}
+
+/*========================================================================*//**
+ * Convert a ROM size in kilobytes to its header code
+ *
+ * \return the ROM size code, -1 if the size is not valid
+ *//*=========================================================================*/
+int mmap_rom_size(int kbytes)
+{
+    int code;
+    for (code = _32K; code <= _8M; ++code)
+    {
+        if ((32 << code) == kbytes)
+            return code;
+    }
+    return -1;
+}
+
+/*========================================================================*//**
+ * Convert an external RAM size in kilobytes to its header code
+ *
+ * \return the RAM size code, -1 if the size is not valid
+ *//*=========================================================================*/
+int mmap_ram_size(int kbytes)
+{
+    switch (kbytes)
+    {
+        case 0:   return no_ram;
+        case 8:   return ram_8K;
+        case 32:  return ram_32K;
+        case 64:  return ram_64K;
+        case 128: return ram_128K;
+        default:  return -1;
+    }
+}
+
+/*========================================================================*//**
+ * Tell whether a ROM bank can be mapped in the switchable bank area. MBC1
+ * maps banks $21, $41 and $61 when $20, $40 or $60 are requested.
+ *//*=========================================================================*/
+int mmap_rom_bank_mappable(int bank)
+{
+    if (bank <= 0 || bank >= num_rom_banks)
+        return 0;
+    if ((cartridge.cart_type == mbc1 || cartridge.cart_type == mbc1_ram
+         || cartridge.cart_type == mbc1_ram_battery) && (bank & 0x1F) == 0)
+        return 0;
+    return 1;
+}
+
 int get_num_rom_banks()
 {
     return num_rom_banks;
@@ -37,17 +37,43 @@ typedef enum
 
 typedef enum
 {
-    rom_only = 0x00
+    rom_only                = 0x00,
+    mbc1                    = 0x01,
+    mbc1_ram                = 0x02,
+    mbc1_ram_battery        = 0x03,
+    mbc3_timer_battery      = 0x0F,
+    mbc3_timer_ram_battery  = 0x10,
+    mbc3                    = 0x11,
+    mbc3_ram                = 0x12,
+    mbc3_ram_battery        = 0x13,
+    mbc5                    = 0x19,
+    mbc5_ram                = 0x1A,
+    mbc5_ram_battery        = 0x1B,
+    mbc5_rumble             = 0x1C,
+    mbc5_rumble_ram         = 0x1D,
+    mbc5_rumble_ram_battery = 0x1E
 } cartridge_type_t;
 
 typedef enum
 {
-    _32K = 0x00
+    _32K = 0x00,
+    _64K,
+    _128K,
+    _256K,
+    _512K,
+    _1M,
+    _2M,
+    _4M,
+    _8M
 } rom_size_t;
 
 typedef enum
 {
-    no_ram = 0x00
+    no_ram   = 0x00,
+    ram_8K   = 0x02,
+    ram_32K  = 0x03,
+    ram_128K = 0x04,
+    ram_64K  = 0x05
 } ram_size_t;
 
 typedef struct cartridge_s
@@ -62,6 +88,10 @@ typedef struct cartridge_s
 
 void        set_cartridge(cartridge_t type);
 cartridge_t get_cartridge();
+int         mmap_cartridge_type(const char* name);
+int         mmap_rom_size(int kbytes);
+int         mmap_ram_size(int kbytes);
+int         mmap_rom_bank_mappable(int bank);
 int         get_num_rom_banks();
 int         get_num_ram_banks();
 int         get_num_wram_banks();
@@ -2,32 +2,134 @@
  * \addtogroup Commons
  * \{
  * \defgroup objfile Object file
+ * Objects are written in the version 4 format described in
+ * obj_file_format.txt: a hash of the inputs of the object, a block index, a
+ * string table and entries encoded with variable length integers. Its blocks
+ * are built in memory between write_obj_header and write_obj_end, as the
+ * offsets of the index are only known once the whole object has been
+ * written. Version 1 and 2 objects can still be read, in block order or by
+ * going straight to a block with find_block.
+ * The data of a section may be left unread by read_section_header until
+ * read_section_data is called.
+ *
+ * Fields are decoded from and encoded to memory buffers rather than with a
+ * stdio call each: the input file is read by chunks of IN_BUFFER_SIZE bytes,
+ * and what is not written to an object block is gathered in an output
+ * buffer until flush_outfile. Large data such as the contents of a section
+ * bypass these buffers.
  * \addtogroup objfile
  * \}
  */
 
 #include "objfile.h"
 
-#include <strings.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include "errors.h"
 #include "utils.h"
 
+#define OBJ_HEADER_SIZE 20  /**< signature, version, hash of the inputs and
+                             * number of blocks */
+#define V2_HEADER_SIZE  16  /**< the same without the hash */
+#define INDEX_ENTRY_SIZE 16
+
+/* Sizes of the version 1 entries, data excluded */
+#define V1_HEADER_SIZE  12
+#define V1_SECTION_SIZE 18
+#define V1_SYMBOL_SIZE  46
+#define V1_RELOC_SIZE   14
+
+#define IN_BUFFER_SIZE  4096
+#define OUT_BUFFER_SIZE 4096
+
+/** Block of an object being written */
+typedef struct out_block_s
+{
+    block_type_t   type;
+    int            num_entries;
+    unsigned char* data;
+    size_t         size;
+    size_t         capacity;
+} out_block_t;
+
+/** Entry of the block index of the object being read */
+typedef struct index_entry_s
+{
+    block_type_t type;
+    int          num_entries;
+    long         offset;    /**< from the start of the object */
+    long         size;
+} index_entry_t;
+
 static FILE* in = NULL;
 static FILE* out = NULL;
 
+/* Input buffer; the position of the input file is always its end */
+static unsigned char in_buf[IN_BUFFER_SIZE];
+static long          in_buf_pos;    /**< offset of in_buf in the file */
+static size_t        in_buf_len;
+static size_t        in_cur;        /**< next byte to decode */
+
+/* Output buffer, used when no object block is being built */
+static unsigned char out_buf[OUT_BUFFER_SIZE];
+static size_t        out_len = 0;
+
+/* Object being read */
+static int            in_version;
+static long           in_base;      /**< offset of the object in the file */
+static long           in_end;       /**< offset of its end */
+static index_entry_t* in_index = NULL;
+static int            in_blocks;
+static int            in_next;      /**< next block of the index to read */
+static unsigned char* in_strings = NULL;
+static long           in_strings_size;
+
+/* Object being written */
+static out_block_t* out_blocks = NULL;
+static int          out_num_blocks = 0;
+static int          out_building = 0;
+static unsigned long out_hash = 0;
+static int*         out_string_table = NULL; /**< offsets of the strings,
+                                              * hashed, -1 if free */
+static int          out_string_slots = 0;
+static int          out_num_strings = 0;
+
+static long          in_tell();
+static void          in_seek(long pos);
+static int           in_fill();
 static unsigned char read_int8();
 static int           read_int16();
 static int           read_int32();
+static unsigned      read_varint();
+static int           read_svarint();
 static void          read_data(unsigned char* dest, size_t size);
+static void          read_string(unsigned offset, unsigned char* id,
+                                 unsigned* hash);
+static void          read_section_fields(section_entry_t* sect);
 
-static void write_int16(int val);
+static unsigned char* reserve(size_t size);
 static void write_int32(int val);
+static void write_varint(unsigned val);
+static void write_svarint(int val);
 static void write_data(unsigned char* data, size_t size);
+static void grow(out_block_t* block, size_t size);
+static void append(out_block_t* block, const unsigned char* data,
+                   size_t size);
+static void add_block(block_type_t type, int num_entries);
+static int  add_string(const char* str);
+static void free_out_blocks();
 
+/*========================================================================*//**
+ * Set the file read by the functions of this module, from its current
+ * position. The file must not be moved by other means until the next call.
+ *//*=========================================================================*/
 void set_infile(FILE* infile)
 {
     in = infile;
+    in_buf_pos = infile ? ftell(infile) : 0;
+    in_buf_len = 0;
+    in_cur = 0;
 }
 
 void set_outfile(FILE* outfile)
@@ -35,50 +137,308 @@ void set_outfile(FILE* outfile)
     out = outfile;
 }
 
-void read_obj_header()
+/*========================================================================*//**
+ * FNV-1a hash of a symbol name, as stored in the string table
+ *//*=========================================================================*/
+unsigned hash_name(const char* name)
+{
+    return (unsigned)hash_data(HASH_INIT, name, strlen(name));
+}
+
+/*========================================================================*//**
+ * Continue a 32 bits FNV-1a hash over some data
+ *
+ * \param hash: hash of the previous data, HASH_INIT to start
+ * \return the hash
+ *//*=========================================================================*/
+unsigned long hash_data(unsigned long hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+
+    while (size--)
+    {
+        hash ^= *p++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/*========================================================================*//**
+ * Read the hash of the inputs of an object file from its header, without
+ * reading the rest of it
+ *
+ * \param file: the object file, read from its start
+ * \param hash: receives the hash
+ * \return 0 if the file is not an object carrying a hash
+ *//*=========================================================================*/
+int read_obj_hash(FILE* file, unsigned long* hash)
+{
+    unsigned char bytes[16];
+
+    if (fseek(file, 0, SEEK_SET) != 0
+        || fread(bytes, 1, 16, file) != 16
+        || strncmp((char*)bytes, "GBOBJECT", 8) != 0
+        || bytes[8] + (bytes[9] << 8) != 3 || bytes[10] || bytes[11])
+        return 0;
+    *hash = bytes[12] + ((unsigned long)bytes[13] << 8)
+            + ((unsigned long)bytes[14] << 16)
+            + ((unsigned long)bytes[15] << 24);
+    return *hash != 0;
+}
+
+/*========================================================================*//**
+ * Read the header of an object file from the current position of the input
+ * file. The index and the string table of a version 2 object are loaded.
+ *
+ * \param end: offset of the end of the object in the input file
+ *//*=========================================================================*/
+void read_obj_header(long end)
 {
     obj_header_t header;
+    int i;
+
+    in_base = in_tell();
+    in_end = end;
     read_data((unsigned char*)header.signature, 8);
     header.version = read_int32();
     if (strncmp((char*)header.signature, "GBOBJECT", 8) != 0)
         err(F, "invalid object file");
-    if (header.version != 1)
+    if (header.version < 1 || header.version > OBJ_VERSION)
         err(F, "object file format version not handled");
+    in_version = header.version;
+    if (in_version == 1)
+        return;
+    if (in_version >= 3)
+        read_int32();   /* hash of the inputs, see read_obj_hash */
+
+    free(in_index);
+    free(in_strings);
+    in_strings = NULL;
+    in_strings_size = 0;
+    in_next = 0;
+    in_blocks = read_int32();
+    if (in_blocks < 0
+        || (in_version == 2 ? V2_HEADER_SIZE : OBJ_HEADER_SIZE)
+           + (long)in_blocks * INDEX_ENTRY_SIZE > end - in_base)
+        err(F, "invalid object file: block index corrupted");
+
+    in_index = (index_entry_t*)mmalloc(sizeof(index_entry_t) * in_blocks + 1);
+    for (i = 0; i < in_blocks; ++i)
+    {
+        in_index[i].type = read_int32();
+        in_index[i].num_entries = read_int32();
+        in_index[i].offset = read_int32();
+        in_index[i].size = read_int32();
+        if (in_index[i].type < sections || in_index[i].type > lines
+            || in_index[i].num_entries < 0 || in_index[i].offset < 0
+            || in_index[i].size < 0
+            || in_index[i].offset + in_index[i].size > end - in_base)
+            err(F, "invalid object file: block index corrupted");
+    }
+
+    /* The string table is needed to read any symbol */
+    for (i = 0; i < in_blocks; ++i)
+    {
+        if (in_index[i].type != strings)
+            continue;
+        in_strings = (unsigned char*)mmalloc(in_index[i].size + 1);
+        in_strings_size = in_index[i].size;
+        in_seek(in_base + in_index[i].offset);
+        read_data(in_strings, in_strings_size);
+        break;
+    }
 }
 
+/*========================================================================*//**
+ * Read the header of the next block of the object and position the input
+ * file at its first entry
+ *
+ * \return the header, to be freed by the caller, or NULL after the last
+ * block
+ *//*=========================================================================*/
 block_header_t* read_block_header()
 {
-    block_header_t* header = (block_header_t*)mmalloc(sizeof(block_header_t));
-    header->type = read_int32();
-    header->num_entries = read_int32();
-    if (header->type < sections || header->type > relocations)
-        err(F, "invalid object file: unknown block type");
+    block_header_t* header;
+
+    if (in_version == 1)
+    {
+        if (in_tell() >= in_end)
+            return NULL;
+        header = (block_header_t*)mmalloc(sizeof(block_header_t));
+        header->type = read_int32();
+        header->num_entries = read_int32();
+        if (header->type < sections || header->type > relocations)
+            err(F, "invalid object file: unknown block type");
+        return header;
+    }
+
+    while (in_next < in_blocks && in_index[in_next].type == strings)
+        ++in_next;
+    if (in_next == in_blocks)
+        return NULL;
+
+    header = (block_header_t*)mmalloc(sizeof(block_header_t));
+    header->type = in_index[in_next].type;
+    header->num_entries = in_index[in_next].num_entries;
+    in_seek(in_base + in_index[in_next++].offset);
     return header;
 }
 
+/*========================================================================*//**
+ * Find a block of the object and position the input file at its first
+ * entry. A version 2 object is found through its index, the blocks of a
+ * version 1 object are skipped one by one.
+ *
+ * \param type: type of the block; an object has at most one of each type
+ * \return the header, to be freed by the caller, or NULL if the object has
+ * no such block
+ *//*=========================================================================*/
+block_header_t* find_block(block_type_t type)
+{
+    block_header_t* header;
+    int i;
+
+    if (in_version != 1)
+    {
+        for (i = 0; i < in_blocks; ++i)
+        {
+            if (in_index[i].type != type)
+                continue;
+            header = (block_header_t*)mmalloc(sizeof(block_header_t));
+            header->type = type;
+            header->num_entries = in_index[i].num_entries;
+            in_seek(in_base + in_index[i].offset);
+            return header;
+        }
+        return NULL;
+    }
+
+    in_seek(in_base + V1_HEADER_SIZE);
+    while ((header = read_block_header()) != NULL)
+    {
+        if (header->type == type)
+            return header;
+        for (i = 0; i < header->num_entries; ++i)
+        {
+            if (header->type == sections)
+            {
+                long size;
+                in_seek(in_tell() + V1_SECTION_SIZE - 4);
+                size = read_int32();
+                in_seek(in_tell() + size);
+            }
+            else if (header->type == symbols)
+                in_seek(in_tell() + V1_SYMBOL_SIZE);
+            else
+                in_seek(in_tell() + V1_RELOC_SIZE);
+        }
+        free(header);
+    }
+    return NULL;
+}
+
+/*========================================================================*//**
+ * Read a section entry and its data
+ *//*=========================================================================*/
 section_entry_t* read_section_entry()
 {
     section_entry_t* sect = (section_entry_t*)mmalloc(sizeof(section_entry_t));
-    sect->id = read_int32();
-    sect->type = read_int32();
-    sect->offset = read_int16();
-    sect->bank_num = read_int32();
-    sect->data_size = read_int32();
-    if (sect->type < org || sect->type > org)
-        err(F, "invalid object file: unknown section type");
+
+    read_section_fields(sect);
     sect->data = (unsigned char*)mmalloc(sect->data_size);
     read_data(sect->data, sect->data_size);
     return sect;
 }
 
+/*========================================================================*//**
+ * Read a section entry and skip its data, which read_section_data loads
+ * later if the section is kept
+ *
+ * \return the section, whose data is NULL and data_pos the position of the
+ * data in the input file
+ *//*=========================================================================*/
+section_entry_t* read_section_header()
+{
+    section_entry_t* sect = (section_entry_t*)mmalloc(sizeof(section_entry_t));
+
+    read_section_fields(sect);
+    sect->data = NULL;
+    sect->data_pos = in_tell();
+    in_seek(sect->data_pos + sect->data_size);
+    return sect;
+}
+
+/*========================================================================*//**
+ * Load the data of a section read by read_section_header. The input file
+ * must be the one the section was read from.
+ *//*=========================================================================*/
+void read_section_data(section_entry_t* sect)
+{
+    in_seek(sect->data_pos);
+    sect->data = (unsigned char*)mmalloc(sect->data_size);
+    read_data(sect->data, sect->data_size);
+    sect->data_pos = 0;
+}
+
+void read_section_fields(section_entry_t* sect)
+{
+    if (in_version == 1)
+    {
+        sect->id = read_int32();
+        sect->type = read_int32();
+        sect->offset = read_int16();
+        sect->bank_num = read_int32();
+        sect->data_size = read_int32();
+    }
+    else
+    {
+        sect->id = read_varint();
+        sect->type = read_varint();
+        sect->offset = read_varint();
+        sect->bank_num = read_svarint();
+        sect->data_size = read_varint();
+    }
+    sect->align = 0;
+
+    /* The attributes of a section are stored above its type */
+    sect->flags = sect->type & ~SECTION_TYPE_MASK;
+    sect->type &= SECTION_TYPE_MASK;
+    if (sect->type < org || sect->type > rom)
+        err(F, "invalid object file: unknown section type");
+
+    /* The offset of a floating section holds its alignment */
+    if (sect->type == rom)
+    {
+        sect->align = sect->offset;
+        sect->offset = 0;
+    }
+
+    if (sect->data_size < 0 || sect->data_size > in_end - in_tell())
+        err(F, "invalid object file: section %d too large", sect->id);
+    sect->data_pos = 0;
+}
+
 symbol_entry_t* read_symbol_entry()
 {
     symbol_entry_t* sym = (symbol_entry_t*)mmalloc(sizeof(symbol_entry_t));
-    sym->sym_id = read_int32();
-    read_data((unsigned char*)sym->id, 32);
-    sym->section_id = read_int32();
-    sym->offset = read_int16();
-    sym->type = read_int32();
+    if (in_version == 1)
+    {
+        sym->sym_id = read_int32();
+        read_data((unsigned char*)sym->id, 32);
+        sym->id[31] = 0;
+        sym->hash = hash_name((char*)sym->id);
+        sym->section_id = read_int32();
+        sym->offset = read_int16();
+        sym->type = read_int32();
+    }
+    else
+    {
+        sym->sym_id = read_varint();
+        read_string(read_varint(), sym->id, &sym->hash);
+        sym->section_id = read_svarint();
+        sym->offset = read_varint();
+        sym->type = read_varint();
+    }
     if (sym->type < none || sym->type > _extern)
         err(F, "invalid object file: unknown symbol type");
     return sym;
@@ -87,26 +447,115 @@ symbol_entry_t* read_symbol_entry()
 reloc_entry_t* read_reloc_entry()
 {
     reloc_entry_t* reloc = (reloc_entry_t*)mmalloc(sizeof(reloc_entry_t));
-    reloc->sym_id = read_int32();
-    reloc->section_id = read_int32();
-    reloc->offset = read_int16();
-    reloc->flags = read_int32();
+    if (in_version == 1)
+    {
+        reloc->sym_id = read_int32();
+        reloc->section_id = read_int32();
+        reloc->offset = read_int16();
+        reloc->flags = read_int32();
+        reloc->addend = 0;
+    }
+    else
+    {
+        reloc->sym_id = read_varint();
+        reloc->section_id = read_varint();
+        reloc->offset = read_varint();
+        reloc->flags = read_varint();
+        reloc->addend = read_svarint();
+    }
+    if (reloc->flags < absolute
+        || reloc->flags > (in_version >= 4 ? call_address : hram_byte))
+        err(F, "invalid object file: unknown relocation kind");
     return reloc;
 }
 
+line_entry_t* read_line_entry()
+{
+    line_entry_t* entry = (line_entry_t*)mmalloc(sizeof(line_entry_t));
+
+    entry->section_id = read_varint();
+    entry->offset = read_varint();
+    entry->file = read_varint();
+    entry->line = read_varint();
+    return entry;
+}
+
+/*========================================================================*//**
+ * Copy the name of the source file of a line entry, truncated if needed
+ *
+ * \param file: the file field of the entry
+ * \param name: receives the name with its terminator
+ * \param size: size of name
+ *//*=========================================================================*/
+void read_line_file(int file, char* name, size_t size)
+{
+    const unsigned char* p = in_strings + file;
+    size_t len;
+
+    if (in_strings == NULL || file < 0 || file + 5 > in_strings_size
+        || file + 5 + p[4] > in_strings_size)
+        err(F, "invalid object file: string table corrupted");
+    len = p[4] < size ? p[4] : size - 1;
+    memcpy(name, p + 5, len);
+    name[len] = 0;
+}
+
+/*========================================================================*//**
+ * Start an object. The header and the blocks are only written to the output
+ * file by write_obj_end.
+ *//*=========================================================================*/
 void write_obj_header()
 {
-    obj_header_t header;
-    strncpy((char*)header.signature, "GBOBJECT", 8);
-    header.version = 1;
-    write_data((unsigned char*)header.signature, 8);
-    write_int32(header.version);
+    free_out_blocks();
+    out_building = 1;
+    out_hash = 0;
+    add_block(strings, 0);
+}
+
+/*========================================================================*//**
+ * Set the hash of the inputs of the object being written (source, options,
+ * version of the tool...), so that it can be found up to date without being
+ * built again. 0, the default, means unknown.
+ *//*=========================================================================*/
+void set_obj_hash(unsigned long hash)
+{
+    out_hash = hash & 0xFFFFFFFFUL;
+}
+
+/*========================================================================*//**
+ * Write the object started by write_obj_header to the output file: header,
+ * block index, then the blocks in the order they were started
+ *//*=========================================================================*/
+void write_obj_end()
+{
+    long offset;
+    int i;
+
+    out_building = 0;
+    write_data((unsigned char*)"GBOBJECT", 8);
+    write_int32(OBJ_VERSION);
+    write_int32((int)out_hash);
+    write_int32(out_num_blocks);
+
+    offset = OBJ_HEADER_SIZE + (long)out_num_blocks * INDEX_ENTRY_SIZE;
+    for (i = 0; i < out_num_blocks; ++i)
+    {
+        write_int32(out_blocks[i].type);
+        write_int32(out_blocks[i].num_entries);
+        write_int32(offset);
+        write_int32(out_blocks[i].size);
+        offset += out_blocks[i].size;
+    }
+    for (i = 0; i < out_num_blocks; ++i)
+        write_data(out_blocks[i].data, out_blocks[i].size);
+
+    flush_outfile();
+    free_out_blocks();
 }
 
 void write_block_header(block_header_t* header)
 {
-    write_int32(header->type);
-    write_int32(header->num_entries);
+    add_block(header->type, header->num_entries);
 }
 
 /*========================================================================*//**
@@ -118,111 +567,503 @@ void write_block_header(block_header_t* header)
  *//*=========================================================================*/
 void write_section_entry(section_entry_t* entry)
 {
-    write_int32(entry->id);
-    write_int32(entry->type);
-    write_int16(entry->offset);
-    write_int32(entry->bank_num);
-    write_int32(entry->data_size);
+    write_varint(entry->id);
+    write_varint(entry->type | entry->flags);
+    write_varint(entry->type == rom ? entry->align : entry->offset);
+    write_svarint(entry->bank_num);
+    write_varint(entry->data_size);
 }
 
 void write_symbol_entry(symbol_entry_t* entry)
 {
-    write_int32(entry->sym_id);
-    write_data(entry->id, 32);
-    write_int32(entry->section_id);
-    write_int16(entry->offset);
-    write_int32(entry->type);
+    int name = add_string((char*)entry->id);
+
+    write_varint(entry->sym_id);
+    write_varint(name);
+    write_svarint(entry->section_id);
+    write_varint(entry->offset);
+    write_varint(entry->type);
 }
 
 void write_reloc_entry(reloc_entry_t* entry)
 {
-    write_int32(entry->sym_id);
-    write_int32(entry->section_id);
-    write_int16(entry->offset);
-    write_int32(entry->flags);
+    write_varint(entry->sym_id);
+    write_varint(entry->section_id);
+    write_varint(entry->offset);
+    write_varint(entry->flags);
+    write_svarint(entry->addend);
 }
 
 /*========================================================================*//**
- * Writes a single byte of data to the output file
+ * Write a line entry, its file name going to the string table
+ *
+ * \param entry: the entry, whose file field is ignored
+ * \param file: name of the source file
+ *//*=========================================================================*/
+void write_line_entry(line_entry_t* entry, const char* file)
+{
+    write_varint(entry->section_id);
+    write_varint(entry->offset);
+    write_varint(add_string(file));
+    write_varint(entry->line);
+}
+
+/*========================================================================*//**
+ * Write what is left in the output buffer to the output file. Needed before
+ * closing a file written without write_obj_end, such as an archive.
+ *//*=========================================================================*/
+void flush_outfile()
+{
+    if (out_len > 0 && fwrite(out_buf, 1, out_len, out) != out_len)
+        ccerr(F, "error while writing to the output file");
+    out_len = 0;
+}
+
+/*========================================================================*//**
+ * Tell whether a file is an archive, leaving its position unchanged
+ *//*=========================================================================*/
+int is_archive(FILE* file)
+{
+    char signature[8];
+    long pos = ftell(file);
+    int  ret;
+
+    ret = fread(signature, 1, 8, file) == 8
+          && strncmp(signature, "GBARCHIV", 8) == 0;
+    fseek(file, pos, SEEK_SET);
+    return ret;
+}
+
+void read_archive_header(archive_header_t* header)
+{
+    read_data(header->signature, 8);
+    header->version = read_int32();
+    if (strncmp((char*)header->signature, "GBARCHIV", 8) != 0)
+        err(F, "invalid archive");
+    if (header->version != 1)
+        err(F, "archive format version not handled");
+    header->num_members = read_int32();
+    header->num_symbols = read_int32();
+}
+
+void read_archive_member(archive_member_t* member)
+{
+    read_data(member->name, 32);
+    member->name[31] = 0;
+    member->offset = read_int32();
+    member->size = read_int32();
+}
+
+void read_archive_symbol(archive_symbol_t* sym)
+{
+    read_data(sym->id, 32);
+    sym->id[31] = 0;
+    sym->member = read_int32();
+}
+
+void write_archive_header(archive_header_t* header)
+{
+    strncpy((char*)header->signature, "GBARCHIV", 8);
+    header->version = 1;
+    write_data(header->signature, 8);
+    write_int32(header->version);
+    write_int32(header->num_members);
+    write_int32(header->num_symbols);
+}
+
+void write_archive_member(archive_member_t* member)
+{
+    write_data(member->name, 32);
+    write_int32(member->offset);
+    write_int32(member->size);
+}
+
+void write_archive_symbol(archive_symbol_t* sym)
+{
+    write_data(sym->id, 32);
+    write_int32(sym->member);
+}
+
+/*========================================================================*//**
+ * Writes a block of data to the output file, such as an archive member, or
+ * to the current block of the object being written
+ *//*=========================================================================*/
+void write_block(unsigned char* data, size_t size)
+{
+    write_data(data, size);
+}
+
+/*========================================================================*//**
+ * Writes a single byte of data to the output file, or to the current block
+ * of the object being written
  *
  * \param val: The value to write
  *//*=========================================================================*/
 void write_byte(unsigned char val)
 {
-    if (fputc(val, out) != val)
-        ccerr(F, "error while writing to the output file");
+    write_data(&val, 1);
+}
+
+/*========================================================================*//**
+ * \return the offset in the input file of the next byte to decode
+ *//*=========================================================================*/
+long in_tell()
+{
+    return in_buf_pos + (long)in_cur;
+}
+
+/*========================================================================*//**
+ * Move to an offset of the input file. The buffer is kept if it holds the
+ * offset, so that skipping section data or going back to an entry read
+ * shortly before costs nothing.
+ *//*=========================================================================*/
+void in_seek(long pos)
+{
+    if (pos >= in_buf_pos && pos <= in_buf_pos + (long)in_buf_len)
+    {
+        in_cur = pos - in_buf_pos;
+        return;
+    }
+    if (fseek(in, pos, SEEK_SET) != 0)
+        err(F, "invalid object file");
+    in_buf_pos = pos;
+    in_buf_len = 0;
+    in_cur = 0;
+}
+
+/*========================================================================*//**
+ * Read the chunk of the input file following the buffer
+ *
+ * \return 0 at the end of the file
+ *//*=========================================================================*/
+int in_fill()
+{
+    in_buf_pos += in_buf_len;
+    in_buf_len = fread(in_buf, 1, IN_BUFFER_SIZE, in);
+    in_cur = 0;
+    return in_buf_len > 0;
 }
 
 unsigned char read_int8()
 {
-    unsigned char val;
-    if (fread(&val, 1, 1, in) < 1)
+    if (in_cur == in_buf_len && !in_fill())
         err(F, "invalid object file");
-    return val;
+    return in_buf[in_cur++];
 }
 
 int read_int16()
 {
     unsigned char bytes[2];
-    if (fread(bytes, 1, 2, in) < 2)
-        err(F, "invalid object file");
-    return ((bytes[1] << 8) + bytes[0]);
+    const unsigned char* p = in_buf + in_cur;
+
+    if (in_buf_len - in_cur >= 2)
+        in_cur += 2;
+    else
+    {
+        read_data(bytes, 2);
+        p = bytes;
+    }
+    return ((p[1] << 8) + p[0]);
 }
 
 int read_int32()
 {
     unsigned char bytes[4];
-    if (fread(bytes, 1, 4, in) < 4)
-        err(F, "invalid object file");
-    return ((bytes[3] << 24) + (bytes[2] << 16) + (bytes[1] << 8) + bytes[0]);
+    const unsigned char* p = in_buf + in_cur;
+
+    if (in_buf_len - in_cur >= 4)
+        in_cur += 4;
+    else
+    {
+        read_data(bytes, 4);
+        p = bytes;
+    }
+    return ((p[3] << 24) + (p[2] << 16) + (p[1] << 8) + p[0]);
+}
+
+/*========================================================================*//**
+ * Read an unsigned variable length integer: 7 bits per byte, low bits
+ * first, bit 7 set on every byte but the last
+ *//*=========================================================================*/
+unsigned read_varint()
+{
+    unsigned val = 0;
+    int shift = 0;
+    unsigned char byte;
+
+    do
+    {
+        if (shift > 28)
+            err(F, "invalid object file: integer too large");
+        byte = in_cur < in_buf_len ? in_buf[in_cur++] : read_int8();
+        val |= (unsigned)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return val;
 }
 
+/*========================================================================*//**
+ * Read a signed variable length integer, zigzag encoded so that small
+ * negative values such as ANY_BANK stay short
+ *//*=========================================================================*/
+int read_svarint()
+{
+    unsigned val = read_varint();
+    return (val & 1) ? -(int)(val >> 1) - 1 : (int)(val >> 1);
+}
+
+/*========================================================================*//**
+ * Read bytes from the input buffer, or straight from the input file for
+ * what does not fit in it
+ *//*=========================================================================*/
 void read_data(unsigned char* dest, size_t size)
 {
-    if (fread(dest, 1, size, in) < size)
-        err(F, "invalid oject file");
+    size_t n = in_buf_len - in_cur;
+
+    if (size > n)
+    {
+        memcpy(dest, in_buf + in_cur, n);
+        dest += n;
+        size -= n;
+        in_cur = in_buf_len;
+        if (size >= IN_BUFFER_SIZE)
+        {
+            if (fread(dest, 1, size, in) < size)
+                err(F, "invalid object file");
+            in_buf_pos += in_buf_len + size;
+            in_buf_len = 0;
+            in_cur = 0;
+            return;
+        }
+        if (!in_fill() || in_buf_len < size)
+            err(F, "invalid object file");
+    }
+    memcpy(dest, in_buf + in_cur, size);
+    in_cur += size;
 }
 
 /*========================================================================*//**
- * Writes a 16 bits big-endian value to the output file
+ * Copy a string of the string table of the object being read
  *
- * \param val: The value to write
+ * \param offset: offset of the string entry in the table
+ * \param id: receives the string, 32 bytes long with its terminator
+ * \param hash: receives the hash of the string
  *//*=========================================================================*/
-void write_int16(int val)
+void read_string(unsigned offset, unsigned char* id, unsigned* hash)
 {
-    char bytes[2];
-    bytes[0] = ((val & 0x00FF));
-    bytes[1] = ((val & 0xFF00) >> 8);
-    if (fwrite(bytes, 1, 2, out) != 2)
-        ccerr(F, "error while writing to the output file");
+    const unsigned char* p = in_strings + offset;
+    const unsigned char* end = in_strings + in_strings_size;
+
+    if (in_strings == NULL || offset + 5 > (unsigned long)in_strings_size
+        || p[4] >= 32 || p + 5 + p[4] > end)
+        err(F, "invalid object file: string table corrupted");
+    *hash = p[0] + (p[1] << 8) + ((unsigned)p[2] << 16)
+            + ((unsigned)p[3] << 24);
+    memcpy(id, p + 5, p[4]);
+    id[p[4]] = 0;
+}
+
+/*========================================================================*//**
+ * Make room for an encoded field at the end of the current object block, or
+ * of the output buffer
+ *
+ * \param size: size of the field, at most OUT_BUFFER_SIZE
+ * \return where to encode the field
+ *//*=========================================================================*/
+unsigned char* reserve(size_t size)
+{
+    unsigned char* p;
+
+    if (out_building)
+    {
+        out_block_t* block = out_blocks + out_num_blocks - 1;
+        grow(block, size);
+        p = block->data + block->size;
+        block->size += size;
+        return p;
+    }
+
+    if (out_len + size > OUT_BUFFER_SIZE)
+        flush_outfile();
+    p = out_buf + out_len;
+    out_len += size;
+    return p;
 }
 
 /*========================================================================*//**
- * Writes a 32 bits big-endian value to the output file
+ * Writes a 32 bits little-endian value to the output
  *
  * \param val: The value to write
  *//*=========================================================================*/
 void write_int32(int val)
 {
-    char bytes[4];
+    unsigned char* bytes = reserve(4);
     bytes[0] = ((val & 0x000000FF));
     bytes[1] = ((val & 0x0000FF00) >> 8);
     bytes[2] = ((val & 0x00FF0000) >> 16);
     bytes[3] = ((val & 0xFF000000) >> 24);
-    if (fwrite(bytes, 1, 4, out) != 4)
-        ccerr(F, "error while writing to the output file");
+}
+
+void write_varint(unsigned val)
+{
+    unsigned char* bytes;
+    unsigned rest = val >> 7;
+    int n = 1;
+
+    while (rest)
+    {
+        rest >>= 7;
+        ++n;
+    }
+    bytes = reserve(n);
+    while (val >= 0x80)
+    {
+        *bytes++ = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    *bytes = val;
+}
+
+void write_svarint(int val)
+{
+    write_varint(val < 0 ? ((unsigned)(-(val + 1)) << 1) | 1
+                         : (unsigned)val << 1);
 }
 
 /*========================================================================*//**
- * Writes a block of data to the output file
+ * Writes a block of data to the current block of the object being written,
+ * or to the output buffer. Data larger than the buffer is written straight
+ * to the output file.
  *
  * \param data: Pointer to the data to write
  * \param size: Size of the block of data
  *//*=========================================================================*/
 void write_data(unsigned char* data, size_t size)
 {
-    if (fwrite(data, 1, size, out) != size)
-        ccerr(F, "error while writing to the output file");
+    if (out_building)
+    {
+        append(out_blocks + out_num_blocks - 1, data, size);
+        return;
+    }
+
+    if (out_len + size > OUT_BUFFER_SIZE)
+    {
+        flush_outfile();
+        if (size >= OUT_BUFFER_SIZE)
+        {
+            if (fwrite(data, 1, size, out) != size)
+                ccerr(F, "error while writing to the output file");
+            return;
+        }
+    }
+    memcpy(out_buf + out_len, data, size);
+    out_len += size;
+}
+
+void grow(out_block_t* block, size_t size)
+{
+    if (block->size + size > block->capacity)
+    {
+        block->capacity = block->capacity * 2 + size + 64;
+        block->data = (unsigned char*)mrealloc(block->data, block->capacity);
+    }
+}
+
+void append(out_block_t* block, const unsigned char* data, size_t size)
+{
+    grow(block, size);
+    memcpy(block->data + block->size, data, size);
+    block->size += size;
+}
+
+void add_block(block_type_t type, int num_entries)
+{
+    out_blocks = (out_block_t*)mrealloc(out_blocks, sizeof(out_block_t)
+                                                    * (out_num_blocks + 1));
+    memset(out_blocks + out_num_blocks, 0, sizeof(out_block_t));
+    out_blocks[out_num_blocks].type = type;
+    out_blocks[out_num_blocks++].num_entries = num_entries;
+}
+
+/*========================================================================*//**
+ * Add a string to the string table of the object being written, unless it
+ * is already there. An entry holds the hash of the string (4 bytes), its
+ * length (1 byte) and its characters; longer strings are truncated to 255
+ * characters.
+ *
+ * \return offset of the entry in the table
+ *//*=========================================================================*/
+int add_string(const char* str)
+{
+    out_block_t* table = out_blocks;
+    unsigned hash = hash_name(str);
+    size_t len = strlen(str) > 255 ? 255 : strlen(str);
+    unsigned char entry[5];
+    int slot, offset;
+
+    /* Keep the hash table of the offsets at most half full */
+    if (2 * (out_num_strings + 1) > out_string_slots)
+    {
+        int* old = out_string_table;
+        int old_slots = out_string_slots, i;
+
+        out_string_slots = out_string_slots ? out_string_slots * 2 : 64;
+        out_string_table = (int*)mmalloc(sizeof(int) * out_string_slots);
+        for (i = 0; i < out_string_slots; ++i)
+            out_string_table[i] = -1;
+        for (i = 0; i < old_slots; ++i)
+        {
+            const unsigned char* p;
+            if (old[i] < 0)
+                continue;
+            p = table->data + old[i];
+            slot = (p[0] + (p[1] << 8) + ((unsigned)p[2] << 16)
+                    + ((unsigned)p[3] << 24)) & (out_string_slots - 1);
+            while (out_string_table[slot] >= 0)
+                slot = (slot + 1) & (out_string_slots - 1);
+            out_string_table[slot] = old[i];
+        }
+        free(old);
+    }
+
+    slot = hash & (out_string_slots - 1);
+    while ((offset = out_string_table[slot]) >= 0)
+    {
+        if (table->data[offset + 4] == len
+            && memcmp(table->data + offset + 5, str, len) == 0)
+            return offset;
+        slot = (slot + 1) & (out_string_slots - 1);
+    }
+
+    offset = table->size;
+    entry[0] = hash & 0xFF;
+    entry[1] = (hash >> 8) & 0xFF;
+    entry[2] = (hash >> 16) & 0xFF;
+    entry[3] = (hash >> 24) & 0xFF;
+    entry[4] = len;
+    out_string_table[slot] = offset;
+    ++out_num_strings;
+    ++table->num_entries;
+
+    append(table, entry, 5);
+    append(table, (const unsigned char*)str, len);
+    return offset;
+}
+
+void free_out_blocks()
+{
+    int i;
+
+    for (i = 0; i < out_num_blocks; ++i)
+        free(out_blocks[i].data);
+    free(out_blocks);
+    free(out_string_table);
+    out_blocks = NULL;
+    out_num_blocks = 0;
+    out_string_table = NULL;
+    out_string_slots = 0;
+    out_num_strings = 0;
+    out_building = 0;
 }
 
 /**
@@ -10,18 +10,31 @@
 
 #include <stdio.h>
 
+#define OBJ_VERSION 4   /**< Version of the objects written */
+#define HASH_INIT   2166136261UL    /**< Start value of hash_data() */
+
 typedef enum
 {
     sections,
     symbols,
-    relocations
+    relocations,
+    strings,    /**< String table, version 2 only */
+    lines       /**< Source line table, version 2 only */
 } block_type_t;
 
 typedef enum
 {
-    org
+    org,    /**< Fixed address section */
+    rom     /**< Floating ROM section, placed by the linker */
 } section_type_t;
 
+#define ANY_BANK    -1  /**< Bank number of a floating section which can be
+                         * placed in any switchable ROM bank */
+
+#define SECTION_TYPE_MASK   0xFF    /**< Bits of the type in the type field */
+#define SECTION_LZ          0x100   /**< The linker stores the section
+                                     * compressed */
+
 typedef enum
 {
     none,
@@ -29,9 +42,16 @@ typedef enum
     _extern
 } sym_type_t;
 
+/** Kind of a relocation, stored in its flags */
 enum reloc_flags
 {
-    relative = 0x01
+    absolute = 0x00,    /**< 16 bits address */
+    relative = 0x01,    /**< 8 bits distance from the next byte (jr) */
+    low_byte = 0x02,    /**< LOW(symbol): low byte of the address */
+    high_byte = 0x03,   /**< HIGH(symbol): high byte of the address */
+    bank_byte = 0x04,   /**< BANK(symbol): ROM bank of the symbol */
+    hram_byte = 0x05,   /**< Low byte of an address in $FF00-$FFFF (ldh) */
+    call_address = 0x06 /**< 16 bits address, operand of a CALL or JP */
 };
 
 typedef struct obj_header_s
@@ -52,14 +72,20 @@ typedef struct section_entry_s
     section_type_t type;
     int            offset;
     int            bank_num;
+    int            align;     /**< Alignment of a floating section, 0 or 1
+                               * meaning none */
     int            data_size;
+    int            flags;     /**< SECTION_LZ */
     unsigned char* data;
+    long           data_pos;  /**< Position of the data in the object file
+                               * while it is not loaded, or 0 */
 } section_entry_t;
 
 typedef struct symbol_entry_s
 {
     int           sym_id;
     unsigned char id[32];
+    unsigned      hash;     /**< hash_name(id) */
     int           section_id;
     int           offset;
     sym_type_t    type;
@@ -70,23 +96,78 @@ typedef struct reloc_entry_s
     int sym_id;     /**< id of the pointed symbol */
     int section_id; /**< id of the section containing the address to relocate */
     int offset;     /**< offset in the section of the address to relocate */
-    int flags;      /**< relocation attributes flag */
+    int flags;      /**< kind of relocation */
+    int addend;     /**< added to the address of the symbol */
 } reloc_entry_t;
 
+typedef struct line_entry_s
+{
+    int section_id;
+    int offset;     /**< offset in the section of the first byte of the line */
+    int file;       /**< name of the source file, offset in the string table */
+    int line;
+} line_entry_t;
+
+typedef struct archive_header_s
+{
+    unsigned char signature[8];
+    int           version;
+    int           num_members;
+    int           num_symbols;
+} archive_header_t;
+
+typedef struct archive_member_s
+{
+    unsigned char name[32];
+    int           offset;   /**< offset of the object file in the archive */
+    int           size;     /**< size of the object file */
+} archive_member_t;
+
+typedef struct archive_symbol_s
+{
+    unsigned char id[32];
+    int           member;   /**< index of the member defining the symbol */
+} archive_symbol_t;
+
+#define ARCHIVE_HEADER_SIZE 20
+#define ARCHIVE_MEMBER_SIZE 40
+#define ARCHIVE_SYMBOL_SIZE 36
+
 void             set_infile(FILE* infile);
 void             set_outfile(FILE* outfile);
-void             read_obj_header();
+unsigned         hash_name(const char* name);
+unsigned long    hash_data(unsigned long hash, const void* data, size_t size);
+int              read_obj_hash(FILE* file, unsigned long* hash);
+void             read_obj_header(long end);
 block_header_t*  read_block_header();
+block_header_t*  find_block(block_type_t type);
 section_entry_t* read_section_entry();
+section_entry_t* read_section_header();
+void             read_section_data(section_entry_t* sect);
 symbol_entry_t*  read_symbol_entry();
 reloc_entry_t*   read_reloc_entry();
+line_entry_t*    read_line_entry();
+void             read_line_file(int file, char* name, size_t size);
 void             write_obj_header();
+void             set_obj_hash(unsigned long hash);
+void             write_obj_end();
 void             write_block_header(block_header_t* header);
 void             write_section_entry(section_entry_t* entry);
 void             write_symbol_entry(symbol_entry_t* entry);
 void             write_reloc_entry(reloc_entry_t* reloc);
+void             write_line_entry(line_entry_t* entry, const char* file);
 void             write_byte(unsigned char val);
 
+int              is_archive(FILE* file);
+void             read_archive_header(archive_header_t* header);
+void             read_archive_member(archive_member_t* member);
+void             read_archive_symbol(archive_symbol_t* sym);
+void             write_archive_header(archive_header_t* header);
+void             write_archive_member(archive_member_t* member);
+void             write_archive_symbol(archive_symbol_t* sym);
+void             write_block(unsigned char* data, size_t size);
+void             flush_outfile();
+
 #endif
 
 /**
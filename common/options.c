@@ -17,17 +17,33 @@
 #include "utils.h"
 #include "files.h"
 #include "defs.h"
+#include "objfile.h"
 
 option_t options[NUM_OPTIONS] =
 {
     { "--help",      flag,   {.num = 0 },   NULL,       0, 1, 1 },
     { "--version",   flag,   {.num = 0 },   NULL,       0, 1, 1 },
     { "-ftabstop=",  number, {.num = 8 },   NULL,       0, 1, 0 },
+    { "-ftime-report", flag, {.num = 0 },   NULL,       0, 1, 1 },
     { "-E",          flag,   {.num = 0 },   NULL,       0, 0, 0 },
     { "-S",          flag,   {.num = 0 },   NULL,       0, 0, 0 },
     { "-c",          flag,   {.num = 0 },   NULL,       0, 1, 0 },
+    { "-j",          number, {.num = 0 },   NULL,       0, 0, 0 },
     { "-o",          string, {.str = NULL}, "filename", 0, 1, 1 },
-    { "-g",          flag,   {.num = 0},    NULL,       0, 1, 1 }
+    { "-g",          flag,   {.num = 0},    NULL,       0, 1, 1 },
+    { "--print-memory-usage", flag, {.num = 0}, NULL,       0, 0, 1 },
+    { "--print-far-calls", flag, {.num = 0},   NULL,       0, 0, 1 },
+    { "--gc-sections", flag, {.num = 0},   NULL,       0, 0, 1 },
+    { "--fold-sections", flag, {.num = 0}, NULL,       0, 0, 1 },
+    { "--keep=",     string, {.str = NULL}, "symbols",  0, 0, 1 },
+    { "--profile=",  string, {.str = NULL}, "file",     0, 0, 1 },
+    { "--incremental", string, {.str = NULL}, "file",   0, 0, 1 },
+    { "-Map=",       string, {.str = NULL}, "file",     0, 0, 1 },
+    { "--map-json=", string, {.str = NULL}, "file",     0, 0, 1 },
+    { "--verify",    flag,   {.num = 0},    NULL,       0, 0, 1 },
+    { "-mcartridge=", string, {.str = NULL}, "type",    0, 1, 1 },
+    { "-mrom-size=", number, {.num = 32 },  NULL,       0, 1, 1 },
+    { "-mram-size=", number, {.num = 0 },   NULL,       0, 1, 1 }
 };
 
 static cartridge_t cartridge =
@@ -43,7 +59,7 @@ static void read_number(char* p, option_t* opt);
 static void read_string(option_t* opt, int* iarg, int argc, char** argv);
 
 /*========================================================================*//**
- * \param program: One of GBCC, GBAS or GBLD
+ * \param program: One of GBCC, GBAS, GBLD or GBAR
  * \param help: Pointer to a function displaying the help message
  * \param version: Pointer to a function displaying the version message
  *//*=========================================================================*/
@@ -107,6 +123,13 @@ void parse_options(int argc, char** argv, int program, void(*help)(),
                     continue;
                 }
 
+                /* The archiver only needs the output file name */
+                if (program == GBAR && strcmp(opt->name, "-o") != 0)
+                {
+                    ccerr(E, "unrecognized command line option '%s'.", argv[i]);
+                    continue;
+                }
+
                 opt->set = 1;
                 if (opt->type != flag)
                 {
@@ -156,6 +179,36 @@ void parse_options(int argc, char** argv, int program, void(*help)(),
         opt->set = 0;
     }
     
+    opt = get_option("-mcartridge=");
+    if (opt->set)
+    {
+        int type = mmap_cartridge_type(opt->value.str);
+        if (type < 0)
+            ccerr(F, "unknown cartridge type '%s'", opt->value.str);
+        else
+            cartridge.cart_type = (cartridge_type_t)type;
+    }
+
+    opt = get_option("-mrom-size=");
+    if (opt->set)
+    {
+        int size = mmap_rom_size(opt->value.num);
+        if (size < 0)
+            ccerr(F, "invalid ROM size %d KB", opt->value.num);
+        else
+            cartridge.rom_size = (rom_size_t)size;
+    }
+
+    opt = get_option("-mram-size=");
+    if (opt->set)
+    {
+        int size = mmap_ram_size(opt->value.num);
+        if (size < 0)
+            ccerr(F, "invalid RAM size %d KB", opt->value.num);
+        else
+            cartridge.ram_size = (ram_size_t)size;
+    }
+
     set_cartridge(cartridge);
 }
 
@@ -224,6 +277,15 @@ char** gen_options(unsigned program)
             opts[num_opts-1] = (char*)mmalloc(strlen(buf) + 1);
             strcpy(opts[num_opts-1], buf);
         }
+        else if (options[i].type == string
+                 && options[i].name[strlen(options[i].name) - 1] == '=')
+        {   /* -opt=<string> */
+            opts[num_opts-1] = (char*)mmalloc(strlen(options[i].name)
+                                              + strlen(options[i].value.str)
+                                              + 1);
+            sprintf(opts[num_opts-1], "%s%s", options[i].name,
+                    options[i].value.str);
+        }
         else if (options[i].type == string) /* -opt <string> */
         {
             unsigned j;
@@ -257,6 +319,41 @@ char** gen_options(unsigned program)
     return opts;
 }
 
+/*========================================================================*//**
+ * Continue a hash with the options set for a program, the name then the value
+ * of each of them
+ *
+ * \param hash: hash of the previous data, HASH_INIT to start a new one
+ * \param program: GBAS or GBLD
+ * \param skip: null-terminated prefixes of the option names left out
+ * \return the new hash
+ *//*=========================================================================*/
+unsigned long hash_options(unsigned long hash, unsigned program,
+                           const char* const skip[])
+{
+    unsigned i, j;
+
+    for (i = 0; i < NUM_OPTIONS; ++i)
+    {
+        option_t* opt = options + i;
+        if (!opt->set || (program == GBAS ? !opt->as_opt : !opt->ld_opt))
+            continue;
+        for (j = 0; skip[j]; ++j)
+            if (strncmp(opt->name, skip[j], strlen(skip[j])) == 0)
+                break;
+        if (skip[j])
+            continue;
+        hash = hash_data(hash, opt->name, strlen(opt->name) + 1);
+        if (opt->type == number)
+            hash = hash_data(hash, &opt->value.num, sizeof(opt->value.num));
+        else if (opt->type == string && opt->value.str)
+            hash = hash_data(hash, opt->value.str, strlen(opt->value.str));
+    }
+
+    return hash;
+}
+
+
 char** add_option(char** options, char* opt)
 {
     unsigned nopt = 0;
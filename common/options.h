@@ -11,7 +11,8 @@
 #define GBCC        0   /**< gbcc program id */
 #define GBAS        1   /**< gbas program id */
 #define GBLD        2   /**< gbld program id */
-#define NUM_OPTIONS 8
+#define GBAR        3   /**< gbar program id */
+#define NUM_OPTIONS 23
 
 typedef enum
 {
@@ -43,6 +44,8 @@ void         parse_options(int argc, char** argv, int program, void(*help)(),
                            void(*version)());
 option_t* get_option(const char* name);
 char**    gen_options(unsigned program);
+unsigned long hash_options(unsigned long hash, unsigned program,
+                           const char* const skip[]);
 char**    add_option(char** options, char* opt);
 void      free_options(char* options[]);
 
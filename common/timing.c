@@ -0,0 +1,174 @@
+/**
+ * \addtogroup Commons
+ * \{
+ * \defgroup Timing
+ * Time and memory spent in each phase of a program, printed with
+ * -ftime-report. A phase entered several times accumulates its times and
+ * allocations. The peak is the largest resident size of the process at the
+ * end of the phase, which includes the memory of the previous phases.
+ * \addtogroup Timing
+ * \{
+ */
+
+#include "timing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/time.h>
+    #include <sys/resource.h>
+#endif
+
+#include "utils.h"
+
+#define MAX_PHASES  32
+
+typedef struct phase_s
+{
+    const char*   name;
+    double        wall;     /**< seconds */
+    double        cpu;      /**< seconds */
+    unsigned long allocs;   /**< calls to mmalloc and mrealloc */
+    unsigned long bytes;    /**< bytes they requested */
+    long          peak;     /**< KB, -1 if unknown */
+} phase_t;
+
+static phase_t       phases[MAX_PHASES];
+static int           num_phases = 0;
+static int           current = -1;
+static double        start_wall;
+static clock_t       start_cpu;
+static unsigned long start_allocs;
+static unsigned long start_bytes;
+
+static double wall_time();
+static long   peak_memory();
+
+/*========================================================================*//**
+ * End the current phase, if any, and start another one
+ *
+ * \param phase: name of the phase, a string which must stay valid
+ *//*=========================================================================*/
+void timing_start(const char* phase)
+{
+    int i;
+
+    timing_stop();
+    for (i = 0; i < num_phases; ++i)
+    {
+        if (strcmp(phases[i].name, phase) == 0)
+            break;
+    }
+    if (i == num_phases)
+    {
+        if (num_phases == MAX_PHASES)
+            return;
+        memset(&phases[num_phases], 0, sizeof(phase_t));
+        phases[num_phases++].name = phase;
+    }
+
+    current = i;
+    alloc_stats(&start_allocs, &start_bytes);
+    start_cpu = clock();
+    start_wall = wall_time();
+}
+
+/*========================================================================*//**
+ * End the current phase
+ *//*=========================================================================*/
+void timing_stop()
+{
+    unsigned long allocs, bytes;
+
+    if (current < 0)
+        return;
+    phases[current].wall += wall_time() - start_wall;
+    phases[current].cpu += (double)(clock() - start_cpu) / CLOCKS_PER_SEC;
+    alloc_stats(&allocs, &bytes);
+    phases[current].allocs += allocs - start_allocs;
+    phases[current].bytes += bytes - start_bytes;
+    phases[current].peak = peak_memory();
+    current = -1;
+}
+
+/*========================================================================*//**
+ * Print the times and allocations of the phases, in the order they were
+ * first entered
+ *
+ * \param program: name of the program, heading the report
+ *//*=========================================================================*/
+void timing_report(const char* program)
+{
+    double wall = 0, cpu = 0;
+    unsigned long allocs = 0, bytes = 0;
+    long peak = -1;
+    int i;
+
+    timing_stop();
+    fprintf(stderr, "%-20s %10s %10s %10s %10s %10s\n", program, "Wall (ms)",
+            "CPU (ms)", "Allocs", "Alloc (KB)", "Peak (KB)");
+    for (i = 0; i < num_phases; ++i)
+    {
+        fprintf(stderr, "%-20s %10.3f %10.3f %10lu %10lu ", phases[i].name,
+                phases[i].wall * 1000, phases[i].cpu * 1000, phases[i].allocs,
+                (phases[i].bytes + 1023) / 1024);
+        if (phases[i].peak < 0)
+            fprintf(stderr, "%10s\n", "-");
+        else
+            fprintf(stderr, "%10ld\n", phases[i].peak);
+        wall += phases[i].wall;
+        cpu += phases[i].cpu;
+        allocs += phases[i].allocs;
+        bytes += phases[i].bytes;
+        if (phases[i].peak > peak)
+            peak = phases[i].peak;
+    }
+    fprintf(stderr, "%-20s %10.3f %10.3f %10lu %10lu ", "Total", wall * 1000,
+            cpu * 1000, allocs, (bytes + 1023) / 1024);
+    if (peak < 0)
+        fprintf(stderr, "%10s\n", "-");
+    else
+        fprintf(stderr, "%10ld\n", peak);
+}
+
+double wall_time()
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+/*========================================================================*//**
+ * \return the peak resident size of the process in KB, -1 if unknown
+ *//*=========================================================================*/
+long peak_memory()
+{
+#ifdef _WIN32
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  /* bytes on macOS */
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/**
+ * \} Timing
+ * \} Commons
+ */
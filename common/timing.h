@@ -0,0 +1,20 @@
+/**
+ * \addtogroup Commons
+ * \{
+ * \addtogroup Timing
+ * \{
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+void timing_start(const char* phase);
+void timing_stop();
+void timing_report(const char* program);
+
+#endif
+
+/**
+ * \} Timing
+ * \} Commons
+ */
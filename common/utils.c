@@ -23,6 +23,28 @@
 #include "errors.h"
 #include "defs.h"
 
+static unsigned long alloc_count = 0;   /**< Calls to mmalloc and mrealloc */
+static unsigned long alloc_bytes = 0;   /**< Bytes they requested */
+
+/** A call started by spawn_call() */
+typedef struct
+{
+    const char* file;       /**< Name of the job, NULL if the slot is free */
+#ifdef _WIN32
+    int         result;     /**< What the call returned */
+#else
+    pid_t       pid;
+#endif
+} job_t;
+
+static job_t jobs[MAX_JOBS];
+static int   num_jobs = 0;          /**< Jobs not waited for yet */
+
+static int   free_job();
+#ifndef _WIN32
+static int   exit_status(const char* file, int status);
+#endif
+
 /*========================================================================*//**
  * Allocates a block of memory or throws a fatal error in case of failure
  *
@@ -33,6 +55,8 @@
  void* mmalloc(size_t size)
  {
     void* new = malloc(size);
+    ++alloc_count;
+    alloc_bytes += size;
     if (new == NULL)
         ccerr(F, "unable to allocate memory");
     return new;
@@ -50,11 +74,26 @@
  void* mrealloc(void* ptr, size_t size)
  {
     void* new = realloc(ptr, size);
+    ++alloc_count;
+    alloc_bytes += size;
     if (new == NULL)
         ccerr(F, "unable to allocate memory");
     return new;
  }
 
+/*========================================================================*//**
+ * Get the number of calls to mmalloc and mrealloc and the bytes they
+ * requested since the start of the program. The memory freed is not known.
+ *
+ * \param count: receives the number of calls
+ * \param bytes: receives the number of bytes
+ *//*=========================================================================*/
+void alloc_stats(unsigned long* count, unsigned long* bytes)
+{
+    *count = alloc_count;
+    *bytes = alloc_bytes;
+}
+
 /*========================================================================*//**
  * Generates a temporary file name
  *
@@ -176,7 +215,12 @@ int exec(char* file, char* const args[])
     CloseHandle(pi.hProcess);
     CloseHandle(pi.hThread);
     
-    return (int)exit_code;
+    if (exit_code)
+    {
+        add_error();
+        return 0;
+    }
+    return 1;
 #else
     pid_t pid = fork();
     if (pid == 0)
@@ -190,19 +234,7 @@ int exec(char* file, char* const args[])
     {
         int status;
         if (waitpid(pid, &status, 0) > 0)
-        {
-            if (WIFEXITED(status) && WEXITSTATUS(status))
-            {
-                add_error();
-                return 0;
-            }
-            else if (!(WIFEXITED(status) && !WEXITSTATUS(status)))
-            {
-                ccerr(F, "%s terminated abnoarmally\n", file);
-                return 0;
-            }
-            return 1;
-        }
+            return exit_status(file, status);
         else
         {
             ccerr(F, "waitpid() failed\n");
@@ -217,6 +249,166 @@ int exec(char* file, char* const args[])
 #endif
 }
 
+/*========================================================================*//**
+ * Run a function in a child process, without waiting for it to end. The
+ * child starts with a copy of the memory of the program and exits once the
+ * function returns, so the function can change any global state. Without
+ * fork(), on Windows, the function is run before returning.
+ *
+ * \param name: name given to the job in the error messages, which must stay
+ * valid until it ends
+ * \param call: the function, returning nonzero on success
+ * \param arg: its argument
+ * \return an id from 0 to MAX_JOBS - 1, given back by wait_job() when the
+ * function has returned, or -1 if it could not be started
+ *//*=========================================================================*/
+int spawn_call(const char* name, int (*call)(void*), void* arg)
+{
+    int id = free_job();
+
+    if (id < 0)
+        return -1;
+
+#ifdef _WIN32
+    jobs[id].result = call(arg);
+#else
+    {
+        pid_t pid;
+
+        /* The child must not write again what is still buffered */
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0)
+            exit(call(arg) ? EXIT_SUCCESS : EXIT_FAILURE);
+        else if (pid < 0)
+        {
+            ccerr(F, "fork() failed\n");
+            return -1;
+        }
+        jobs[id].pid = pid;
+    }
+#endif
+
+    jobs[id].file = name;
+    ++num_jobs;
+    return id;
+}
+
+/*========================================================================*//**
+ * \return the first free slot of the jobs, -1 if they are all used
+ *//*=========================================================================*/
+int free_job()
+{
+    int id = 0;
+
+    while (id < MAX_JOBS && jobs[id].file)
+        ++id;
+    if (id == MAX_JOBS)
+    {
+        ccerr(F, "too many jobs running\n");
+        return -1;
+    }
+    return id;
+}
+
+/*========================================================================*//**
+ * Wait for one of the jobs started by spawn_call() to end
+ *
+ * \param id: receives the id of the job, -1 if none was running
+ * \return 1 if the job succeeded, 0 otherwise
+ *//*=========================================================================*/
+int wait_job(int* id)
+{
+    *id = -1;
+    if (!num_jobs)
+        return 0;
+
+#ifdef _WIN32
+    {
+        int i;
+
+        /* The call has already returned and reported its errors */
+        for (i = 0; !jobs[i].file; ++i)
+            ;
+        *id = i;
+        jobs[i].file = NULL;
+        --num_jobs;
+        return jobs[i].result;
+    }
+#else
+    for (;;)
+    {
+        const char* file;
+        int status;
+        int i;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid <= 0)
+        {
+            ccerr(F, "waitpid() failed\n");
+            return 0;
+        }
+
+        /* Children started by exec() are waited for by exec() */
+        for (i = 0; i < MAX_JOBS; ++i)
+        {
+            if (jobs[i].file && jobs[i].pid == pid)
+                break;
+        }
+        if (i == MAX_JOBS)
+            continue;
+
+        *id = i;
+        file = jobs[i].file;
+        jobs[i].file = NULL;
+        --num_jobs;
+        return exit_status(file, status);
+    }
+#endif
+}
+
+/*========================================================================*//**
+ * \return the number of processors available, at least 1
+ *//*=========================================================================*/
+int num_cpus()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+#ifndef _WIN32
+/*========================================================================*//**
+ * Check how a child process ended. A program which failed has reported its
+ * errors itself, they are only counted.
+ *
+ * \param file: name of the program
+ * \param status: status given by waitpid()
+ * \return 1 if the program succeeded, 0 otherwise
+ *//*=========================================================================*/
+int exit_status(const char* file, int status)
+{
+    if (WIFEXITED(status) && WEXITSTATUS(status))
+    {
+        add_error();
+        return 0;
+    }
+    else if (!(WIFEXITED(status) && !WEXITSTATUS(status)))
+    {
+        ccerr(F, "%s terminated abnoarmally\n", file);
+        return 0;
+    }
+    return 1;
+}
+#endif
+
 /**
  * \} Utils
  * \} Commons
@@ -10,11 +10,17 @@
 
 #include <stdio.h>
 
+#define MAX_JOBS    64  /**< Jobs started by spawn_call() at the same time */
+
 char* m_tmpnam();
 void* mmalloc(size_t size);
 void* mrealloc(void* ptr, size_t size);
+void  alloc_stats(unsigned long* count, unsigned long* bytes);
 int   copy_file(const char* src, const char* dst);
 int   exec(char* path, char* const args[]);
+int   spawn_call(const char* name, int (*call)(void*), void* arg);
+int   wait_job(int* id);
+int   num_cpus();
 
 #endif
 
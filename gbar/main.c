@@ -0,0 +1,216 @@
+/**
+ * \defgroup gbar gbar
+ * Archiver. Gathers object files into a static library with an index of
+ * their global symbols, so that the linker only reads the members it needs.
+ * \addtogroup gbar
+ * \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/errors.h"
+#include "../common/files.h"
+#include "../common/options.h"
+#include "../common/utils.h"
+#include "../common/objfile.h"
+#include "version.h"
+
+const char* const pgm = "gbar";
+
+typedef struct member_s
+{
+    archive_member_t entry;
+    unsigned char*   data;
+} member_t;
+
+static member_t*         members = NULL;
+static int               num_members = 0;
+static archive_symbol_t* globals = NULL;
+static int               num_globals = 0;
+
+void help();
+void version();
+void on_fatal_error(int from_program);
+void read_member(const char* name);
+int  compare_symbol(const void* a, const void* b);
+void free_members();
+
+int main(int argc, char** argv)
+{
+    sourcefile_t* file;
+    archive_header_t header;
+    FILE* outfile;
+    int offset, i;
+
+    esetprogram(pgm);
+    esetonfatal(&on_fatal_error);
+
+    parse_options(argc, argv, GBAR, &help, &version);
+
+    if (errors())
+        return EXIT_FAILURE;
+
+    if (!get_option("-o")->set)
+        ccerr(F, "no output archive, use -o <file>");
+
+    file_first();
+    while ((file = file_next()))
+    {
+        esetfile(file->name);
+        read_member(file->name);
+    }
+
+    /* The index is sorted so that the linker can search it */
+    qsort(globals, num_globals, sizeof(archive_symbol_t), &compare_symbol);
+    for (i = 1; i < num_globals; ++i)
+    {
+        if (strcmp((char*)globals[i - 1].id, (char*)globals[i].id) == 0)
+            ccerr(E, "symbol '%s' defined in both %s and %s", globals[i].id,
+                  members[globals[i - 1].member].entry.name,
+                  members[globals[i].member].entry.name);
+    }
+
+    if (errors())
+    {
+        free_members();
+        return EXIT_FAILURE;
+    }
+
+    offset = ARCHIVE_HEADER_SIZE + num_members * ARCHIVE_MEMBER_SIZE
+             + num_globals * ARCHIVE_SYMBOL_SIZE;
+    for (i = 0; i < num_members; ++i)
+    {
+        members[i].entry.offset = offset;
+        offset += members[i].entry.size;
+    }
+
+    if (!(outfile = fopen(get_option("-o")->value.str, "wb")))
+        ccerr(F, "unable to open \"%s\"", get_option("-o")->value.str);
+
+    set_outfile(outfile);
+    header.num_members = num_members;
+    header.num_symbols = num_globals;
+    write_archive_header(&header);
+    for (i = 0; i < num_members; ++i)
+        write_archive_member(&members[i].entry);
+    for (i = 0; i < num_globals; ++i)
+        write_archive_symbol(&globals[i]);
+    for (i = 0; i < num_members; ++i)
+        write_block(members[i].data, members[i].entry.size);
+    flush_outfile();
+    fclose(outfile);
+
+    free_members();
+    return errors() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*========================================================================*//**
+ * Read an object file and add its global symbols to the index
+ *//*=========================================================================*/
+void read_member(const char* name)
+{
+    FILE* infile;
+    member_t* member;
+    block_header_t* header;
+    const char* base;
+    long fsize;
+    int i;
+
+    if (!(infile = fopen(name, "rb")))
+    {
+        ccerr(F, "unable to open \"%s\"", name);
+        return;
+    }
+
+    fseek(infile, 0, SEEK_END);
+    fsize = ftell(infile);
+    fseek(infile, 0, SEEK_SET);
+
+    members = (member_t*)mrealloc(members,
+                                  sizeof(member_t) * (num_members + 1));
+    member = members + num_members++;
+    memset(&member->entry, 0, sizeof(archive_member_t));
+    base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    strncpy((char*)member->entry.name, base, sizeof(member->entry.name) - 1);
+    member->entry.size = fsize;
+    member->data = (unsigned char*)mmalloc(fsize);
+    if (fread(member->data, 1, fsize, infile) != (size_t)fsize)
+        ccerr(F, "unable to read \"%s\"", name);
+
+    fseek(infile, 0, SEEK_SET);
+    set_infile(infile);
+    read_obj_header(fsize);
+
+    /* Only the symbols are needed for the index */
+    if ((header = find_block(symbols)) != NULL)
+    {
+        for (i = 0; i < header->num_entries; ++i)
+        {
+            symbol_entry_t* sym = read_symbol_entry();
+            if (sym->type == _global)
+            {
+                globals = (archive_symbol_t*)mrealloc(globals,
+                            sizeof(archive_symbol_t) * (num_globals + 1));
+                memcpy(globals[num_globals].id, sym->id, 32);
+                globals[num_globals++].member = num_members - 1;
+            }
+            free(sym);
+        }
+        free(header);
+    }
+
+    fclose(infile);
+}
+
+int compare_symbol(const void* a, const void* b)
+{
+    return strcmp((char*)((archive_symbol_t*)a)->id,
+                  (char*)((archive_symbol_t*)b)->id);
+}
+
+void free_members()
+{
+    int i;
+
+    for (i = 0; i < num_members; ++i)
+        free(members[i].data);
+    free(members);
+    free(globals);
+    members = NULL;
+    globals = NULL;
+    num_members = 0;
+    num_globals = 0;
+}
+
+void help()
+{
+    puts("Usage: gbar [options] file...");
+    puts("Options:");
+    puts("  --help      Display this information");
+    puts("  --version   Display archiver version information");
+    puts("  -o <file>   Place the archive into <file>");
+    exit(EXIT_SUCCESS);
+}
+
+void version()
+{
+#ifdef NDEBUG
+    printf("%s %d.%d.%d\n", pgm, VERSION_MAJOR, VERSION_MINOR, PATCH);
+#else
+    printf("%s %d.%d.%d debug\n", pgm, VERSION_MAJOR, VERSION_MINOR, PATCH);
+#endif
+    exit(EXIT_SUCCESS);
+}
+
+void on_fatal_error(int from_program)
+{
+    (void)from_program;
+    free_members();
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \}
+ */
@@ -0,0 +1,17 @@
+/**
+ * \addtogroup gbar
+ * \{
+ */
+
+#ifndef VERSION_H
+#define VERSION_H
+
+#define VERSION_MAJOR   0
+#define VERSION_MINOR   1
+#define PATCH           0
+
+#endif
+
+/**
+ * \}
+ */
@@ -0,0 +1,103 @@
+/**
+ * \addtogroup gbas
+ * \{
+ * \defgroup Lines
+ * Source line table, recorded with -g: the offset in its section of the
+ * first byte generated by each line of the source file
+ * \addtogroup Lines
+ * \{
+ */
+
+#include "lines.h"
+
+#include <stdlib.h>
+
+#include "../common/utils.h"
+#include "../common/objfile.h"
+
+typedef struct line_s
+{
+    int section_id;
+    int offset;
+    int line;
+    struct line_s* next;
+} line_t;
+
+static line_t* root = NULL;
+static line_t* cur = NULL;
+static int lines_count;
+
+void init_lines()
+{
+    free_lines();
+    lines_count = 0;
+}
+
+void free_lines()
+{
+    line_t* next = root;
+    while (next)
+    {
+        cur = next;
+        next = cur->next;
+        free(cur);
+    }
+    root = NULL;
+    cur = NULL;
+}
+
+/*========================================================================*//**
+ * Add a line to the table
+ *
+ * \param section_id: id of the section the line generated bytes in
+ * \param offset: offset of its first byte in the section
+ * \param line: line number in the source file
+ *//*=========================================================================*/
+void add_line(int section_id, int offset, int line)
+{
+    line_t* new = (line_t*)mmalloc(sizeof(line_t));
+    new->section_id = section_id;
+    new->offset = offset;
+    new->line = line;
+    new->next = NULL;
+
+    if (root == NULL)
+        root = new;
+    else
+        cur->next = new;
+    cur = new;
+
+    ++lines_count;
+}
+
+/*========================================================================*//**
+ * Write the lines block
+ *
+ * \param file: name of the source file
+ *//*=========================================================================*/
+void write_lines(const char* file)
+{
+    block_header_t header;
+    line_entry_t entry;
+    if (lines_count == 0)
+        return;
+
+    header.type = lines;
+    header.num_entries = lines_count;
+    write_block_header(&header);
+
+    cur = root;
+    while (cur)
+    {
+        entry.section_id = cur->section_id;
+        entry.offset = cur->offset;
+        entry.line = cur->line;
+        write_line_entry(&entry, file);
+        cur = cur->next;
+    }
+}
+
+/**
+ * \} Lines
+ * \} gbas
+ */
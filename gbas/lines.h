@@ -0,0 +1,21 @@
+/**
+ * \addtogroup gbas
+ * \{
+ * \addtogroup Lines
+ * \{
+ */
+
+#ifndef LINES_H
+#define LINES_H
+
+void init_lines();
+void free_lines();
+void add_line(int section_id, int offset, int line);
+void write_lines(const char* file);
+
+#endif
+
+/**
+ * \} Lines
+ * \} gbas
+ */
@@ -17,12 +17,14 @@
 #include "../common/files.h"
 #include "../common/gbmmap.h"
 #include "../common/objfile.h"
+#include "../common/timing.h"
 #include "commons.h"
 #include "opcodes.h"
 #include "sections.h"
 #include "syms.h"
 #include "version.h"
 #include "relocs.h"
+#include "lines.h"
 
 #define BUFSIZE     256
 
@@ -42,6 +44,7 @@ typedef enum
     _SPRITE,    /**< .sprite directive */
     _GLOBAL,    /**< .global directive */
     _ORG,       /**< .org directive */
+    _ROM,       /**< .rom directive */
 
     EOL,        /**< End of line */
     ERR         /**< Invalid token */
@@ -59,6 +62,17 @@ typedef struct
     int          column;        /**< Column of the token in the source file */
 } token_t;
 
+/**
+ * Symbol given as an operand, as "symbol", "symbol+n", "LOW(symbol)"...
+ */
+typedef struct
+{
+    char id[MAX_ID_LEN + 1];    /**< Empty if the operand is not a symbol */
+    int  op;                    /**< absolute, low_byte, high_byte or
+                                 * bank_byte */
+    int  addend;
+} symref_t;
+
 
 const char* const pgm = "gbas";
 
@@ -84,6 +98,12 @@ void parse_line(int pass);
 void parse_directive(int pass);
 int  compare(const char* str1, const char* str2);
 int  filter(int *lb, int *ub, int col, char c);
+int  peek_char();
+int  parse_symbol(int pass, symref_t* ref);
+int  symbol_value(int pass, symref_t* ref, int size, int iopcode);
+unsigned long hash_inputs(const char* name);
+char* object_name(const char* source);
+int  is_up_to_date(const char* name, unsigned long hash);
 token_t* token();
 
 
@@ -94,6 +114,7 @@ int main(int argc, char** argv)
     sourcefile_t* file = NULL;
     char* output_name = NULL;
     int donot_link = 0;
+    int gen_lines = 0;
     int errors_encountered = 0;
     spritemode = 0;
 
@@ -107,6 +128,7 @@ int main(int argc, char** argv)
 
     tabstop = get_option("-ftabstop=")->value.num;
     donot_link = get_option("-c")->set;
+    gen_lines = get_option("-g")->set;
 
     output_name = (char*)mmalloc(strlen(get_option("-o")->value.str) + 1);
     strcpy(output_name, get_option("-o")->value.str);
@@ -115,6 +137,8 @@ int main(int argc, char** argv)
     while ((file = file_next()) != NULL)
     {
         char* oname = m_tmpnam();
+        char* obj_name;
+        unsigned long hash;
         infile = NULL;
         outfile = NULL;
 
@@ -123,6 +147,21 @@ int main(int argc, char** argv)
 
         esetfile(file->name);
 
+        /* An object assembled from the same inputs is kept as it is */
+        hash = hash_inputs(input_name);
+        if (donot_link && get_option("-o")->set)
+            obj_name = strcpy((char*)mmalloc(strlen(output_name) + 1),
+                              output_name);
+        else
+            obj_name = object_name(input_name);
+        if (is_up_to_date(obj_name, hash))
+        {
+            file_set_attr(O, 0);
+            free(obj_name);
+            continue;
+        }
+        free(obj_name);
+
         if (! (infile = fopen(input_name, "rb")) )
         {
             ccerr(F, "unable to open \"%s\"", file->name);
@@ -139,6 +178,7 @@ int main(int argc, char** argv)
         init_sections();
         init_syms();
         init_relocs();
+        init_lines();
         set_outfile(outfile);
 
         clear_errors();
@@ -151,20 +191,37 @@ int main(int argc, char** argv)
             continue;
         }
 
+        timing_start("assembly pass 1");
         line = 0;
         while (get_line())
             parse_line(READ_PASS);
 
+        timing_start("assembly pass 2");
         rewind(infile);
         write_obj_header();
+        set_obj_hash(hash);
 
         line = 0;
         while (get_line() && !errors())
+        {
+            section_t* sect = get_current_section();
+            int pc = sect ? sect->pc : 0;
+
             parse_line(GEN_PASS);
 
+            /* A line which generated bytes starts at the previous pc */
+            if (gen_lines && sect && sect == get_current_section()
+                && sect->pc > pc)
+                add_line(sect->id, pc, line);
+        }
+
         write_syms();
         write_relocs();
+        if (gen_lines)
+            write_lines(input_name);
+        write_obj_end();
         fclose(outfile);
+        timing_stop();
 
         if (!errors())
         {
@@ -194,6 +251,10 @@ int main(int argc, char** argv)
     free_sections();
     free_syms();
     free_relocs();
+    free_lines();
+
+    if (get_option("-ftime-report")->set)
+        timing_report(pgm);
 
     if (!errors_encountered && !donot_link)
     {
@@ -224,8 +285,13 @@ void help()
     puts("  --version       Display assembler version information");
     puts("  -c              Assemble only, do not link");
     puts("  -o <file>       Place the output into <file>");
-    puts("  -g              Generate debug information file");
+    puts("  -g              Record the source lines for the debug files");
     puts("  -ftabstop=width Set the distance between tab stops");
+    puts("  -ftime-report   Display the time and memory spent in each phase");
+    puts("  -mcartridge=<type>");
+    puts("                  Set the cartridge type (rom, mbc1, mbc5+ram...)");
+    puts("  -mrom-size=<KB> Set the ROM size, from 32 to 8192 KB");
+    puts("  -mram-size=<KB> Set the external RAM size: 0, 8, 32, 64 or 128 KB");
     exit(EXIT_SUCCESS);
 }
 
@@ -404,6 +470,8 @@ void get_token(int pass)
             tok.type = _GLOBAL;
         else if (compare(tok.str + 1, "ORG") == 0)
             tok.type = _ORG;
+        else if (compare(tok.str + 1, "ROM") == 0)
+            tok.type = _ROM;
     }
     else if (*lineptr == '$' || isdigit(*lineptr))
     {
@@ -540,14 +608,17 @@ void parse_line(int pass)
     int neg = 0;    /* Non-zero means the numeric value is negative */
     int ccol;       /* Index of the character to test in the opcode strings */
     char exp = 0;   /* Non-zero means ] or ) is expected */
+    symref_t ref;   /* Symbol operand */
     int i;
 
+    ref.id[0] = 0;
+
     get_token(pass);
 
     if (tok.type == EOL)
         return;
 
-    if (tok.type >= _BYTE && tok.type <= _ORG)
+    if (tok.type >= _BYTE && tok.type <= _ROM)
     {
         parse_directive(pass);
         return;
@@ -568,7 +639,7 @@ void parse_line(int pass)
 
     if (tok.type == EOL)
         return;
-    else if (tok.type >= _BYTE && tok.type <= _ORG)
+    else if (tok.type >= _BYTE && tok.type <= _ROM)
     {
         parse_directive(pass);
         return;
@@ -642,10 +713,8 @@ void parse_line(int pass)
         }
         else if (tok.type == ID)
         {
-            int relative = 0;
-            if (lb >= 146 && ub <= 150) /* JRs */
-                relative = 1;
-            val = sym_request(pass, tok.str, relative);
+            if (!parse_symbol(pass, &ref))
+                return;
         }
 
         if (!filter(&lb, &ub, ccol, '%'))
@@ -726,10 +795,14 @@ void parse_line(int pass)
     if (lb == ub && opcodes[lb].str[ARG2_COLUMN] == ' ')
     {
         get_token(pass);
-        if (tok.type == EOL)
-            add_opcode(pass, lb, val);
-        else
+        if (tok.type != EOL)
             err(E, "unexpected argument");
+        else
+        {
+            if (ref.id[0])
+                val = symbol_value(pass, &ref, opcodes[lb].len - 1, lb);
+            add_opcode(pass, lb, val);
+        }
         return;
     }
 
@@ -785,10 +858,8 @@ void parse_line(int pass)
         }
         else if (tok.type == ID)
         {
-            int relative = 0;
-            if (lb >= 146 && ub <= 150) /* JRs */
-                relative = 1;
-            val = sym_request(pass, tok.str, relative);
+            if (!parse_symbol(pass, &ref))
+                return;
         }
 
         if (!filter(&lb, &ub, ccol, '%'))
@@ -871,10 +942,14 @@ void parse_line(int pass)
     if (lb == ub)
     {
         get_token(pass);
-        if (tok.type == EOL)
-            add_opcode(pass, lb, val);
-        else
+        if (tok.type != EOL)
             err(E, "unexpected argument");
+        else
+        {
+            if (ref.id[0])
+                val = symbol_value(pass, &ref, opcodes[lb].len - 1, lb);
+            add_opcode(pass, lb, val);
+        }
     }
     else
     {
@@ -895,9 +970,17 @@ void parse_directive(int pass)
         token_type_t type = tok.type;
         do
         {
-            gbspace_t mspace = get_space(get_current_section()->offset);
+            gbspace_t mspace = get_section_space(get_current_section());
             get_token(pass);
-            if (tok.type != NUM)
+            if (tok.type == ID)
+            {
+                symref_t ref;
+                if (!parse_symbol(pass, &ref))
+                    return;
+                tok.num_val = symbol_value(pass, &ref, type == _WORD ? 2 : 1,
+                                           -1);
+            }
+            else if (tok.type != NUM)
             {
                 if (tok.type == EOL)
                 {
@@ -949,7 +1032,7 @@ void parse_directive(int pass)
     }
     else if (tok.type == _ASCII)
     {
-        gbspace_t mspace = get_space(get_current_section()->offset);
+        gbspace_t mspace = get_section_space(get_current_section());
         char* c;
         if (mspace != rom_0 && mspace != rom_n)
         {
@@ -1007,13 +1090,270 @@ void parse_directive(int pass)
             return;
         }
 
-        add_section(pass, org, address, 0);
+        add_section(pass, org, address, 0, 0, 0);
+    }
+    else if (tok.type == _ROM)
+    {
+        int bank = ANY_BANK;
+        int align = 0;
+        int flags = 0;
+
+        get_token(pass);
+        if (tok.type == NUM)
+        {
+            bank = tok.num_val;
+            if (bank >= MAX_ROM_BANKS)
+            {
+                err(E, "invalid ROM bank number");
+                return;
+            }
+            get_token(pass);
+        }
+
+        /* Section attributes */
+        while (tok.type != EOL)
+        {
+            char attr[MAX_ID_LEN + 1];
+
+            if (tok.type == ',')
+                get_token(pass);
+            if (tok.type != ID)
+            {
+                err(E, "expected section attribute");
+                return;
+            }
+            strcpy(attr, tok.str);
+
+            get_token(pass);
+            if (tok.type != '=')
+            {
+                err(E, "expected '=' after \"%s\"", attr);
+                return;
+            }
+
+            get_token(pass);
+            if (compare(attr, "ALIGN") == 0)
+            {
+                if (tok.type != NUM || tok.num_val == 0
+                    || (tok.num_val & (tok.num_val - 1))
+                    || tok.num_val > ROM_BANK_SIZE)
+                {
+                    err(E, "alignment must be a power of 2 not greater than "
+                           "$%X", ROM_BANK_SIZE);
+                    return;
+                }
+                align = tok.num_val;
+            }
+            else if (compare(attr, "COMPRESS") == 0)
+            {
+                if (tok.type != ID || compare(tok.str, "LZ") != 0)
+                {
+                    err(E, "unknown compression, expected \"lz\"");
+                    return;
+                }
+                flags |= SECTION_LZ;
+            }
+            else
+            {
+                err(E, "unknown section attribute \"%s\"", attr);
+                return;
+            }
+            get_token(pass);
+        }
+
+        add_section(pass, rom, 0, bank, align, flags);
     }
  }
 
 
 
 
+/*========================================================================*//**
+ * Return the next character of the line which is not a space, without
+ * consuming it
+ *//*=========================================================================*/
+int peek_char()
+{
+    const char* p = lineptr;
+    while (isspace(*p))
+        ++p;
+    return *p;
+}
+
+/*========================================================================*//**
+ * Read a symbol operand, the current token being its first identifier:
+ * "symbol", "symbol+n", "symbol-n", or one of these within LOW(), HIGH()
+ * or BANK()
+ *
+ * \param pass: assembly pass
+ * \param ref: receives the operand
+ * \return 0 in case of error
+ *//*=========================================================================*/
+int parse_symbol(int pass, symref_t* ref)
+{
+    ref->op = absolute;
+    ref->addend = 0;
+
+    if (peek_char() == '(')
+    {
+        if (compare(tok.str, "LOW") == 0)
+            ref->op = low_byte;
+        else if (compare(tok.str, "HIGH") == 0)
+            ref->op = high_byte;
+        else if (compare(tok.str, "BANK") == 0)
+            ref->op = bank_byte;
+        else
+        {
+            err(E, "unknown operator \"%s\"", tok.str);
+            return 0;
+        }
+        get_token(pass);
+        get_token(pass);
+        if (tok.type != ID)
+        {
+            err(E, "expected identifier");
+            return 0;
+        }
+    }
+    strcpy(ref->id, tok.str);
+
+    if (peek_char() == '+' || peek_char() == '-')
+    {
+        int neg;
+        get_token(pass);
+        neg = tok.type == '-';
+        get_token(pass);
+        if (tok.type != NUM)
+        {
+            err(E, "invalid number");
+            return 0;
+        }
+        ref->addend = neg ? -tok.num_val : tok.num_val;
+    }
+
+    if (ref->op != absolute)
+    {
+        get_token(pass);
+        if (tok.type != ')')
+        {
+            err(E, "expected ')'");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*========================================================================*//**
+ * Value of a symbol operand, left for the linker to relocate if it is not
+ * known yet
+ *
+ * \param pass: assembly pass
+ * \param ref: the operand
+ * \param size: size of the value in bytes
+ * \param iopcode: index of the instruction in opcodes, -1 for data
+ * \return the value, 0 if it is only known after linking
+ *//*=========================================================================*/
+int symbol_value(int pass, symref_t* ref, int size, int iopcode)
+{
+    int kind = ref->op;
+
+    if (pass == READ_PASS)
+        return 0;
+
+    if (size == 2 && kind != absolute)
+    {
+        err(E, "LOW(), HIGH() and BANK() are 8 bits values");
+        return 0;
+    }
+    if (size == 1 && kind == absolute)
+    {
+        /* The 8 bits operands which can hold an address */
+        if (iopcode >= 146 && iopcode <= 150)   /* JRs */
+            kind = relative;
+        else if (iopcode >= 0 && !opcodes[iopcode].pre
+                 && (opcodes[iopcode].oc == 0xE0 || opcodes[iopcode].oc == 0xF0))
+            kind = hram_byte;                   /* LDH */
+        else
+        {
+            err(E, "8 bits value expected, use LOW(), HIGH() or BANK() with "
+                   "'%s'", ref->id);
+            return 0;
+        }
+    }
+    /* The linker may send a call or a jump to another bank through a
+     * trampoline */
+    if (size == 2 && kind == absolute && iopcode >= 0
+        && (strncmp(opcodes[iopcode].str, "CALL", 4) == 0
+            || strncmp(opcodes[iopcode].str, "JP ", 3) == 0))
+        kind = call_address;
+
+    return sym_request(pass, ref->id, kind, ref->addend, iopcode >= 0);
+}
+
+/*========================================================================*//**
+ * Hash of everything the object of a source file depends on: the name and
+ * the contents of the file, the options changing the object and the version
+ * of the assembler
+ *
+ * \return the hash, 0 if the file cannot be read
+ *//*=========================================================================*/
+unsigned long hash_inputs(const char* name)
+{
+    static const int versions[] = { VERSION_MAJOR, VERSION_MINOR, PATCH,
+                                    OBJ_VERSION };
+    static const char* const skip[] = { "-o", "-c", "-ftime-report", NULL };
+    unsigned char buf[4096];
+    unsigned long hash = HASH_INIT;
+    size_t n;
+    FILE* file;
+
+    if (!(file = fopen(name, "rb")))
+        return 0;
+    hash = hash_data(hash, name, strlen(name) + 1);
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        hash = hash_data(hash, buf, n);
+    fclose(file);
+
+    hash = hash_data(hash, versions, sizeof(versions));
+    hash = hash_options(hash, GBAS, skip);
+
+    return hash;
+}
+
+/*========================================================================*//**
+ * Name of the object file of a source file: the name of the source file
+ * with the extension .o
+ *//*=========================================================================*/
+char* object_name(const char* source)
+{
+    const char* p = strrchr(source, '.');
+    size_t len = p ? (size_t)(p - source) : strlen(source);
+    char* name = (char*)mmalloc(len + 3);
+
+    memcpy(name, source, len);
+    strcpy(name + len, ".o");
+    return name;
+}
+
+/*========================================================================*//**
+ * Tell whether an object file was assembled from the inputs of a hash
+ *
+ * \param name: name of the object file
+ * \param hash: hash of the inputs, from hash_inputs
+ *//*=========================================================================*/
+int is_up_to_date(const char* name, unsigned long hash)
+{
+    unsigned long obj_hash;
+    FILE* file;
+    int ret;
+
+    if (hash == 0 || !(file = fopen(name, "rb")))
+        return 0;
+    ret = read_obj_hash(file, &obj_hash) && obj_hash == hash;
+    fclose(file);
+    return ret;
+}
+
 /*========================================================================*//**
  * Case insensitive alpha string comparison
  *//*=========================================================================*/
@@ -18,7 +18,8 @@ typedef struct reloc_s
     int sym_id;
     int section_id;
     int offset;
-    int flags;
+    int kind;
+    int addend;
     struct reloc_s* next;
 } reloc_t;
 
@@ -45,16 +46,23 @@ void free_relocs()
     cur = NULL;
 }
 
-void add_reloc(int sym_id, int section_id, int offset, int relative)
+/*========================================================================*//**
+ * Add a relocation to the list
+ *
+ * \param sym_id: id of the symbol the relocated value depends on
+ * \param section_id: id of the section holding the value
+ * \param offset: offset of the value in the section
+ * \param kind: kind of relocation (absolute, relative, low_byte...)
+ * \param addend: added to the address of the symbol
+ *//*=========================================================================*/
+void add_reloc(int sym_id, int section_id, int offset, int kind, int addend)
 {
     reloc_t* new = (reloc_t*)mmalloc(sizeof(reloc_t));
     new->sym_id = sym_id;
     new->section_id = section_id;
     new->offset = offset;
-    if (relative)
-        new->flags = 1;
-    else
-        new->flags = 0;
+    new->kind = kind;
+    new->addend = addend;
     new->next = NULL;
     
     if (root == NULL)
@@ -88,7 +96,8 @@ void write_relocs()
         reloc.sym_id = cur->sym_id;
         reloc.section_id = cur->section_id;
         reloc.offset = cur->offset;
-        reloc.flags = cur->flags;
+        reloc.flags = cur->kind;
+        reloc.addend = cur->addend;
         write_reloc_entry(&reloc);
         cur = cur->next;
     }
@@ -10,7 +10,7 @@
 
 void init_relocs();
 void free_relocs();
-void add_reloc(int sym_id, int section_id, int offset, int relative);
+void add_reloc(int sym_id, int section_id, int offset, int kind, int addend);
 void write_relocs();
 
 #endif
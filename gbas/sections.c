@@ -71,15 +71,30 @@ section_t* get_section_by_id(int id)
     return ps;
 }
 
+/*========================================================================*//**
+ * Return the memory space a section will be placed in
+ *
+ * \param sect: the section
+ *//*=========================================================================*/
+gbspace_t get_section_space(section_t* sect)
+{
+    if (sect->type == rom)
+        return sect->bank == 0 ? rom_0 : rom_n;
+    return get_space(sect->offset);
+}
+
 /*========================================================================*//**
  * Create a new section and set it as the current section
  *
  * \param pass: assembly pass
  * \param type: the new section's type
- * \param address: the new section's address
+ * \param address: the new section's address, ignored for floating sections
  * \param bank: the new section's bank
+ * \param align: alignment of a floating section
+ * \param flags: attributes of the section (SECTION_LZ)
  *//*=========================================================================*/
-void add_section(int pass, section_type_t type, int address, int bank)
+void add_section(int pass, section_type_t type, int address, int bank,
+                 int align, int flags)
 {
     section_entry_t sect_entry;
     
@@ -105,6 +120,8 @@ void add_section(int pass, section_type_t type, int address, int bank)
         cur->id = num_sections;
         cur->offset = address;
         cur->bank = bank;
+        cur->align = align;
+        cur->flags = flags;
         cur->pc = 0;
         cur->datasize = 0;
         cur->next = NULL;
@@ -130,6 +147,8 @@ void add_section(int pass, section_type_t type, int address, int bank)
         sect_entry.type = cur->type;
         sect_entry.offset = cur->offset;
         sect_entry.bank_num = cur->bank;
+        sect_entry.align = cur->align;
+        sect_entry.flags = cur->flags;
         sect_entry.data_size = cur->datasize;
         write_section_entry(&sect_entry);
     }
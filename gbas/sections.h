@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include "../common/objfile.h"
+#include "../common/gbmmap.h"
 
 /** Describes a section entry in the sections list */
 typedef struct section_s
@@ -18,6 +19,8 @@ typedef struct section_s
     section_type_t type;        /**< Section type */
     int            offset;      /**< Absolute address or offset in the bank */
     int            bank;        /**< Bank number */
+    int            align;       /**< Alignment of a floating section */
+    int            flags;       /**< Attributes, SECTION_LZ */
     int            datasize;    /**< Size of the section */
     int            pc;          /**< Program counter */
     struct section_s*     next; /**< Pointer to the next section in the list */
@@ -27,7 +30,9 @@ void       init_sections();
 void       free_sections();
 section_t* get_current_section();
 section_t* get_section_by_id(int id);
-void       add_section(int pass, section_type_t type, int address, int bank);
+gbspace_t  get_section_space(section_t* sect);
+void       add_section(int pass, section_type_t type, int address, int bank,
+                       int align, int flags);
 void       add_opcode(int pass, int iopcode, int val);
 void       add_data(int pass, char c);
 
@@ -9,6 +9,7 @@
 #include "syms.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "../common/errors.h"
 #include "../common/utils.h"
@@ -115,26 +116,29 @@ void sym_declare(int pass, char* id, char* filename, int line, int column)
 }
 
 /*========================================================================*//**
- * Search for a symbol and return its absolute or relative address. If no
- * symbol is found, create a new symbol and mark it as extern. If the address
+ * Search for a symbol and return the value of a reference to it. If no
+ * symbol is found, create a new symbol and mark it as extern. If the value
  * cannot be resolved, 0 is returned and relocation informations are created.
  *
  * \param pass: assembly pass
  * \param id: symbol's identifier
- * \param relative: non-zero means the symbol is requested by a relative jump
- * \return address of the symbol if absolute, distance if relative
- *
- * \todo handle symbol relocation
+ * \param kind: kind of reference (absolute, relative, low_byte...)
+ * \param addend: added to the address of the symbol
+ * \param offset: offset of the value from the current address, 1 after an
+ * opcode
+ * \return the value if it is known when assembling, 0 otherwise
  *//*=========================================================================*/
-int sym_request(int pass, char* id, int relative)
+int sym_request(int pass, char* id, int kind, int addend, int offset)
 {
     sym_t* psym;
     section_t* cursect;
     section_t* targetsect;
+    int addr;
 
     if (pass == READ_PASS)
         return 0;
-    
+
+    cursect = get_current_section();
     psym = root;
     while (psym)
     {
@@ -143,43 +147,37 @@ int sym_request(int pass, char* id, int relative)
         psym = psym->next;
     }
 
-    /* The symbol cannot be found: create it, mark it as imported and add
-    a relocation information */
+    /* The symbol cannot be found: create it, mark it as imported */
     if (psym == NULL)
     {
         /* Force symbol declaration by simulating the read pass */
         sym_declare(READ_PASS, id, " ", 0, 0);
         cur->type = _extern;
-        /* Use offset+1 since all jump instructions are 1 byte long */
-        add_reloc(cur->sym_id, cur->section_id, cur->offset+1, relative);
-        if (relative)
-            err(W, "relative jump to an external address");
-
-        return 0;
+        psym = cur;
     }
 
-    cursect = get_current_section();
-    
     /* Imported symbol: add a relocation information */
     if (psym->type == _extern)
     {
-        add_reloc(psym->sym_id, cursect->id, cursect->pc+1, relative);
-        if (relative)
+        add_reloc(psym->sym_id, cursect->id, cursect->pc + offset, kind,
+                  addend);
+        if (kind == relative)
             err(W, "relative jump to an external address");
         return 0;
     }
 
-    if (relative)
+    if (kind == relative)
     {
         if (psym->section_id != cursect->id)
         {
             err(W, "relative jump to a different section");
-            add_reloc(psym->section_id, cursect->id, cursect->pc, relative);
+            add_reloc(psym->sym_id, cursect->id, cursect->pc + offset, kind,
+                      addend);
             return 0;
         }
         else
         {
-            int diff = psym->offset - (cursect->pc + 2);
+            int diff = psym->offset + addend - (cursect->pc + offset + 1);
             if (diff > 128 || diff < -127)
             {
                 err(E, "relative jump to '%s' out of range", psym->id);
@@ -189,14 +187,30 @@ int sym_request(int pass, char* id, int relative)
         }
     }
 
-
+    /* The address of a floating section is only known after linking, and
+     * the bank of any section is set by the linker */
     targetsect = get_section_by_id(psym->section_id);
-    if (targetsect->type == org)
-        return targetsect->offset + psym->offset;
-
-    TODO("Relocation");
+    if (targetsect->type != org || kind == bank_byte)
+    {
+        add_reloc(psym->sym_id, cursect->id, cursect->pc + offset, kind,
+                  addend);
+        return 0;
+    }
 
-    return 0;
+    addr = targetsect->offset + psym->offset + addend;
+    switch (kind)
+    {
+    case low_byte:
+        return addr & 0xFF;
+    case high_byte:
+        return (addr >> 8) & 0xFF;
+    case hram_byte:
+        if (addr < 0xFF00 || addr > 0xFFFF)
+            err(E, "'%s' is not in high RAM", psym->id);
+        return addr & 0xFF;
+    default:
+        return addr;
+    }
 }
 
 /*========================================================================*//**
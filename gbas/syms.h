@@ -31,7 +31,7 @@ void   free_syms();
 sym_t* sym_get_table();
 void   sym_declare(int pass, char* id, char* filename, int line, int column);
 void   sym_set_global(int pass, char* id);
-int    sym_request(int pass, char* id, int relative);
+int    sym_request(int pass, char* id, int kind, int addend, int offset);
 void   write_syms();
 
 #endif
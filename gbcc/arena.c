@@ -0,0 +1,102 @@
+/**
+ * \addtogroup gbcc
+ * \{
+ * \defgroup Arenas
+ * Region allocation of the data of a translation unit, the abstract syntax
+ * tree and the symbol tables: memory is taken from large blocks and never
+ * released piecemeal, all the blocks of an arena being freed together once
+ * the unit is compiled.
+ * \addtogroup Arenas
+ * \{
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+#include "../common/utils.h"
+
+#define BLOCK_SIZE  16384   /**< Usable size of a block, larger allocations
+                             * get a block of their own */
+
+/** Alignment suitable for any of the structures allocated */
+typedef union
+{
+    long   l;
+    double d;
+    void*  p;
+} align_t;
+
+struct arena_block_s
+{
+    arena_block_t* next;    /**< Previous block of the arena */
+    size_t         size;    /**< Usable bytes */
+    size_t         used;    /**< Bytes allocated */
+    align_t        data[1]; /**< Start of the memory allocated */
+};
+
+/*========================================================================*//**
+ * Initialize an empty arena
+ *//*=========================================================================*/
+void arena_init(arena_t* arena)
+{
+    arena->blocks = NULL;
+}
+
+/*========================================================================*//**
+ * Allocate memory from an arena, or throw a fatal error in case of failure
+ *
+ * \param size: size of the memory block to allocate
+ * \return the memory block, valid until arena_free()
+ *//*=========================================================================*/
+void* arena_alloc(arena_t* arena, size_t size)
+{
+    arena_block_t* block = arena->blocks;
+    void* mem;
+
+    size = (size + sizeof(align_t) - 1) / sizeof(align_t) * sizeof(align_t);
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+
+        block = (arena_block_t*)mmalloc(sizeof(arena_block_t)
+                                        - sizeof(align_t) + block_size);
+        block->size = block_size;
+        block->used = 0;
+
+        /* A block of its own is kept behind the current one, so that the
+        space left in the latter is still used */
+        if (size > BLOCK_SIZE && arena->blocks)
+        {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        }
+        else
+        {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    mem = (char*)block->data + block->used;
+    block->used += size;
+    return mem;
+}
+
+/*========================================================================*//**
+ * Release all the memory allocated from an arena, which is left empty
+ *//*=========================================================================*/
+void arena_free(arena_t* arena)
+{
+    while (arena->blocks)
+    {
+        arena_block_t* next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+/**
+ * \} Arenas
+ * \} gbcc
+ */
@@ -0,0 +1,30 @@
+/**
+ * \addtogroup gbcc
+ * \{
+ * \addtogroup Arenas
+ * \{
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena_block_s arena_block_t;
+
+/** Allocations released all at once */
+typedef struct
+{
+    arena_block_t* blocks;  /**< Last block allocated, NULL if none */
+} arena_t;
+
+void  arena_init(arena_t* arena);
+void* arena_alloc(arena_t* arena, size_t size);
+void  arena_free(arena_t* arena);
+
+#endif
+
+/**
+ * \} Arenas
+ * \} gbcc
+ */
@@ -2,6 +2,8 @@
  * \addtogroup gbcc
  * \{
  * \defgroup ast Abstract Syntax Tree
+ * The nodes and their arrays of children are allocated from an arena,
+ * released at once by ast_free().
  * \addtogroup ast
  * \{
  */
@@ -15,16 +17,19 @@
 #include "../common/errors.h"
 #include "../common/utils.h"
 #include "lexer.h"
+#include "arena.h"
+
+#define MIN_CHILDREN    2   /**< Initial size of the arrays of children */
 
 _node_t*        root = NULL;    /**< Root of the AST */
 static _node_t* node = NULL;    /**< The current node */
+static arena_t  arena;          /**< Memory of the nodes */
 
 static _node_t* create_node();
 static void     add_child(_node_t* to, _node_t* child);
-static void     free_node(_node_t* n);
 
 
-static void     ast_dump_node(FILE* f, _node_t* n, int indent);
+static void     ast_dump_node(buffer_t* f, _node_t* n, int indent);
 
 /*========================================================================*//**
  * Initialize the abstract syntax tree
@@ -43,12 +48,9 @@ void ast_init()
  *//*=========================================================================*/
 void ast_free()
 {
-    if (root)
-    {
-        free_node(root);
-        root = NULL;
-        node = NULL;
-    }
+    arena_free(&arena);
+    root = NULL;
+    node = NULL;
 }
 
 /*========================================================================*//**
@@ -193,91 +195,88 @@ node_t jump(int id, node_t arg)
 
 _node_t* create_node()
 {
-    _node_t* new = (_node_t*)mmalloc(sizeof(_node_t));
+    _node_t* new = (_node_t*)arena_alloc(&arena, sizeof(_node_t));
 
     new->type = 0;
     new->num_children = 0;
+    new->max_children = 0;
     new->parent = NULL;
     new->children = NULL;
     return new;
 }
 
+/*========================================================================*//**
+ * Append a child to a node. The children stay contiguous: when the array is
+ * full, a twice larger one replaces it, the old one being left to the arena.
+ *//*=========================================================================*/
 void add_child(_node_t* to, _node_t* child)
 {
-    _node_t** new;
-    to->num_children++;
-    new =
-        (_node_t**)mrealloc(to->children, sizeof(_node_t*) * to->num_children);
-
-    to->children = new;
-    to->children[to->num_children - 1] = child;
-    child->parent = to;
-}
-
-void free_node(_node_t* n)
-{
-    unsigned int i;
-    for (i = 0; i < n->num_children; i++)
+    if (to->num_children == to->max_children)
     {
-        if (n->children[i])
-            free_node(n->children[i]);
+        unsigned int max = to->max_children ? to->max_children * 2
+                                            : MIN_CHILDREN;
+        _node_t** new =
+            (_node_t**)arena_alloc(&arena, sizeof(_node_t*) * max);
+
+        if (to->num_children)
+            memcpy(new, to->children, sizeof(_node_t*) * to->num_children);
+        to->children = new;
+        to->max_children = max;
     }
 
-    if (n->children)
-        free(n->children);
-
-    free(n);
+    to->children[to->num_children++] = child;
+    child->parent = to;
 }
 
 
 
-void ast_dump(FILE* f)
+void ast_dump(buffer_t* f)
 {
-    fprintf(f, ";********************************  AST *****************************************\n");
+    buffer_printf(f, ";********************************  AST *****************************************\n");
     ast_dump_node(f, root, -1);
-    fprintf(f, ";*******************************************************************************\n\n\n");
+    buffer_printf(f, ";*******************************************************************************\n\n\n");
 }
 
-void ast_dump_node(FILE* f, _node_t* n, int indent)
+void ast_dump_node(buffer_t* f, _node_t* n, int indent)
 {
     unsigned int i;
     if (n != root)
     {
         int ind = indent;
-        fprintf(f, "; ");
+        buffer_printf(f, "; ");
         while (ind--)
-            fprintf(f, "    ");
+            buffer_printf(f, "    ");
 
         if (n->type == STATEMENT_LIST)
         {
-            fprintf(f, "SCOPE %d\n", n->num_value);
+            buffer_printf(f, "SCOPE %d\n", n->num_value);
         }
         else if (n->type == FUNCTION)
         {
-            fprintf(f, "FUNCTION %s\n", n->identifier);
+            buffer_printf(f, "FUNCTION %s\n", n->identifier);
         }
         else if (n->type == ASSIGN)
         {
-            fprintf(f, "assign\n");
+            buffer_printf(f, "assign\n");
         }
         else if (n->id == IDENTIFIER)
         {
-            fprintf(f, "%s\n", n->identifier);
+            buffer_printf(f, "%s\n", n->identifier);
         }
         else if (n->id == CONSTANT)
         {
-            fprintf(f, "%d\n", n->num_value);
+            buffer_printf(f, "%d\n", n->num_value);
         }
         else if (n->id == POSITIVE)
         {
-            fprintf(f, "+ve\n");
+            buffer_printf(f, "+ve\n");
         }
         else if (n->id == NEGATIVE)
         {
-            fprintf(f, "-ve\n");
+            buffer_printf(f, "-ve\n");
         }
         else
-            fprintf(f, "%s\n", token_name(n->id));
+            buffer_printf(f, "%s\n", token_name(n->id));
     }
 
     for (i = 0; i < n->num_children; i++)
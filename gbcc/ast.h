@@ -22,8 +22,8 @@ node_t unop(int id, node_t right);
 node_t binop(int id, node_t left, node_t right);
 node_t jump(int id, node_t arg);
 
-#include <stdio.h>
-void ast_dump(FILE* f);
+#include "buffer.h"
+void ast_dump(buffer_t* f);
 
 #endif
 
@@ -28,6 +28,7 @@ typedef struct _node_s
     int                 id;             /**< Token id */
     enum node_type_e    type;           /**< Node type */
     unsigned int        num_children;   /**< Number of child nodes */
+    unsigned int        max_children;   /**< Size of the children array */
     struct _node_s*     parent;         /**< Parent node */
     struct _node_s**    children;       /**< Child nodes */
     int     num_value;                  /**< Contains the value of a constant
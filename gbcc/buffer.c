@@ -0,0 +1,139 @@
+/**
+ * \addtogroup gbcc
+ * \{
+ * \defgroup Buffers
+ * In-memory text passed between the stages of the compiler: the
+ * preprocessed source read by the lexer and the assembly source written by
+ * the code generator. Files are only read and written at the ends of the
+ * pipeline.
+ * \addtogroup Buffers
+ * \{
+ */
+
+#include "buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "../common/utils.h"
+
+#define MIN_CAPACITY    4096
+
+static void reserve(buffer_t* buf, size_t size);
+
+/*========================================================================*//**
+ * Initialize an empty buffer
+ *//*=========================================================================*/
+void buffer_init(buffer_t* buf)
+{
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+
+/*========================================================================*//**
+ * Release the memory of a buffer, which is left empty
+ *//*=========================================================================*/
+void buffer_free(buffer_t* buf)
+{
+    free(buf->data);
+    buffer_init(buf);
+}
+
+/*========================================================================*//**
+ * Make room for 'size' more bytes, doubling the capacity as needed
+ *//*=========================================================================*/
+void reserve(buffer_t* buf, size_t size)
+{
+    size_t capacity = buf->capacity ? buf->capacity : MIN_CAPACITY;
+
+    if (buf->size + size <= buf->capacity)
+        return;
+    while (capacity < buf->size + size)
+        capacity *= 2;
+    buf->data = (char*)mrealloc(buf->data, capacity);
+    buf->capacity = capacity;
+}
+
+/*========================================================================*//**
+ * Append a character
+ *//*=========================================================================*/
+void buffer_putc(buffer_t* buf, int c)
+{
+    reserve(buf, 1);
+    buf->data[buf->size++] = (char)c;
+}
+
+/*========================================================================*//**
+ * Append formatted text
+ *
+ * \param format: format string, as for printf()
+ *//*=========================================================================*/
+void buffer_printf(buffer_t* buf, const char* format, ...)
+{
+    va_list args;
+    int len;
+
+    /* The terminating null of vsnprintf is overwritten by the next write */
+    reserve(buf, 256);
+    va_start(args, format);
+    len = vsnprintf(buf->data + buf->size, buf->capacity - buf->size, format,
+                    args);
+    va_end(args);
+
+    if (len >= 0 && (size_t)len >= buf->capacity - buf->size)
+    {
+        reserve(buf, len + 1);
+        va_start(args, format);
+        vsnprintf(buf->data + buf->size, len + 1, format, args);
+        va_end(args);
+    }
+    if (len > 0)
+        buf->size += len;
+}
+
+/*========================================================================*//**
+ * Append the contents of a file
+ *
+ * \return 0 if the file could not be read
+ *//*=========================================================================*/
+int buffer_load(buffer_t* buf, const char* name)
+{
+    FILE* file = fopen(name, "rb");
+    size_t n;
+
+    if (!file)
+        return 0;
+    do
+    {
+        reserve(buf, MIN_CAPACITY);
+        n = fread(buf->data + buf->size, 1, buf->capacity - buf->size, file);
+        buf->size += n;
+    } while (n > 0);
+
+    n = ferror(file);
+    fclose(file);
+    return !n;
+}
+
+/*========================================================================*//**
+ * Write the contents of a buffer to a file
+ *
+ * \return 0 if the file could not be written
+ *//*=========================================================================*/
+int buffer_save(const buffer_t* buf, const char* name)
+{
+    FILE* file = fopen(name, "wb");
+    int ok;
+
+    if (!file)
+        return 0;
+    ok = fwrite(buf->data, 1, buf->size, file) == buf->size;
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * \} Buffers
+ * \} gbcc
+ */
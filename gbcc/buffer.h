@@ -0,0 +1,33 @@
+/**
+ * \addtogroup gbcc
+ * \{
+ * \addtogroup Buffers
+ * \{
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+/** Text growing as it is written, passed from one stage to the next */
+typedef struct
+{
+    char*  data;        /**< Not null terminated */
+    size_t size;        /**< Bytes written */
+    size_t capacity;    /**< Bytes allocated */
+} buffer_t;
+
+void buffer_init(buffer_t* buf);
+void buffer_free(buffer_t* buf);
+void buffer_putc(buffer_t* buf, int c);
+void buffer_printf(buffer_t* buf, const char* format, ...);
+int  buffer_load(buffer_t* buf, const char* name);
+int  buffer_save(const buffer_t* buf, const char* name);
+
+#endif
+
+/**
+ * \} Buffers
+ * \} gbcc
+ */
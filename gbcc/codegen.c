@@ -7,14 +7,13 @@
  */
 
 #include "codegen.h"
-#include <stdio.h>
 
 #include "../common/errors.h"
 #include "lexer.h"
 #include "astcommons.h"
 #include "syms.h"
 
-static FILE* f;
+static buffer_t* f;
 
 void export_syms(symtbl_t* tbl);
 void export_funcs(symtbl_t* tbl);
@@ -24,18 +23,18 @@ void gen_assign(_node_t* node);
 void gen_jump(_node_t* node);
 sym_t* gen_lvalue(_node_t* node);
 
-void codegen(FILE* outfile)
+void codegen(buffer_t* out)
 {
     _node_t* tree = ast_get_tree();
     if (!tree)
         return;
 
-    f = outfile;
+    f = out;
 
-    fprintf(f, ".org $C000 ; TMP BS\n");
+    buffer_printf(f, ".org $C000 ; TMP BS\n");
     export_syms(syms_get_table());
 
-    fprintf(f, ".org $200  ; TMP BS\n");
+    buffer_printf(f, ".org $200  ; TMP BS\n");
     export_funcs(syms_get_table());
     gen_block(tree);
 }
@@ -49,7 +48,7 @@ void export_syms(symtbl_t* tbl)
         if (tbl->syms[i]->function)
             continue;
         if (tbl->scope_id == 0)
-            fprintf(f, ".global %s\n", tbl->syms[i]->id);
+            buffer_printf(f, ".global %s\n", tbl->syms[i]->id);
     }
 
     for (i = 0; i < tbl->num_syms; ++i)
@@ -57,8 +56,8 @@ void export_syms(symtbl_t* tbl)
         if (tbl->syms[i]->function)
             continue;
 
-        fprintf(f, "%s:", tbl->syms[i]->id);
-        fprintf(f, " %s\n", tbl->syms[i]->type_id == WORD ? ".word" : ".byte");
+        buffer_printf(f, "%s:", tbl->syms[i]->id);
+        buffer_printf(f, " %s\n", tbl->syms[i]->type_id == WORD ? ".word" : ".byte");
     }
 
     for (i = 0; i < tbl->num_children; i++)
@@ -73,7 +72,7 @@ void export_funcs(symtbl_t* tbl)
         if (!tbl->syms[i]->function)
             continue;
 
-        fprintf(f, ".global %s\n", tbl->syms[i]->id);
+        buffer_printf(f, ".global %s\n", tbl->syms[i]->id);
     }
 }
 
@@ -93,8 +92,8 @@ void gen_block(_node_t* node)
         }
         else if (child->type == FUNCTION)
         {
-            fprintf(f, "; FUNCTION\n");
-            fprintf(f, "%s:\n", child->identifier);
+            buffer_printf(f, "; FUNCTION\n");
+            buffer_printf(f, "%s:\n", child->identifier);
         }
         else if (child->type == ASSIGN)
         {
@@ -104,7 +103,7 @@ void gen_block(_node_t* node)
                  child->type == BINOP || child->type == UNOP)
         {
             gen_expr(child);
-            fprintf(f, "        call print_a   ; DEBUG\n");
+            buffer_printf(f, "        call print_a   ; DEBUG\n");
         }
         else if (child->id == RETURN)
         {
@@ -124,16 +123,16 @@ void gen_expr(_node_t* node)
     if (node->id == IDENTIFIER)
     {
         TODO("check existing ");
-        fprintf(f, "        ld      bc, %s\n", node->identifier);
-        fprintf(f, "        ld      a, [bc]\n"); /* 8-bits only */
+        buffer_printf(f, "        ld      bc, %s\n", node->identifier);
+        buffer_printf(f, "        ld      a, [bc]\n"); /* 8-bits only */
     }
     else if (node->id == CONSTANT)
     {
-        fprintf(f, "; load constant\n");
+        buffer_printf(f, "; load constant\n");
         if (!node->num_value)
-            fprintf(f, "        xor     a\n");
+            buffer_printf(f, "        xor     a\n");
         else
-            fprintf(f, "        ld      a, $%02X\n", node->num_value);
+            buffer_printf(f, "        ld      a, $%02X\n", node->num_value);
     }
     else if (node->type == UNOP)
     {
@@ -145,55 +144,55 @@ void gen_expr(_node_t* node)
             break;
 
         case NEGATIVE:
-            fprintf(f, "; negative (8 bits)\n");
-            fprintf(f, "        cpl\n");
-            fprintf(f, "        inc     a\n");
+            buffer_printf(f, "; negative (8 bits)\n");
+            buffer_printf(f, "        cpl\n");
+            buffer_printf(f, "        inc     a\n");
             break;
         }
     }
     else if (node->type == BINOP)
     {
         gen_expr(node->children[LEFTOP]);
-        fprintf(f, "        push    af\n");
+        buffer_printf(f, "        push    af\n");
         gen_expr(node->children[RIGHTOP]);
         switch(node->id)
         {
 
         case '+':
-            fprintf(f, "; addition \n");
-            fprintf(f, "        pop     de\n");
-            fprintf(f, "        add     a, d\n");
+            buffer_printf(f, "; addition \n");
+            buffer_printf(f, "        pop     de\n");
+            buffer_printf(f, "        add     a, d\n");
             break;
 
         case '-':
-            fprintf(f, "; substraction \n");
-            fprintf(f, "        ld      d, a\n");
-            fprintf(f, "        pop     af\n");
-            fprintf(f, "        sub     a, d\n");
+            buffer_printf(f, "; substraction \n");
+            buffer_printf(f, "        ld      d, a\n");
+            buffer_printf(f, "        pop     af\n");
+            buffer_printf(f, "        sub     a, d\n");
             break;
 
         case '*':
-            fprintf(f, "; multiplication \n");
-            fprintf(f, "        pop     de\n");
-            fprintf(f, "        ld      e, d\n");
-            fprintf(f, "        ld      h, a\n");
-            fprintf(f, "        call    ___mul_8_\n");
-            fprintf(f, "        ld      a, l\n");
+            buffer_printf(f, "; multiplication \n");
+            buffer_printf(f, "        pop     de\n");
+            buffer_printf(f, "        ld      e, d\n");
+            buffer_printf(f, "        ld      h, a\n");
+            buffer_printf(f, "        call    ___mul_8_\n");
+            buffer_printf(f, "        ld      a, l\n");
             break;
 
         case '/':
-            fprintf(f, "; division \n");
-            fprintf(f, "        pop     de\n");
-            fprintf(f, "        ld      e, a\n");
-            fprintf(f, "        call    ___div_u8_\n");
-            fprintf(f, "        ld      a, d\n");
+            buffer_printf(f, "; division \n");
+            buffer_printf(f, "        pop     de\n");
+            buffer_printf(f, "        ld      e, a\n");
+            buffer_printf(f, "        call    ___div_u8_\n");
+            buffer_printf(f, "        ld      a, d\n");
             break;
 
         case '%':
-            fprintf(f, "; modulo \n");
-            fprintf(f, "        pop     de\n");
-            fprintf(f, "        ld      e, a\n");
-            fprintf(f, "        call    ___div_u8_\n");
+            buffer_printf(f, "; modulo \n");
+            buffer_printf(f, "        pop     de\n");
+            buffer_printf(f, "        ld      e, a\n");
+            buffer_printf(f, "        call    ___div_u8_\n");
             break;
         }
     }
@@ -207,32 +206,32 @@ void gen_assign(_node_t* node)
 {
     sym_t* s;
     TODO("assign word");
-    fprintf(f, "; assign { \n");
+    buffer_printf(f, "; assign { \n");
     gen_expr(node->children[RIGHTOP]);  /* Load byte into A or word into HL */
 
     s = gen_lvalue(node->children[LEFTOP]); /* Load ptr into DE */
     if (s->type_id == BYTE)
     {
-        fprintf(f, "        ld      [de], a\n");
+        buffer_printf(f, "        ld      [de], a\n");
     }
     else
     {
-        fprintf(f, "        ld      [de], l\n");
-        fprintf(f, "        inc     de\n");
-        fprintf(f, "        ld      [de], h\n");
+        buffer_printf(f, "        ld      [de], l\n");
+        buffer_printf(f, "        inc     de\n");
+        buffer_printf(f, "        ld      [de], h\n");
     }
 
-    fprintf(f, "; } assign \n");
+    buffer_printf(f, "; } assign \n");
 }
 
 void gen_jump(_node_t* node)
 {
     if (node->id == RETURN)
     {
-        fprintf(f, "; *** return ***\n");
+        buffer_printf(f, "; *** return ***\n");
         if (node->num_children)
             gen_expr(node->children[0]);
-        fprintf(f, "        ret\n");
+        buffer_printf(f, "        ret\n");
     }
 }
 
@@ -241,7 +240,7 @@ sym_t* gen_lvalue(_node_t* node)
     sym_t* s = get_sym(node->identifier);
     TODO("lvalue type check");
     assert(s != NULL);
-    fprintf(f, "        ld      de, %s\n", node->identifier);
+    buffer_printf(f, "        ld      de, %s\n", node->identifier);
     return s;
 }
 
@@ -8,9 +8,9 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
-#include <stdio.h>
+#include "buffer.h"
 
-void codegen(FILE* outfile);
+void codegen(buffer_t* out);
 
 #endif
 
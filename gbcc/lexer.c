@@ -116,24 +116,37 @@ L?\"(\\.|[^\\"])*\"	{ count(); return(STRING_LITERAL); }
 
 #include "../common/options.h"
 #include "../common/errors.h"
+#include "../common/utils.h"
 
-static FILE* f;          /**< Current file */
+#define RING_SIZE   64  /**< Initial size of the token ring, a power of 2 */
+
+static const char* text; /**< Preprocessed source */
+static size_t   size;    /**< Size of the source */
+static size_t   pos;     /**< Position of the character after 'l' */
 static int      c;       /**< Current character */
 static int      l;       /**< Look-ahead character */
 static int      prev;    /**< Previous character */
 static unsigned line;    /**< Current line number in the source file */
 static unsigned column;  /**< Current column number in the source file */
 
-static int      bc;      /**< Current character backup */
-static int      bl;      /**< Current look-ahead character backup */
-static int      bprev;   /**< Previous character backup */
-static unsigned bline;   /**< Current line number backup */
-static unsigned bcolumn; /**< Current column backup */
-static unsigned bseek;   /**< Current position in the file backup */
 static int      tabstop; /**< Width of the tab character */
 
-static token_t t;        /**< Current token */
+static token_t t;        /**< Token being read */
+
+static token_t* ring = NULL; /**< Tokens read, token n is at n % capacity */
+static unsigned capacity = 0;/**< Size of the ring, a power of 2 */
+static unsigned num_read;    /**< Tokens read from the source */
+static unsigned num_given;   /**< Tokens returned by get_token() */
+static unsigned mark;        /**< Token to go back to, the ring keeps every
+                              * token from this one */
+static unsigned marks;       /**< Backtrack points not released yet, the
+                              * tokens given are dropped when there is none */
 
+/** Read the next character of the source, EOF at its end */
+#define NEXT_CHAR() (pos < size ? (unsigned char)text[pos++] : EOF)
+
+static token_t* read_token();
+static void  grow_ring();
 static void  readbyte();
 static int   get_digit(int base);
 static void  parse_num();
@@ -142,10 +155,20 @@ static void  parse_pp_info();
 
 /*========================================================================*//**
  * Initializes the lexer for a new file
+ *
+ * \param source: preprocessed source, which must stay valid while parsing
  *//*=========================================================================*/
-void lexer_init(FILE* infile)
+void lexer_init(const buffer_t* source)
 {
-    f = infile;
+    text = source->data;
+    size = source->size;
+    pos = 0;
+    num_read = 0;
+    num_given = 0;
+    mark = 0;
+    marks = 0;
+    if (!ring)
+        grow_ring();
     tabstop = get_option("-ftabstop=")->value.num;
 
     readbyte();
@@ -161,13 +184,13 @@ void lexer_init(FILE* infile)
                 readbyte();
             else
             {
-                fseek(f, 1, SEEK_SET);
+                pos = 1;
                 l = 0xEF;
             }
         }
         else
         {
-            fseek(f, 1, SEEK_SET);
+            pos = 1;
             l = 0xEF;
         }
     }
@@ -178,9 +201,55 @@ void lexer_init(FILE* infile)
 }
 
 /*========================================================================*//**
- * Get the next token
+ * Release the token ring
+ *//*=========================================================================*/
+void lexer_free()
+{
+    free(ring);
+    ring = NULL;
+    capacity = 0;
+}
+
+/*========================================================================*//**
+ * Get the next token, from the ring if the parser went back, otherwise from
+ * the source
+ *
+ * \return the token, valid until the next call
  *//*=========================================================================*/
 token_t* get_token()
+{
+    if (num_given == num_read)
+    {
+        if (!marks)
+            mark = num_read;
+        else if (num_read - mark == capacity)
+            grow_ring();
+        ring[num_read++ & (capacity - 1)] = *read_token();
+    }
+    return &ring[num_given++ & (capacity - 1)];
+}
+
+/*========================================================================*//**
+ * Double the size of the token ring, keeping the tokens from the mark in
+ * order
+ *//*=========================================================================*/
+void grow_ring()
+{
+    unsigned size = capacity ? capacity * 2 : RING_SIZE;
+    token_t* tokens = (token_t*)mmalloc(size * sizeof(token_t));
+    unsigned n;
+
+    for (n = mark; n != num_read; ++n)
+        tokens[n & (size - 1)] = ring[n & (capacity - 1)];
+    free(ring);
+    ring = tokens;
+    capacity = size;
+}
+
+/*========================================================================*//**
+ * Read the next token from the source
+ *//*=========================================================================*/
+token_t* read_token()
 {
     int skip = '1';
 
@@ -233,7 +302,7 @@ token_t* get_token()
     if (c == '#' && prev == '\n' && isspace(l))
     {
         parse_pp_info();
-        return get_token();
+        return read_token();
     }
 
     if (c == EOF)
@@ -338,7 +407,7 @@ token_t* get_token()
             err(E, "stray '%o' in program", c);
         else
             err(E, "stray \"%c\" in program", c);
-        return get_token();
+        return read_token();
     }
 
     return &t;
@@ -376,39 +445,40 @@ const char* token_name(int id)
     }
 }
 
+/*========================================================================*//**
+ * Mark the current token, the last one returned by get_token(), as the one
+ * lexer_backtrace() goes back to. The tokens before it are no longer needed.
+ *//*=========================================================================*/
 void lexer_backtrace_prepare()
 {
-    bc = c;
-    bl = l;
-    bprev = prev;
-    bline = line;
-    bcolumn = column;
-    bseek = ftell(f);
+    mark = num_given - 1;
+    ++marks;
 }
 
-void lexer_backtrace()
+/*========================================================================*//**
+ * Release the backtrack point set by lexer_backtrace_prepare() when the
+ * parser no longer needs to go back to it
+ *//*=========================================================================*/
+void lexer_backtrace_release()
 {
-    c = bc;
-    l = bl;
-    prev = bprev;
-    line = bline;
-    column = bcolumn;
-    fseek(f, bseek, SEEK_SET);
+    --marks;
 }
 
-void token_copy(token_t* from, token_t* to)
+/*========================================================================*//**
+ * Go back to the marked token. The tokens after it are given again by
+ * get_token() without reading the source.
+ *
+ * \return the marked token
+ *//*=========================================================================*/
+token_t* lexer_backtrace()
 {
-    to->id = from->id;
-    to->line = from->line;
-    to->column = from->column;
-    to->constant = from->constant;
-    to->_unsigned = from->_unsigned;
-    to->_word = from->_word;
-    strcpy(to->string, from->string);
+    num_given = mark + 1;
+    --marks;
+    return &ring[mark & (capacity - 1)];
 }
 
 /*========================================================================*//**
- * Read a character from the source file and update the line and column
+ * Read a character from the source and update the line and column
  * numbers. All different line ending formats are handled and return a single
  * '\n'.
  *//*=========================================================================*/
@@ -416,7 +486,7 @@ void readbyte()
 {
     prev = c;
     c = l;
-    l = fgetc(f);
+    l = NEXT_CHAR();
 
     if (c == '\n')
     {
@@ -424,7 +494,7 @@ void readbyte()
         {
             prev = c;
             c = '\n';
-            l = fgetc(f);
+            l = NEXT_CHAR();
         }
         ++line;
         column = 0;
@@ -435,7 +505,7 @@ void readbyte()
         {
             prev = c;
             c = l;
-            l = fgetc(f);
+            l = NEXT_CHAR();
         }
         ++line;
         column = 0;
@@ -535,7 +605,7 @@ void parse_num()
         {
             int bl = line;
             int bc = column;
-            long fp = ftell(f);
+            size_t fp = pos;
 
             base = 16;
             readbyte();
@@ -545,7 +615,7 @@ void parse_num()
                    || (l >= 'A' && l <= 'F'))
                )
             {
-                fseek(f, fp, SEEK_SET);
+                pos = fp;
                 l = c;
                 line = bl;
                 column = bc;
@@ -9,6 +9,7 @@
 #define LEXER_H
 
 #include <stdio.h>
+#include "buffer.h"
 
 #define MAX_ID_LEN  31
 
@@ -46,12 +47,13 @@ typedef struct
     char         string[MAX_ID_LEN + 1];
 } token_t;
 
-void        lexer_init(FILE* infile);
+void        lexer_init(const buffer_t* source);
+void        lexer_free();
 token_t*    get_token();
 const char* token_name(int id);
 void        lexer_backtrace_prepare();
-void        lexer_backtrace();
-void        token_copy(token_t* from, token_t* to);
+void        lexer_backtrace_release();
+token_t*    lexer_backtrace();
 
 #endif
 
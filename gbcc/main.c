@@ -1,5 +1,8 @@
 /** \defgroup gbcc gbcc
- * C compiler
+ * C compiler. The preprocessor, the parser and the code generator pass their
+ * output to each other in memory. The assembler and the linker are the gbas
+ * and gbld programs: the assembly source and the objects go to them through
+ * files.
  * \addtogroup gbcc
  * \{
  */
@@ -13,26 +16,37 @@
 #include "../common/options.h"
 #include "../common/utils.h"
 #include "../common/files.h"
+#include "../common/timing.h"
 #include "version.h"
 #include "pp.h"
 #include "parser.h"
 #include "ast.h"
 #include "syms.h"
+#include "lexer.h"
+#include "buffer.h"
 
 const char* const pgm = "gbcc";
 
 void help();
 void version();
 void on_fatal_error(int from_program);
+int  build(void* file);
+void compile(sourcefile_t* file);
+int  assemble(sourcefile_t* file);
+int  finish_build();
+
+static const char*   output_name = NULL;
+static int           donot_compile = 0;
+static int           donot_assemble = 0;
+static int           donot_link = 0;
+static sourcefile_t* building[MAX_JOBS];    /**< Files being built, by id of
+                                             * their job */
 
 int main(int argc, char** argv)
 {
     sourcefile_t* file = NULL;
-    char* output_name = NULL;
-
-    int donot_compile = 0;
-    int donot_assemble = 0;
-    int donot_link = 0;
+    int jobs = 0;
+    int running = 0;
 
     esetprogram(pgm);
     esetonfatal(&on_fatal_error);
@@ -43,194 +57,215 @@ int main(int argc, char** argv)
         return EXIT_FAILURE;
 
     donot_compile = get_option("-E")->set;
-    donot_assemble = get_option("-S")->set;
-    donot_link = get_option("-c")->set;
+    donot_assemble = donot_compile || get_option("-S")->set;
+    donot_link = donot_assemble || get_option("-c")->set;
+
+    output_name = get_option("-o")->set ? get_option("-o")->value.str : NULL;
 
-    output_name = (char*)mmalloc(strlen(get_option("-o")->value.str) + 1);
-    strcpy(output_name, get_option("-o")->value.str);
+    jobs = get_option("-j")->value.num;
+    if (jobs <= 0)
+        jobs = num_cpus();
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
 
-    /* .c source files */
+    /* Each source file goes through its whole chain in a job of its own, up
+    to -j jobs at a time */
     file_first();
     while ((file = file_next()) != NULL)
     {
-        if (file->type == C)
+        int id;
+
+        if (!(file->type == C || (file->type == I && !donot_compile)
+              || (file->type == S && !donot_assemble)))
+            continue;
+        if (running == jobs)
+            running -= finish_build();
+        if ((id = spawn_call(pgm, &build, file)) >= 0)
         {
-            FILE* infile = NULL;
-            FILE* outfile = NULL;
-            char* iname = NULL;
-            char* oname = m_tmpnam();
-            int   del = file->tmp;
-
-            iname = (char*)mmalloc(strlen(file->name) + 1);
-            strcpy(iname, file->name);
-
-            esetfile(file->name);
-
-            /*printf("*** preprocessor in: %s\n", iname);
-              printf("*** tmp out: %s\n", oname); */
-
-            if (! (infile = fopen(iname, "rb")) )
-            {
-                ccerr(F, "unable to open \"%s\"", file->name);
-                continue;
-            }
-
-            if (! (outfile = fopen(oname, "wb")) )
-            {
-                fclose(infile);
-                ccerr(F, "unable to create output file");
-                continue;
-            }
-
-            if (pp(iname, infile, outfile))
-            {
-                /* Update file attributes in the list to get the output
-                file name. In case of error the type is not changed and will
-                be ignored by further compilation steps. */
-                file_set_attr(I, !donot_compile);
-
-                /* Copy the tmp file content to the output file */
-                fclose(outfile);
-                if (donot_compile && output_name)
-                {
-                    if (!copy_file(oname, output_name))
-                        err(F, "could not write to the output file");
-                    /* printf("*** preprocessor out: %s\n\n", file_name()); */
-                }
-                else
-                {
-                    if (!copy_file(oname, file_name()))
-                        err(F, "could not write to the output file");
-                }
-            }
-            else
-                fclose(outfile);
-
-            fclose(infile);
-            remove(oname);
-            if (del)
-                remove(iname);
-
+            building[id] = file;
+            ++running;
         }
     }
-/*
-    file_top();
-    printf("\nRemaining files: \n");
-    while((file = file_next()) != NULL)
-        printf("* %s %s\n", file->name, file->tmp ? "to be removed" : "end product");
-    putchar('\n');
-*/
+    while (finish_build())
+        ;
 
     file_first();
-    while ((file = file_next()) != NULL && !donot_compile)
+    if (!donot_link && !errors())
     {
-        if (file->type == I)
-        {
-            FILE* infile = NULL;
-            FILE* outfile = NULL;
-            char* iname = NULL;
-            char* oname = m_tmpnam();
-            int   del = file->tmp;
-
-            iname = (char*)mmalloc(strlen(file->name) + 1);
-            strcpy(iname, file->name);
-
-            esetfile(file->name);
-
-            /* printf("*** parser in: %s\n", iname);
-               printf("*** tmp out: %s\n", oname); */
-
-            if (! (infile = fopen(iname, "rb")) )
-            {
-                ccerr(E, "unable to open \"%s\"", file->name);
-                continue;
-            }
-
-            if (! (outfile = fopen(oname, "wb")) )
-            {
-                fclose(infile);
-                ccerr(E, "unable to create output file");
-                continue;
-            }
-
-            if (parse(infile, outfile))
-            {
-                file_set_attr(S, !donot_assemble);
-                fclose(outfile);
-                if (donot_assemble && output_name)
-                {
-                    if (!copy_file(oname, output_name))
-                        err(F, "could not write to the output file");
-                }
-                else
-                {
-                    if (!copy_file(oname, file_name()))
-                        err(F, "could not write to the output file");
-                }
-            }
-            else
-                fclose(outfile);
-
-            fclose(infile);
-            remove(oname);
-            if (del)
-                remove(iname);
+        char** opts;
+        opts = gen_options(GBLD);
+        while ((file = file_next()))
+            opts = add_option(opts, file->name);
+        exec("gbld", opts);
+    }
 
-        }
+    if (errors())
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+/*========================================================================*//**
+ * Run the whole chain of a source file, from the preprocessor to the
+ * assembler, as far as the options ask. This is the job of the file: the
+ * lexer, the parser and the symbol tables are global, so each file has a
+ * process of its own.
+ *
+ * \param file: the file of the list to build
+ * \return 1 on success
+ *//*=========================================================================*/
+int build(void* file)
+{
+    sourcefile_t* f = (sourcefile_t*)file;
+    int before = errors();  /* Errors of the files already built */
+
+    if (f->type == C || (f->type == I && !donot_compile))
+    {
+        compile(f);
+        /* The assembler and the linker print their own report */
+        if (get_option("-ftime-report")->set)
+            timing_report(pgm);
     }
-/*
-    file_top();
-    printf("\nRemaining files: \n");
-    while((file = file_next()) != NULL)
-        printf("* %s %s\n", file->name, file->tmp ? "to be removed" : "end product");
-*/
+    if (f->type == S && !donot_assemble)
+        assemble(f);
 
-    file_first();
-    while ((file = file_next()) != NULL && !donot_assemble)
+    return errors() == before;
+}
+
+/*========================================================================*//**
+ * Preprocess, parse and generate the code of a .c or .i file. The stages
+ * pass their output to the next one in memory: the preprocessed source is
+ * only written with -E, and the assembly source is written for the
+ * assembler, or with -S.
+ *
+ * \param file: the file of the list, whose type and name are updated to the
+ * ones of the last output written
+ *//*=========================================================================*/
+void compile(sourcefile_t* file)
+{
+    buffer_t source;
+    buffer_t assembly;
+
+    esetfile(file->name);
+    buffer_init(&source);
+
+    if (file->type == C)
     {
-        if (file->type == S)
+        FILE* infile = NULL;
+        int   done;
+
+        if (! (infile = fopen(file->name, "rb")) )
+        {
+            ccerr(F, "unable to open \"%s\"", file->name);
+            return;
+        }
+
+        timing_start("preprocess");
+        done = pp(file->name, infile, &source);
+        fclose(infile);
+        timing_stop();
+
+        /* In case of error the type is not changed and will be ignored by
+        further compilation steps */
+        if (!done)
+        {
+            buffer_free(&source);
+            return;
+        }
+
+        if (donot_compile)
         {
-            char*  iname = NULL;
-            int    del = file->tmp;
-            char** opts;
-            int oset = get_option("-o")->set;
-
-            iname = (char*)mmalloc(strlen(file->name) + 1);
-            strcpy(iname, file->name);
-
-            if (!donot_link && file_count() > 1)
-                get_option("-o")->set = 0;
-
-            opts = gen_options(GBAS);
-            /* We don't want gbas to invoke the linker */
-            if (!donot_link)
-                opts = add_option(opts, "-c");
-            get_option("-o")->set = oset;
-
-            opts = add_option(opts, iname);
-            if (exec("gbas", opts))
-            {
-                file_set_attr(O, 0);
-                if (del)
-                    remove(iname);
-            }
+            file_set_type(file, I, 0);
+            if (!buffer_save(&source, output_name ? output_name : file->name))
+                err(F, "could not write to the output file");
+            buffer_free(&source);
+            return;
         }
     }
+    else if (!buffer_load(&source, file->name))
+    {
+        ccerr(E, "unable to open \"%s\"", file->name);
+        buffer_free(&source);
+        return;
+    }
 
-    file_first();
-    if (!donot_link && !errors())
+    buffer_init(&assembly);
+    timing_start("parse");
+    if (parse(&source, &assembly))
     {
-        char** opts;
-        opts = gen_options(GBAS);
-        while ((file = file_next()))
-            opts = add_option(opts, file->name);
-        exec("gbld", opts);
+        file_set_type(file, S, !donot_assemble);
+        if (!buffer_save(&assembly, donot_assemble && output_name
+                                    ? output_name : file->name))
+            err(F, "could not write to the output file");
     }
+    timing_stop();
 
-    if (errors())
-        return EXIT_FAILURE;
+    buffer_free(&source);
+    buffer_free(&assembly);
+}
 
-    return EXIT_SUCCESS;
+/*========================================================================*//**
+ * Assemble a .s file. It becomes the object file, and its source is removed
+ * if it was temporary.
+ *
+ * \return 1 on success
+ *//*=========================================================================*/
+int assemble(sourcefile_t* file)
+{
+    char** opts;
+    int oset = get_option("-o")->set;
+    int done;
+
+    if (!donot_link && file_count() > 1)
+        get_option("-o")->set = 0;
+
+    opts = gen_options(GBAS);
+    /* We don't want gbas to invoke the linker */
+    if (!donot_link)
+        opts = add_option(opts, "-c");
+    get_option("-o")->set = oset;
+
+    opts = add_option(opts, file->name);
+    done = exec("gbas", opts);
+    free_options(opts);
+
+    if (done)
+    {
+        if (file->tmp)
+            remove(file->name);
+        file_set_type(file, O, 0);
+    }
+    return done;
+}
+
+/*========================================================================*//**
+ * Wait for one of the jobs to end. The job has worked on its own copy of the
+ * list of files, so the file it built is given the type of its last output
+ * here.
+ *
+ * \return 0 if no job was running
+ *//*=========================================================================*/
+int finish_build()
+{
+    sourcefile_t* file;
+    int id;
+    int done = wait_job(&id);
+
+    if (id < 0)
+        return 0;
+
+    file = building[id];
+    building[id] = NULL;
+    if (done)
+    {
+        if (donot_compile)
+            file_set_type(file, I, 0);
+        else if (donot_assemble)
+            file_set_type(file, S, 0);
+        else
+            file_set_type(file, O, 0);
+    }
+    return 1;
 }
 
 void help()
@@ -243,8 +278,15 @@ void help()
     puts("  -S               Compile only; do not assemble or link.");
     puts("  -c               Compile and assemble, but do not link.");
     puts("  -o <file>        Place the output into <file>.");
+    puts("  -j<jobs>         Build up to <jobs> files at a time; the default");
+    puts("                   is the number of processors.");
     puts("  -g               Generate debug information file");
     puts("  -ftabstop=width  Set the distance between tab stops");
+    puts("  -ftime-report    Display the time and memory spent in each phase");
+    puts("  -mcartridge=<type>");
+    puts("                   Set the cartridge type (rom, mbc1, mbc5+ram...)");
+    puts("  -mrom-size=<KB>  Set the ROM size, from 32 to 8192 KB");
+    puts("  -mram-size=<KB>  Set the external RAM size: 0, 8, 32, 64 or 128 KB");
     exit(EXIT_SUCCESS);
 }
 
@@ -262,6 +304,7 @@ void on_fatal_error(int from_program)
 {
     ast_free();
     syms_free();
+    lexer_free();
 
     if (from_program)
     {
@@ -14,6 +14,7 @@
 
 #include "../common/errors.h"
 #include "../common/options.h"
+#include "../common/timing.h"
 #include "lexer.h"
 #include "ast.h"
 #include "syms.h"
@@ -21,10 +22,10 @@
 
 static token_t *t;      /**< The current token */
 static int     last_id; /**< Last token type */
-static token_t bt;
 static int     blast_id;
 
 static void    backtrace_prepare();
+static void    backtrace_release();
 static void    backtrace();
 
 static void    next();
@@ -79,12 +80,12 @@ static int     jump_statement();
 
 static int     function_definition();
 
-int parse(FILE* infile, FILE* outfile)
+int parse(const buffer_t* source, buffer_t* out)
 {
     int parse_error = errors();
     ast_init();
     syms_init();
-    lexer_init(infile);
+    lexer_init(source);
 
     t = get_token();
     last_id = ' ';
@@ -113,29 +114,34 @@ int parse(FILE* infile, FILE* outfile)
         }
     }
 
-    syms_dump(outfile);
-    ast_dump(outfile);
+    timing_start("codegen");
+    syms_dump(out);
+    ast_dump(out);
 #ifdef NDEBUG
     if (errors() == parse_error)
 #endif
-        codegen(outfile);
+        codegen(out);
     
     ast_free();
     syms_free();
+    lexer_free();
     return errors() == parse_error;
 }
 
 void backtrace_prepare()
 {
     lexer_backtrace_prepare();
-    token_copy(t, &bt);
     blast_id = last_id;
 }
 
+void backtrace_release()
+{
+    lexer_backtrace_release();
+}
+
 void backtrace()
 {
-    lexer_backtrace();
-    token_copy(&bt, t);
+    t = lexer_backtrace();
     last_id = blast_id;
 }
 
@@ -424,6 +430,7 @@ node_t assignment_expression()
         {
             node_t right = NULL;
             int op = t->id;
+            backtrace_release();
             next();
             if ((right = assignment_expression()))
             {
@@ -496,7 +503,6 @@ int declaration()
         sync(";");
     }
 
-    free(s);
     return 0;
 }
 
@@ -796,12 +802,12 @@ int function_definition()
         if (!s->function)
         {
             backtrace();
-            free(s);
             return 0;
         }
 
         if (t->id == '{')
         {
+            backtrace_release();
             syms_add(s);
             ast_add_node(function(s->id));
             compound_statement();
@@ -815,12 +821,12 @@ int function_definition()
             if (!s->function)
             {
                 backtrace();
-                free(s);
                 return 0;
             }
 
             if (t->id == '{')
             {
+                backtrace_release();
                 syms_add(s);
                 ast_add_node(function(s->id));
                 compound_statement();
@@ -830,7 +836,6 @@ int function_definition()
     }
 
     backtrace();
-    free(s);
     return 0;
 }
 
@@ -8,9 +8,9 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <stdio.h>
+#include "buffer.h"
 
-int parse(FILE* infile, FILE* outfile);
+int parse(const buffer_t* source, buffer_t* out);
 
 #endif
 
@@ -38,9 +38,9 @@ static void process();
  * Preprocess a C source file
  *
  * \param infile: source file in binary read mode
- * \param outfile: output preprocessed source file in binary write mode
+ * \param out: receives the preprocessed source
  *//*=========================================================================*/
-int pp(const char* filename, FILE* infile, FILE* outfile)
+int pp(const char* filename, FILE* infile, buffer_t* out)
 {
     unsigned char bom1, bom2, bom3;
     char* pl;
@@ -64,7 +64,7 @@ int pp(const char* filename, FILE* infile, FILE* outfile)
     mlc = 0;
     line = 1;
 
-    fprintf(outfile, "# 1 \"%s\"\n", filename);
+    buffer_printf(out, "# 1 \"%s\"\n", filename);
     do
     {
         int curline = line;
@@ -79,10 +79,10 @@ int pp(const char* filename, FILE* infile, FILE* outfile)
         
         pl = linebuf;
         while (*pl)
-            fputc(*pl++, outfile);
+            buffer_putc(out, *pl++);
             
         if (update_line)
-            fprintf(outfile, "# %d \"%s\"\n", line, filename);
+            buffer_printf(out, "# %d \"%s\"\n", line, filename);
             
         process(curline);
             
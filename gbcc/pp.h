@@ -9,8 +9,9 @@
 #define PP_H
 
 #include <stdio.h>
+#include "buffer.h"
 
-int pp(const char* filename, FILE* infile, FILE* outfile);
+int pp(const char* filename, FILE* infile, buffer_t* out);
 
 #endif
 
@@ -2,6 +2,8 @@
  * \addtogroup gbcc
  * \{
  * \defgroup syms Symbols table
+ * The tables, their symbols and lists are allocated from an arena, released
+ * at once by syms_free().
  * \addtogroup syms
  * \{
  */
@@ -13,14 +15,19 @@
 
 #include "../common/errors.h"
 #include "../common/utils.h"
+#include "arena.h"
 
+#define MIN_ENTRIES 8   /**< Initial size of the lists of a table */
+
+static symtbl_t* create_symtbl(symtbl_t* parent, int scope_id);
+static void*     grow_list(void* list, unsigned int num, unsigned int* max);
 static symtbl_t* find_scope_id(symtbl_t* s, int scope_id);
-static void      free_symtbl(symtbl_t* s);
 
 static int       scope_id;      /**< ++ each time a new scope is created */
 static int       cur_scope_id;  /**< Current scope id, 0 meaning global scope */
 static symtbl_t* root = NULL;   /**< Root of the symbol table */
 static symtbl_t* scope = NULL;  /**< Current scope's symbol table */
+static arena_t   arena;         /**< Memory of the tables and symbols */
 
 /*========================================================================*//**
  * Initialize the symbol table
@@ -28,13 +35,7 @@ static symtbl_t* scope = NULL;  /**< Current scope's symbol table */
 void syms_init()
 {
     syms_free();
-    root = (symtbl_t*)mmalloc(sizeof(symtbl_t));
-    root->scope_id = 0;
-    root->num_syms = 0;
-    root->num_children = 0;
-    root->parent = NULL;
-    root->children = NULL;
-    root->syms = NULL;
+    root = create_symtbl(NULL, 0);
 
     scope_id = 0;
     cur_scope_id = 0;
@@ -47,12 +48,9 @@ void syms_init()
  *//*=========================================================================*/
 void syms_free()
 {
-    if (root)
-    {
-        free_symtbl(root);
-        root = NULL;
-        scope = NULL;
-    }
+    arena_free(&arena);
+    root = NULL;
+    scope = NULL;
 }
 
 /*========================================================================*//**
@@ -72,11 +70,11 @@ symtbl_t* syms_get_table()
 }
 
 /*========================================================================*//**
- * Create a new symbol
+ * Create a new symbol, valid until syms_free()
  *//*=========================================================================*/
 sym_t* create_sym()
 {
-    sym_t* s = (sym_t*)mmalloc(sizeof(sym_t));
+    sym_t* s = (sym_t*)arena_alloc(&arena, sizeof(sym_t));
     s->id[0] = 0;
     s->type_id = 0;
     s->function = 0;
@@ -106,7 +104,7 @@ sym_t* get_sym(const char *id)
 }
 
 /*========================================================================*//**
- * Add a symbol to the table or destroy it if the declaration was
+ * Add a symbol to the table or ignore it if the declaration was
  * empty
  *//*=========================================================================*/
 void syms_add(sym_t* s)
@@ -114,10 +112,7 @@ void syms_add(sym_t* s)
     int i;
     /* empty declaration like 'static byte;' */
     if (s->id[0] == 0)
-    {
-        free(s);
         return;
-    }
 
     /* set default type */
     if (!s->type_id)
@@ -134,10 +129,10 @@ void syms_add(sym_t* s)
     }
     */
 
-    scope->num_syms++;
-    scope->syms = (sym_t**)mrealloc(scope->syms,
-                                   sizeof(sym_t*) * scope->num_syms);
-    scope->syms[scope->num_syms - 1] = s;
+    if (scope->num_syms == scope->max_syms)
+        scope->syms = (sym_t**)grow_list(scope->syms, scope->num_syms,
+                                         &scope->max_syms);
+    scope->syms[scope->num_syms++] = s;
 
 
 }
@@ -148,22 +143,17 @@ void syms_add(sym_t* s)
 int syms_inc_scope()
 {
     symtbl_t* new;
-    scope->num_children++;
-    scope->children = (symtbl_t**)mrealloc(scope->children,
-                                           sizeof(symtbl_t*) * scope->num_children);
-    new = (symtbl_t*)mmalloc(sizeof(symtbl_t));
+
+    if (scope->num_children == scope->max_children)
+        scope->children = (symtbl_t**)grow_list(scope->children,
+                                                scope->num_children,
+                                                &scope->max_children);
 
     ++scope_id;
     cur_scope_id = scope_id;
 
-    new->scope_id = scope_id;
-    new->parent = scope;
-    new->num_syms = 0;
-    new->num_children = 0;
-    new->syms = NULL;
-    new->children = NULL;
-
-    scope->children[scope->num_children - 1] = new;
+    new = create_symtbl(scope, scope_id);
+    scope->children[scope->num_children++] = new;
     scope = new;
 
     return cur_scope_id;
@@ -206,40 +196,55 @@ symtbl_t* find_scope_id(symtbl_t* s, int scope_id)
 }
 
 /*========================================================================*//**
- * Recursively free the symbol table
+ * Create an empty symbol table
  *//*=========================================================================*/
-void free_symtbl(symtbl_t* s)
+symtbl_t* create_symtbl(symtbl_t* parent, int scope_id)
 {
-    unsigned int i;
-    if (s->children)
-    {
-        for (i = 0; i < s->num_children; i++)
-            free_symtbl(s->children[i]);
-        free (s->children);
-    }
+    symtbl_t* s = (symtbl_t*)arena_alloc(&arena, sizeof(symtbl_t));
+
+    s->scope_id = scope_id;
+    s->num_syms = 0;
+    s->max_syms = 0;
+    s->num_children = 0;
+    s->max_children = 0;
+    s->parent = parent;
+    s->children = NULL;
+    s->syms = NULL;
+    return s;
+}
 
-    if (s->syms)
-    {
-        for (i = 0; i < s->num_syms; i++)
-            free(s->syms[i]);
-        free(s->syms);
-    }
+/*========================================================================*//**
+ * Replace a full list of pointers of a table by a twice larger one, the old
+ * one being left to the arena
+ *
+ * \param list: the list, NULL if empty
+ * \param num: number of pointers in the list
+ * \param max: size of the list, updated
+ * \return the new list
+ *//*=========================================================================*/
+void* grow_list(void* list, unsigned int num, unsigned int* max)
+{
+    void* new;
 
-    free(s);
+    *max = *max ? *max * 2 : MIN_ENTRIES;
+    new = arena_alloc(&arena, sizeof(void*) * *max);
+    if (num)
+        memcpy(new, list, sizeof(void*) * num);
+    return new;
 }
 
 
 
 
-void syms_dump_e(FILE* f, symtbl_t* t)
+void syms_dump_e(buffer_t* f, symtbl_t* t)
 {
     unsigned int i;
     if (t->num_syms)
-        fprintf(f, ";-------------------------------------------------------------------------------\n");
+        buffer_printf(f, ";-------------------------------------------------------------------------------\n");
     for (i = 0; i < t->num_syms; i++)
     {
         sym_t* s = t->syms[i];
-        fprintf(f, "; %-31s %-9s %-5s %-6d\n", s->id, token_name(s->type_id), s->function ? "YES" : "", t->scope_id);
+        buffer_printf(f, "; %-31s %-9s %-5s %-6d\n", s->id, token_name(s->type_id), s->function ? "YES" : "", t->scope_id);
     }
 
     for (i = 0; i < t->num_children; i++)
@@ -249,12 +254,12 @@ void syms_dump_e(FILE* f, symtbl_t* t)
     }
 }
 
-void syms_dump(FILE* f)
+void syms_dump(buffer_t* f)
 {
-    fprintf(f, ";**************************** SYMBOL TABLE *************************************\n;\n");
-    fprintf(f, "; %-31s %-9s %-5s %-6s\n", "NAME", "TYPE", "FUNC", "SCOPE");
+    buffer_printf(f, ";**************************** SYMBOL TABLE *************************************\n;\n");
+    buffer_printf(f, "; %-31s %-9s %-5s %-6s\n", "NAME", "TYPE", "FUNC", "SCOPE");
     syms_dump_e(f, root);
-    fprintf(f, ";*******************************************************************************\n\n\n");
+    buffer_printf(f, ";*******************************************************************************\n\n\n");
 }
 
 /**
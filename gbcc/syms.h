@@ -27,7 +27,9 @@ struct symtbl_s
 {
     int          scope_id;      /**< ID of the table's scope */
     unsigned int num_syms;      /**< Number of symbols in this table */
+    unsigned int max_syms;      /**< Size of the symbols list */
     unsigned int num_children;  /**< Number of child tables */
+    unsigned int max_children;  /**< Size of the child tables list */
     sym_t**      syms;          /**< Symbols list */
     symtbl_t**   children;      /**< Child tables list */
     symtbl_t*    parent;        /**< Parent table */
@@ -46,8 +48,8 @@ int       syms_inc_scope();
 void      syms_dec_scope();
 
 
-#include <stdio.h>
-void syms_dump(FILE* f);
+#include "buffer.h"
+void syms_dump(buffer_t* f);
 
 #endif
 
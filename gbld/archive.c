@@ -0,0 +1,172 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup archive Archives
+ * Static libraries written by gbar. Only the header, the member table and
+ * the symbol index of an archive are read when it is opened; a member is
+ * read when it defines a symbol that no file loaded so far defines.
+ * \addtogroup archive
+ * \{
+ */
+
+#include "archive.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+
+typedef struct archive_s
+{
+    char*             name;
+    FILE*             file;
+    archive_member_t* members;
+    int               num_members;
+    archive_symbol_t* index;        /**< global symbols, sorted by name */
+    int               num_symbols;
+    char*             loaded;       /**< members already read */
+} archive_t;
+
+static archive_t* archives = NULL;
+static int        num_archives = 0;
+
+static int find_index(archive_t* archive, const char* symbol);
+
+/*========================================================================*//**
+ * Open an archive and read its symbol index
+ *
+ * \param name: name of the archive file
+ *//*=========================================================================*/
+void open_archive(const char* name)
+{
+    archive_header_t header;
+    archive_t* archive;
+    FILE* file;
+    int i;
+
+    esetfile(name);
+    if (!(file = fopen(name, "rb")))
+    {
+        ccerr(F, "unable to open \"%s\"", name);
+        return;
+    }
+
+    archives = (archive_t*)mrealloc(archives,
+                                    sizeof(archive_t) * (num_archives + 1));
+    archive = archives + num_archives++;
+    memset(archive, 0, sizeof(archive_t));
+    archive->name = (char*)mmalloc(strlen(name) + 1);
+    strcpy(archive->name, name);
+    archive->file = file;
+
+    set_infile(file);
+    read_archive_header(&header);
+    archive->num_members = header.num_members;
+    archive->num_symbols = header.num_symbols;
+    archive->members = (archive_member_t*)mmalloc(sizeof(archive_member_t)
+                                                  * (header.num_members + 1));
+    archive->index = (archive_symbol_t*)mmalloc(sizeof(archive_symbol_t)
+                                                * (header.num_symbols + 1));
+    archive->loaded = (char*)mmalloc(header.num_members + 1);
+    memset(archive->loaded, 0, header.num_members + 1);
+
+    for (i = 0; i < header.num_members; ++i)
+        read_archive_member(archive->members + i);
+    for (i = 0; i < header.num_symbols; ++i)
+    {
+        read_archive_symbol(archive->index + i);
+        if (archive->index[i].member < 0
+            || archive->index[i].member >= header.num_members)
+            err(F, "invalid archive: symbol index corrupted");
+    }
+}
+
+/*========================================================================*//**
+ * Find the archive member defining a symbol, in the order the archives were
+ * given, and mark it as read
+ *
+ * \param symbol: name of the symbol
+ * \param name: receives the name of the member, as "archive(member)", to be
+ * freed by the caller
+ * \param path: receives the name of the archive file
+ * \param end: receives the offset of the end of the member
+ * \return the archive file positioned at the start of the member, or NULL if
+ * no archive defines the symbol or its member has already been read
+ *//*=========================================================================*/
+FILE* archive_member(const char* symbol, char** name, const char** path,
+                     long* end)
+{
+    int i, idx;
+
+    for (i = 0; i < num_archives; ++i)
+    {
+        archive_t* archive = archives + i;
+        archive_member_t* member;
+
+        if ((idx = find_index(archive, symbol)) < 0)
+            continue;
+        idx = archive->index[idx].member;
+        if (archive->loaded[idx])
+            return NULL;
+
+        archive->loaded[idx] = 1;
+        member = archive->members + idx;
+        *name = (char*)mmalloc(strlen(archive->name)
+                               + strlen((char*)member->name) + 3);
+        sprintf(*name, "%s(%s)", archive->name, (char*)member->name);
+        *path = archive->name;
+        *end = member->offset + member->size;
+        fseek(archive->file, member->offset, SEEK_SET);
+        return archive->file;
+    }
+
+    return NULL;
+}
+
+void free_archives()
+{
+    int i;
+
+    for (i = 0; i < num_archives; ++i)
+    {
+        fclose(archives[i].file);
+        free(archives[i].name);
+        free(archives[i].members);
+        free(archives[i].index);
+        free(archives[i].loaded);
+    }
+    free(archives);
+    archives = NULL;
+    num_archives = 0;
+}
+
+/*========================================================================*//**
+ * Binary search of a symbol in the index of an archive
+ *
+ * \return index of the symbol, -1 if the archive does not define it
+ *//*=========================================================================*/
+int find_index(archive_t* archive, const char* symbol)
+{
+    int lo = 0, hi = archive->num_symbols - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp((char*)archive->index[mid].id, symbol);
+
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+/**
+ * \} archive
+ * \} gbld
+ */
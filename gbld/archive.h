@@ -0,0 +1,23 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup archive
+ * \{
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "../common/objfile.h"
+
+void  open_archive(const char* name);
+FILE* archive_member(const char* symbol, char** name, const char** path,
+                     long* end);
+void  free_archives();
+
+#endif
+
+/**
+ * \} archive
+ * \} gbld
+ */
@@ -0,0 +1,223 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup compress Compressed sections
+ * The data of the sections with the compress=lz attribute is compressed
+ * when the object file is read, before anything is placed. The stream is a
+ * sequence of tokens decoded by lz_decompress (lib/gblib.s):
+ *
+ *  - $00: end of the stream
+ *  - $01-$7F: the number of literal bytes which follow
+ *  - $80-$FF: a copy of (token & $7F) + 3 bytes, followed by one byte
+ *    holding the distance of the copy minus 1
+ *
+ * Each global symbol at the start of a compressed section gets two
+ * constants: __size_<symbol>, the size of the data once decompressed, and
+ * __lzsize_<symbol>, the size of the stream. They belong to an empty
+ * section added to the file, which is never allocated.
+ * \addtogroup compress
+ * \{
+ */
+
+#include "compress.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+#include "state.h"
+
+#define MAX_LITERALS    0x7F
+#define MIN_MATCH       3
+#define MAX_MATCH       (0x7F + MIN_MATCH)
+#define WINDOW          0x100
+
+static unsigned char* compress_lz(const unsigned char* data, int size,
+                                  int* out_size);
+static void add_constant(int file_id, int sect_id, int sym_id,
+                         const char* name, int value);
+
+/*========================================================================*//**
+ * Compress the sections of a file with the compress=lz attribute and define
+ * their size symbols. The sections, symbols and relocations of the file
+ * must have been read.
+ *
+ * \param file_id: id of the file
+ * \return number of bytes saved
+ *//*=========================================================================*/
+int compress_sections(int file_id)
+{
+    list_t* list;
+    int num_sections = 0, num_symbols = 0, constants = -1, saved = 0;
+
+    for (list = lsections; list; list = list->next)
+    {
+        if (list->file_id == file_id)
+            ++num_sections;
+    }
+    for (list = lsymbols; list; list = list->next)
+    {
+        symbol_entry_t* sym = (symbol_entry_t*)list->data;
+        if (list->file_id == file_id && sym->sym_id >= num_symbols)
+            num_symbols = sym->sym_id + 1;
+    }
+
+    for (list = lsections; list; list = list->next)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+        list_t* lsym;
+        list_t* lreloc;
+        unsigned char* packed;
+        int size;
+
+        if (list->file_id != file_id || !(sect->flags & SECTION_LZ))
+            continue;
+
+        /* The data cannot be relocated once compressed */
+        for (lreloc = lrelocations; lreloc; lreloc = lreloc->next)
+        {
+            if (lreloc->file_id == file_id && ((reloc_entry_t*)lreloc->data)
+                                              ->section_id == sect->id)
+            {
+                ccerr(E, "compressed section %d holds addresses to relocate",
+                      sect->id);
+                break;
+            }
+        }
+
+        for (lsym = lsymbols; lsym; lsym = lsym->next)
+        {
+            symbol_entry_t* sym = (symbol_entry_t*)lsym->data;
+            if (lsym->file_id != file_id || sym->type == _extern
+                || sym->section_id != sect->id)
+                continue;
+            if (sym->offset != 0)
+                ccerr(E, "'%s' is not at the start of its compressed section",
+                      sym->id);
+        }
+
+        packed = compress_lz(sect->data, sect->data_size, &size);
+        saved += sect->data_size - size;
+
+        if (constants < 0)
+        {
+            section_entry_t* c;
+
+            c = (section_entry_t*)mmalloc(sizeof(section_entry_t));
+            memset(c, 0, sizeof(section_entry_t));
+            c->id = constants = num_sections;
+            c->type = org;
+            list_add(&lsections, file_id, c, SECT_TREATED | SECT_CONSTANTS);
+            capture_section(c);
+        }
+
+        for (lsym = lsymbols; lsym; lsym = lsym->next)
+        {
+            symbol_entry_t* sym = (symbol_entry_t*)lsym->data;
+            char name[64];
+
+            if (lsym->file_id != file_id || sym->type != _global
+                || sym->section_id != sect->id || sym->offset != 0)
+                continue;
+            if (strlen((char*)sym->id) > 31 - strlen("__lzsize_"))
+            {
+                ccerr(E, "'%s' is too long a name for its size symbols",
+                      sym->id);
+                continue;
+            }
+            sprintf(name, "__size_%s", sym->id);
+            add_constant(file_id, constants, num_symbols++, name,
+                         sect->data_size);
+            sprintf(name, "__lzsize_%s", sym->id);
+            add_constant(file_id, constants, num_symbols++, name, size);
+        }
+
+        free(sect->data);
+        sect->data = packed;
+        sect->data_size = size;
+        sect->flags &= ~SECTION_LZ;
+        list->flags |= SECT_COMPRESSED;
+    }
+
+    return saved;
+}
+
+/*========================================================================*//**
+ * Greedy LZ compression: at each position, the longest match of the last
+ * 256 bytes is copied if it is at least 3 bytes long
+ *
+ * \param out_size: receives the size of the stream, end token included
+ * \return the stream, to be freed by the caller
+ *//*=========================================================================*/
+unsigned char* compress_lz(const unsigned char* data, int size, int* out_size)
+{
+    /* In the worst case, one count byte for every 127 literals */
+    unsigned char* out = (unsigned char*)mmalloc(size + size / MAX_LITERALS
+                                                 + 2);
+    int pos = 0, n = 0, literal = -1;
+
+    while (pos < size)
+    {
+        int best_len = 0, best_dist = 0, start, i;
+
+        start = pos > WINDOW ? pos - WINDOW : 0;
+        for (i = pos - 1; i >= start; --i)
+        {
+            int len = 0;
+            while (len < MAX_MATCH && pos + len < size
+                   && data[i + len] == data[pos + len])
+                ++len;
+            if (len > best_len)
+            {
+                best_len = len;
+                best_dist = pos - i;
+                if (len == MAX_MATCH)
+                    break;
+            }
+        }
+
+        if (best_len >= MIN_MATCH)
+        {
+            out[n++] = 0x80 | (best_len - MIN_MATCH);
+            out[n++] = best_dist - 1;
+            pos += best_len;
+            literal = -1;
+        }
+        else
+        {
+            /* Extend the current literal run or start a new one */
+            if (literal < 0 || out[literal] == MAX_LITERALS)
+            {
+                literal = n++;
+                out[literal] = 0;
+            }
+            ++out[literal];
+            out[n++] = data[pos++];
+        }
+    }
+
+    out[n++] = 0;
+    *out_size = n;
+    return out;
+}
+
+void add_constant(int file_id, int sect_id, int sym_id, const char* name,
+                  int value)
+{
+    symbol_entry_t* sym = (symbol_entry_t*)mmalloc(sizeof(symbol_entry_t));
+
+    memset(sym, 0, sizeof(symbol_entry_t));
+    sym->sym_id = sym_id;
+    strcpy((char*)sym->id, name);
+    sym->hash = hash_name(name);
+    sym->section_id = sect_id;
+    sym->offset = value;
+    sym->type = _global;
+    list_add(&lsymbols, file_id, sym, file_id);
+}
+
+/**
+ * \} compress
+ * \} gbld
+ */
@@ -0,0 +1,20 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup compress
+ * \{
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "lists.h"
+
+int compress_sections(int file_id);
+
+#endif
+
+/**
+ * \} compress
+ * \} gbld
+ */
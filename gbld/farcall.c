@@ -0,0 +1,387 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup farcall Far calls
+ * Trampolines for calls and jumps between switchable ROM banks. A CALL from
+ * one switchable bank to a routine of another one goes through a ROM 0
+ * trampoline which maps the target bank, calls the routine and maps the
+ * caller's bank back. A JP goes through a trampoline which only maps the
+ * target bank. Registers and flags are preserved in both directions.
+ * \addtogroup farcall
+ * \{
+ */
+
+#include "farcall.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+#include "../common/gbmmap.h"
+#include "lists.h"
+#include "map.h"
+
+#define MAX_TRAMPOLINE_SIZE 32
+
+typedef struct trampoline_s
+{
+    int                  caller_bank; /**< bank restored on return, -1 for a
+                                       * jump trampoline */
+    int                  target_bank;
+    int                  target_addr;
+    unsigned             address;
+    struct trampoline_s* next;
+} trampoline_t;
+
+typedef struct far_site_s
+{
+    char*              filename;
+    int                bank;
+    int                address;
+    char               target[32];
+    int                target_bank;
+    unsigned           trampoline;
+    struct far_site_s* next;
+} far_site_t;
+
+static int           file_id = -1;    /**< id of the linker generated file */
+static int           num_sections = 0;
+static int           high_register;   /**< address of the MBC register holding
+                                       * the upper bits of the bank number, 0
+                                       * if none */
+static int           high_shift;
+static int           low_mask;
+static trampoline_t* trampolines = NULL;
+static far_site_t*   sites = NULL;
+static far_site_t*   last_site = NULL;
+
+static int      caller_bank_of(section_entry_t* sect, int offset);
+static int      emit_select(unsigned char* p, int bank);
+static unsigned new_trampoline(int caller_bank, int target_bank,
+                               int target_addr, const char* target_name);
+
+/*========================================================================*//**
+ * Prepare the generation of trampolines for the current cartridge
+ *
+ * \param id: file id given to the trampolines, after the ones of the input
+ * files
+ *//*=========================================================================*/
+void init_far_calls(int id)
+{
+    cartridge_type_t type = get_cartridge().cart_type;
+
+    free_far_calls();
+    file_id = id;
+    num_sections = 0;
+    high_register = 0;
+    high_shift = 0;
+    low_mask = 0xFF;
+
+    if (type >= mbc1 && type <= mbc1_ram_battery)
+    {
+        low_mask = 0x1F;
+        if (get_num_rom_banks() > 32)
+        {
+            high_register = 0x4000;
+            high_shift = 5;
+        }
+    }
+    else if (type >= mbc5 && type <= mbc5_rumble_ram_battery)
+    {
+        if (get_num_rom_banks() > 256)
+        {
+            high_register = 0x3000;
+            high_shift = 8;
+        }
+    }
+    else if (type >= mbc3_timer_battery && type <= mbc3_ram_battery)
+        low_mask = 0x7F;
+}
+
+void free_far_calls()
+{
+    trampoline_t* tnext;
+    far_site_t*   snext;
+
+    while (trampolines)
+    {
+        tnext = trampolines->next;
+        free(trampolines);
+        trampolines = tnext;
+    }
+    while (sites)
+    {
+        snext = sites->next;
+        free(sites->filename);
+        free(sites);
+        sites = snext;
+    }
+    last_site = NULL;
+}
+
+/*========================================================================*//**
+ * Tell whether a relocated address is the operand of a CALL or JP from a
+ * switchable ROM bank to another one. gbas gives these operands their own
+ * kind of relocation.
+ *
+ * \param sect: section containing the relocated address
+ * \param target_sect: section containing the target symbol
+ * \param kind: kind of the relocation
+ *//*=========================================================================*/
+int is_far_call(section_entry_t* sect, section_entry_t* target_sect,
+                int kind)
+{
+    return kind == call_address
+           && get_space(sect->offset) == rom_n
+           && get_space(target_sect->offset) == rom_n
+           && sect->bank_num != target_sect->bank_num;
+}
+
+/*========================================================================*//**
+ * Get the trampoline to use for a far call or jump, generating it if the
+ * target has not been reached from the caller's bank yet
+ *
+ * \param filename: name of the file containing the call
+ * \param sect: section containing the call
+ * \param offset: offset of the relocated address in sect
+ * \param target_sect: section containing the target symbol
+ * \param target_addr: address of the target symbol
+ * \param target_name: name of the target symbol
+ * \return address of the trampoline, ALLOC_FAILED if it could not be placed
+ *//*=========================================================================*/
+unsigned far_call(const char* filename, section_entry_t* sect, int offset,
+                  section_entry_t* target_sect, int target_addr,
+                  const char* target_name)
+{
+    far_site_t* site;
+    int caller_bank = caller_bank_of(sect, offset);
+    int target_bank = target_sect->bank_num + 1;
+    unsigned address = find_far_call(sect, offset, target_sect, target_addr);
+
+    site = (far_site_t*)mmalloc(sizeof(far_site_t));
+    site->filename = (char*)mmalloc(strlen(filename) + 1);
+    strcpy(site->filename, filename);
+    site->bank = sect->bank_num + 1;
+    site->address = sect->offset + offset - 1;
+    strncpy(site->target, target_name, sizeof(site->target) - 1);
+    site->target[sizeof(site->target) - 1] = 0;
+    site->target_bank = target_bank;
+    site->trampoline = address != ALLOC_FAILED ? address
+                       : new_trampoline(caller_bank, target_bank,
+                                        target_addr, target_name);
+    site->next = NULL;
+    if (last_site)
+        last_site->next = site;
+    else
+        sites = site;
+    last_site = site;
+
+    return site->trampoline;
+}
+
+/*========================================================================*//**
+ * Get the trampoline already generated for a far call or jump
+ *
+ * \return address of the trampoline, ALLOC_FAILED if there is none
+ *//*=========================================================================*/
+unsigned find_far_call(section_entry_t* sect, int offset,
+                       section_entry_t* target_sect, int target_addr)
+{
+    trampoline_t* t;
+    int caller_bank = caller_bank_of(sect, offset);
+    int target_bank = target_sect->bank_num + 1;
+
+    for (t = trampolines; t; t = t->next)
+    {
+        if (t->caller_bank == caller_bank && t->target_bank == target_bank
+            && t->target_addr == target_addr)
+            return t->address;
+    }
+
+    return ALLOC_FAILED;
+}
+
+/*========================================================================*//**
+ * Declare a trampoline generated by a previous link, whose section and
+ * symbol have been restored
+ *//*=========================================================================*/
+void restore_far_call(int caller_bank, int target_bank, int target_addr,
+                      unsigned address)
+{
+    trampoline_t* t = (trampoline_t*)mmalloc(sizeof(trampoline_t));
+    t->caller_bank = caller_bank;
+    t->target_bank = target_bank;
+    t->target_addr = target_addr;
+    t->address = address;
+    t->next = trampolines;
+    trampolines = t;
+    ++num_sections;
+}
+
+/*========================================================================*//**
+ * Get a trampoline generated during the link
+ *
+ * \param index: index of the trampoline
+ * \return 0 if there is no trampoline with this index
+ *//*=========================================================================*/
+int get_trampoline(int index, int* caller_bank, int* target_bank,
+                   int* target_addr, unsigned* address)
+{
+    trampoline_t* t = trampolines;
+
+    while (t && index--)
+        t = t->next;
+    if (!t)
+        return 0;
+
+    *caller_bank = t->caller_bank;
+    *target_bank = t->target_bank;
+    *target_addr = t->target_addr;
+    *address = t->address;
+    return 1;
+}
+
+/*========================================================================*//**
+ * Print the list of far calls and jumps, with the trampoline each one goes
+ * through
+ *//*=========================================================================*/
+void print_far_calls()
+{
+    far_site_t* site;
+    int count = 0;
+
+    for (site = sites; site; site = site->next)
+        ++count;
+
+    printf("%d far call%s\n", count, count == 1 ? "" : "s");
+    if (!count)
+        return;
+
+    printf("%-20s %4s %7s  %-20s %4s %10s\n", "File", "Bank", "Address",
+           "Target", "Bank", "Trampoline");
+    for (site = sites; site; site = site->next)
+    {
+        printf("%-20s   %02X   $%04X  %-20s   %02X      $%04X\n",
+               site->filename, site->bank, site->address, site->target,
+               site->target_bank, site->trampoline);
+    }
+}
+
+/*========================================================================*//**
+ * Get the bank a trampoline has to map back after a call, -1 for a jump
+ *//*=========================================================================*/
+int caller_bank_of(section_entry_t* sect, int offset)
+{
+    unsigned char opcode = sect->data[offset - 1];
+
+    if ((opcode & 0x07) == 0x04 || opcode == 0xCD)
+        return sect->bank_num + 1;
+    return -1;
+}
+
+/*========================================================================*//**
+ * Write the code mapping a ROM bank: push af, ld a,bank, ld [$2000],a, then
+ * the upper bits if the cartridge needs them, and pop af
+ *
+ * \return number of bytes written
+ *//*=========================================================================*/
+int emit_select(unsigned char* p, int bank)
+{
+    unsigned char* start = p;
+
+    *p++ = 0xF5;
+    *p++ = 0x3E;
+    *p++ = bank & low_mask;
+    *p++ = 0xEA;
+    *p++ = 0x00;
+    *p++ = 0x20;
+    if (high_register)
+    {
+        *p++ = 0x3E;
+        *p++ = (bank >> high_shift) & 0xFF;
+        *p++ = 0xEA;
+        *p++ = high_register & 0xFF;
+        *p++ = (high_register >> 8) & 0xFF;
+    }
+    *p++ = 0xF1;
+
+    return p - start;
+}
+
+/*========================================================================*//**
+ * Generate a trampoline in ROM 0 and add its section and symbol to the ones
+ * of the linked files
+ *//*=========================================================================*/
+unsigned new_trampoline(int caller_bank, int target_bank, int target_addr,
+                        const char* target_name)
+{
+    static const char filename[] = "<far calls>";
+    trampoline_t*    t;
+    section_entry_t* sect;
+    symbol_entry_t*  sym;
+    unsigned char    code[MAX_TRAMPOLINE_SIZE];
+    char             name[64];
+    int              size;
+
+    size = emit_select(code, target_bank);
+    code[size++] = caller_bank < 0 ? 0xC3 : 0xCD;
+    code[size++] = target_addr & 0xFF;
+    code[size++] = (target_addr >> 8) & 0xFF;
+    if (caller_bank >= 0)
+    {
+        size += emit_select(code + size, caller_bank);
+        code[size++] = 0xC9;
+    }
+
+    if (num_sections == 0)
+    {
+        char* fname = (char*)mmalloc(sizeof(filename));
+        strcpy(fname, filename);
+        list_add(&lfiles, file_id, fname, 0);
+    }
+
+    sect = (section_entry_t*)mmalloc(sizeof(section_entry_t));
+    sect->id = num_sections;
+    sect->type = rom;
+    sect->bank_num = 0;
+    sect->align = 0;
+    sect->data_size = size;
+    sect->flags = 0;
+    sect->data = (unsigned char*)mmalloc(size);
+    sect->data_pos = 0;
+    memcpy(sect->data, code, size);
+    sect->offset = allocate(filename, sect);
+    list_add(&lsections, file_id, sect, SECT_TREATED);
+
+    if (caller_bank < 0)
+        sprintf(name, "__far_%.24s", target_name);
+    else
+        sprintf(name, "__far_%.20s_%02X", target_name, caller_bank);
+    sym = (symbol_entry_t*)mmalloc(sizeof(symbol_entry_t));
+    memset(sym, 0, sizeof(symbol_entry_t));
+    sym->sym_id = num_sections;
+    strcpy((char*)sym->id, name);
+    sym->hash = hash_name(name);
+    sym->section_id = num_sections;
+    sym->offset = 0;
+    sym->type = none;
+    list_add(&lsymbols, file_id, sym, file_id);
+
+    ++num_sections;
+
+    t = (trampoline_t*)mmalloc(sizeof(trampoline_t));
+    t->caller_bank = caller_bank;
+    t->target_bank = target_bank;
+    t->target_addr = target_addr;
+    t->address = sect->offset;
+    t->next = trampolines;
+    trampolines = t;
+
+    return t->address;
+}
+
+/**
+ * \} farcall
+ * \} gbld
+ */
@@ -0,0 +1,33 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup farcall
+ * \{
+ */
+
+#ifndef FARCALL_H
+#define FARCALL_H
+
+#include "../common/objfile.h"
+
+void     init_far_calls(int file_id);
+void     free_far_calls();
+int      is_far_call(section_entry_t* sect, section_entry_t* target_sect,
+                     int kind);
+unsigned far_call(const char* filename, section_entry_t* sect, int offset,
+                  section_entry_t* target_sect, int target_addr,
+                  const char* target_name);
+unsigned find_far_call(section_entry_t* sect, int offset,
+                       section_entry_t* target_sect, int target_addr);
+void     restore_far_call(int caller_bank, int target_bank, int target_addr,
+                          unsigned address);
+int      get_trampoline(int index, int* caller_bank, int* target_bank,
+                        int* target_addr, unsigned* address);
+void     print_far_calls();
+
+#endif
+
+/**
+ * \} farcall
+ * \} gbld
+ */
@@ -0,0 +1,339 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup fold Identical section folding
+ * Floating ROM sections with the same contents, the same placement
+ * constraints and relocations to the same places are folded into one copy
+ * before allocation. The sections dropped are not written; once the copy
+ * kept is placed, they take its address, so that the symbols they define
+ * point into it.
+ * \addtogroup fold
+ * \{
+ */
+
+#include "fold.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+
+typedef struct fold_reloc_s
+{
+    int section;        /**< index of the section holding the relocation */
+    int offset;
+    int flags;
+    int target;         /**< index of the section of the symbol, -1 if
+                         * unknown */
+    int target_offset;  /**< offset of the symbol in its section */
+} fold_reloc_t;
+
+typedef struct candidate_s
+{
+    int           section;  /**< index in the sorted sections */
+    unsigned long hash;
+} candidate_t;
+
+static list_t**      sorted_sections = NULL;
+static int           num_sections = 0;
+static list_t**      sorted_symbols = NULL;
+static int           num_symbols = 0;
+static fold_reloc_t* relocs = NULL;
+static int*          first_reloc = NULL;
+static int*          leader = NULL;     /**< section each one is folded into,
+                                         * itself if none */
+static list_t**      folded = NULL;     /**< sections dropped */
+static list_t**      kept = NULL;       /**< section kept for each one */
+static int           num_folded = 0;
+
+static int           compare_reloc(const void* a, const void* b);
+static int           compare_candidate(const void* a, const void* b);
+static int           find_leader(int sect);
+static unsigned long hash_section(int sect);
+static int           same_sections(int a, int b);
+static void          free_tables();
+
+/*========================================================================*//**
+ * Fold the identical floating ROM sections. External symbols must have been
+ * linked.
+ *
+ * \param folded_bytes: receives the size of the sections dropped
+ * \return number of sections dropped
+ *//*=========================================================================*/
+int fold_sections(int* folded_bytes)
+{
+    list_t*      list;
+    candidate_t* candidates;
+    int          num_candidates = 0, num_relocs = 0, changed = 1;
+    int          i, j;
+
+    *folded_bytes = 0;
+    free_folded_sections();
+
+    for (list = lsections; list; list = list->next)
+        ++num_sections;
+    for (list = lsymbols; list; list = list->next)
+        ++num_symbols;
+    for (list = lrelocations; list; list = list->next)
+        ++num_relocs;
+    if (!num_sections)
+        return 0;
+
+    sorted_sections = (list_t**)mmalloc(sizeof(list_t*) * num_sections);
+    sorted_symbols = (list_t**)mmalloc(sizeof(list_t*) * (num_symbols + 1));
+    for (i = 0, list = lsections; list; list = list->next)
+        sorted_sections[i++] = list;
+    for (i = 0, list = lsymbols; list; list = list->next)
+        sorted_symbols[i++] = list;
+    qsort(sorted_sections, num_sections, sizeof(list_t*),
+          &list_compare_section);
+    qsort(sorted_symbols, num_symbols, sizeof(list_t*), &list_compare_symbol);
+
+    /* Relocations grouped by section, in the order of their offsets */
+    relocs = (fold_reloc_t*)mmalloc(sizeof(fold_reloc_t) * (num_relocs + 1));
+    num_relocs = 0;
+    for (list = lrelocations; list; list = list->next)
+    {
+        reloc_entry_t* reloc = (reloc_entry_t*)list->data;
+        fold_reloc_t*  r = relocs + num_relocs;
+        int sym = list_find_symbol(sorted_symbols, num_symbols,
+                                   list->file_id, reloc->sym_id);
+
+        r->section = list_find_section(sorted_sections, num_sections,
+                                       list->file_id, reloc->section_id);
+        if (r->section < 0)
+            continue;
+        r->offset = reloc->offset;
+        r->flags = reloc->flags;
+        r->target = -1;
+        r->target_offset = 0;
+        if (sym >= 0)
+        {
+            list_t* lsym = sorted_symbols[sym];
+            symbol_entry_t* psym = (symbol_entry_t*)lsym->data;
+            /* An external symbol's list flags hold the id of its file */
+            r->target = list_find_section(sorted_sections, num_sections,
+                                          psym->type == _extern
+                                          ? lsym->flags : lsym->file_id,
+                                          psym->section_id);
+            r->target_offset = psym->offset + reloc->addend;
+        }
+        ++num_relocs;
+    }
+    qsort(relocs, num_relocs, sizeof(fold_reloc_t), &compare_reloc);
+
+    first_reloc = (int*)mmalloc(sizeof(int) * (num_sections + 1));
+    for (i = 0, j = 0; i <= num_sections; ++i)
+    {
+        while (j < num_relocs && relocs[j].section < i)
+            ++j;
+        first_reloc[i] = j;
+    }
+
+    leader = (int*)mmalloc(sizeof(int) * num_sections);
+    candidates = (candidate_t*)mmalloc(sizeof(candidate_t) * num_sections);
+    for (i = 0; i < num_sections; ++i)
+    {
+        section_entry_t* sect = (section_entry_t*)sorted_sections[i]->data;
+        leader[i] = i;
+        if (sect->type != rom
+            || (sorted_sections[i]->flags & SECT_DISCARDED))
+            continue;
+        candidates[num_candidates].section = i;
+        candidates[num_candidates++].hash = hash_section(i);
+    }
+    qsort(candidates, num_candidates, sizeof(candidate_t),
+          &compare_candidate);
+
+    /* Folding two sections can make the sections referring to them
+     * identical, so compare again until nothing changes */
+    while (changed)
+    {
+        changed = 0;
+        for (i = 0; i < num_candidates; i = j)
+        {
+            int k;
+            for (j = i + 1; j < num_candidates
+                            && candidates[j].hash == candidates[i].hash; ++j)
+                ;
+            for (k = i; k < j; ++k)
+            {
+                int a = candidates[k].section, l;
+                if (leader[a] != a)
+                    continue;
+                for (l = k + 1; l < j; ++l)
+                {
+                    int b = candidates[l].section;
+                    if (leader[b] == b && same_sections(a, b))
+                    {
+                        leader[b] = a;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    folded = (list_t**)mmalloc(sizeof(list_t*) * num_sections);
+    kept = (list_t**)mmalloc(sizeof(list_t*) * num_sections);
+    for (i = 0; i < num_sections; ++i)
+    {
+        int l = find_leader(i);
+        if (l == i)
+            continue;
+        folded[num_folded] = sorted_sections[i];
+        kept[num_folded++] = sorted_sections[l];
+        sorted_sections[i]->flags |= SECT_FOLDED;
+        sorted_sections[l]->flags |= SECT_SHARED;
+        *folded_bytes +=
+            ((section_entry_t*)sorted_sections[i]->data)->data_size;
+    }
+
+    free(candidates);
+    free_tables();
+
+    return num_folded;
+}
+
+/*========================================================================*//**
+ * Give the sections dropped the address of the copy kept, once it has been
+ * allocated
+ *//*=========================================================================*/
+void place_folded_sections()
+{
+    int i;
+
+    for (i = 0; i < num_folded; ++i)
+    {
+        section_entry_t* sect = (section_entry_t*)folded[i]->data;
+        section_entry_t* copy = (section_entry_t*)kept[i]->data;
+        sect->offset = copy->offset;
+        sect->bank_num = copy->bank_num;
+        folded[i]->flags |= SECT_TREATED;
+    }
+
+    free_folded_sections();
+}
+
+void free_folded_sections()
+{
+    free(folded);
+    free(kept);
+    folded = NULL;
+    kept = NULL;
+    num_folded = 0;
+}
+
+/*========================================================================*//**
+ * Hash the contents of a section and the offsets of its relocations. The
+ * targets of the relocations are compared afterwards, since they change
+ * while folding.
+ *//*=========================================================================*/
+unsigned long hash_section(int sect)
+{
+    section_entry_t* s = (section_entry_t*)sorted_sections[sect]->data;
+    unsigned long hash = hash_data(HASH_INIT, s->data, s->data_size);
+    int i;
+
+    for (i = first_reloc[sect]; i < first_reloc[sect + 1]; ++i)
+    {
+        unsigned char r[3];
+        r[0] = relocs[i].offset & 0xFF;
+        r[1] = relocs[i].offset >> 8;
+        r[2] = relocs[i].flags;
+        hash = hash_data(hash, r, sizeof(r));
+    }
+
+    return hash;
+}
+
+/*========================================================================*//**
+ * Tell whether two sections can be folded: same placement constraints, same
+ * data and relocations to the same offsets of the same (or folded)
+ * sections. A relocation to the section itself matches one to the other
+ * section itself.
+ *//*=========================================================================*/
+int same_sections(int a, int b)
+{
+    section_entry_t* sa = (section_entry_t*)sorted_sections[a]->data;
+    section_entry_t* sb = (section_entry_t*)sorted_sections[b]->data;
+    int i, j;
+
+    if (sa->bank_num != sb->bank_num || sa->align != sb->align
+        || sa->data_size != sb->data_size
+        || first_reloc[a + 1] - first_reloc[a]
+           != first_reloc[b + 1] - first_reloc[b]
+        || memcmp(sa->data, sb->data, sa->data_size) != 0)
+        return 0;
+
+    for (i = first_reloc[a], j = first_reloc[b]; i < first_reloc[a + 1];
+         ++i, ++j)
+    {
+        fold_reloc_t* ra = relocs + i;
+        fold_reloc_t* rb = relocs + j;
+
+        if (ra->offset != rb->offset || ra->flags != rb->flags
+            || ra->target_offset != rb->target_offset
+            || ra->target < 0 || rb->target < 0)
+            return 0;
+        if (ra->target == a && rb->target == b)
+            continue;
+        if (find_leader(ra->target) != find_leader(rb->target))
+            return 0;
+    }
+
+    return 1;
+}
+
+int find_leader(int sect)
+{
+    while (leader[sect] != sect)
+        sect = leader[sect];
+    return sect;
+}
+
+int compare_reloc(const void* a, const void* b)
+{
+    const fold_reloc_t* ra = (const fold_reloc_t*)a;
+    const fold_reloc_t* rb = (const fold_reloc_t*)b;
+
+    if (ra->section != rb->section)
+        return ra->section - rb->section;
+    return ra->offset - rb->offset;
+}
+
+/*========================================================================*//**
+ * Order the candidates by hash, then in the order of the files so that the
+ * first copy is the one kept
+ *//*=========================================================================*/
+int compare_candidate(const void* a, const void* b)
+{
+    const candidate_t* ca = (const candidate_t*)a;
+    const candidate_t* cb = (const candidate_t*)b;
+
+    if (ca->hash != cb->hash)
+        return ca->hash < cb->hash ? -1 : 1;
+    return ca->section - cb->section;
+}
+
+void free_tables()
+{
+    free(sorted_sections);
+    free(sorted_symbols);
+    free(relocs);
+    free(first_reloc);
+    free(leader);
+    sorted_sections = NULL;
+    sorted_symbols = NULL;
+    relocs = NULL;
+    first_reloc = NULL;
+    leader = NULL;
+    num_sections = 0;
+    num_symbols = 0;
+}
+
+/**
+ * \} fold
+ * \} gbld
+ */
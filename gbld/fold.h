@@ -0,0 +1,22 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup fold
+ * \{
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "lists.h"
+
+int  fold_sections(int* folded_bytes);
+void place_folded_sections();
+void free_folded_sections();
+
+#endif
+
+/**
+ * \} fold
+ * \} gbld
+ */
@@ -0,0 +1,202 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup gc Section garbage collection
+ * Sections which cannot be reached from a root section through the
+ * relocations are discarded before allocation. The roots are the .org
+ * sections (reset and interrupt vectors, header, entry point...), which gbas
+ * does not relocate, and the sections defining the symbols to keep.
+ * \addtogroup gc
+ * \{
+ */
+
+#include "gc.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+
+static list_t** sorted_sections = NULL;
+static int      num_sections = 0;
+static list_t** sorted_symbols = NULL;
+static int      num_symbols = 0;
+
+static int  is_kept(const char* name, const char* keep);
+
+/*========================================================================*//**
+ * Discard the sections which are not reachable from the roots. External
+ * symbols must have been linked.
+ *
+ * \param keep: comma separated list of global symbols whose sections are
+ * roots, or NULL
+ * \param discarded_bytes: receives the size of the discarded sections
+ * \return number of sections discarded
+ *//*=========================================================================*/
+int collect_sections(const char* keep, int* discarded_bytes)
+{
+    list_t*  list;
+    int*     first_edge;    /**< index of the first edge of each section */
+    int*     edges;
+    int*     fill;
+    int*     stack;
+    char*    reached;
+    int      num_edges = 0, sp = 0, count = 0;
+    int      i;
+
+    *discarded_bytes = 0;
+
+    for (list = lsections; list; list = list->next)
+        ++num_sections;
+    for (list = lsymbols; list; list = list->next)
+        ++num_symbols;
+    if (!num_sections)
+        return 0;
+
+    sorted_sections = (list_t**)mmalloc(sizeof(list_t*) * num_sections);
+    sorted_symbols = (list_t**)mmalloc(sizeof(list_t*) * (num_symbols + 1));
+    for (i = 0, list = lsections; list; list = list->next)
+        sorted_sections[i++] = list;
+    for (i = 0, list = lsymbols; list; list = list->next)
+        sorted_symbols[i++] = list;
+    qsort(sorted_sections, num_sections, sizeof(list_t*),
+          &list_compare_section);
+    qsort(sorted_symbols, num_symbols, sizeof(list_t*), &list_compare_symbol);
+
+    /* Edges from the sections holding relocations to the sections of their
+     * symbols, grouped by source section */
+    first_edge = (int*)mmalloc(sizeof(int) * (num_sections + 1));
+    memset(first_edge, 0, sizeof(int) * (num_sections + 1));
+    for (list = lrelocations; list; list = list->next)
+    {
+        reloc_entry_t* reloc = (reloc_entry_t*)list->data;
+        int src = list_find_section(sorted_sections, num_sections,
+                                    list->file_id, reloc->section_id);
+        if (src >= 0)
+            ++first_edge[src + 1];
+        ++num_edges;
+    }
+    for (i = 0; i < num_sections; ++i)
+        first_edge[i + 1] += first_edge[i];
+
+    edges = (int*)mmalloc(sizeof(int) * (num_edges + 1));
+    fill = (int*)mmalloc(sizeof(int) * (num_sections + 1));
+    memset(fill, 0, sizeof(int) * (num_sections + 1));
+    for (list = lrelocations; list; list = list->next)
+    {
+        reloc_entry_t*  reloc = (reloc_entry_t*)list->data;
+        int src = list_find_section(sorted_sections, num_sections,
+                                    list->file_id, reloc->section_id);
+        int sym = list_find_symbol(sorted_symbols, num_symbols,
+                                   list->file_id, reloc->sym_id);
+        int dst = -1;
+
+        if (src < 0)
+            continue;
+        if (sym >= 0)
+        {
+            list_t* lsym = sorted_symbols[sym];
+            symbol_entry_t* psym = (symbol_entry_t*)lsym->data;
+            /* An external symbol's list flags hold the id of its file */
+            dst = list_find_section(sorted_sections, num_sections,
+                                    psym->type == _extern ? lsym->flags
+                                                          : lsym->file_id,
+                                    psym->section_id);
+        }
+        edges[first_edge[src] + fill[src]++] = dst;
+    }
+
+    free(fill);
+
+    /* Roots */
+    stack = (int*)mmalloc(sizeof(int) * num_sections);
+    reached = (char*)mmalloc(num_sections);
+    memset(reached, 0, num_sections);
+    for (i = 0; i < num_sections; ++i)
+    {
+        if (((section_entry_t*)sorted_sections[i]->data)->type == org)
+        {
+            reached[i] = 1;
+            stack[sp++] = i;
+        }
+    }
+    for (i = 0; keep && i < num_symbols; ++i)
+    {
+        symbol_entry_t* psym = (symbol_entry_t*)sorted_symbols[i]->data;
+        int sect;
+
+        if (psym->type != _global || !is_kept((char*)psym->id, keep))
+            continue;
+        sect = list_find_section(sorted_sections, num_sections,
+                                 sorted_symbols[i]->file_id,
+                                 psym->section_id);
+        if (sect >= 0 && !reached[sect])
+        {
+            reached[sect] = 1;
+            stack[sp++] = sect;
+        }
+    }
+
+    /* Depth first walk of the relocations */
+    while (sp)
+    {
+        int sect = stack[--sp];
+        for (i = first_edge[sect]; i < first_edge[sect + 1]; ++i)
+        {
+            if (edges[i] >= 0 && !reached[edges[i]])
+            {
+                reached[edges[i]] = 1;
+                stack[sp++] = edges[i];
+            }
+        }
+    }
+
+    for (i = 0; i < num_sections; ++i)
+    {
+        if (reached[i])
+            continue;
+        sorted_sections[i]->flags |= SECT_DISCARDED;
+        *discarded_bytes +=
+            ((section_entry_t*)sorted_sections[i]->data)->data_size;
+        ++count;
+    }
+
+    free(reached);
+    free(stack);
+    free(edges);
+    free(first_edge);
+    free(sorted_sections);
+    free(sorted_symbols);
+    sorted_sections = NULL;
+    sorted_symbols = NULL;
+    num_sections = 0;
+    num_symbols = 0;
+
+    return count;
+}
+
+/*========================================================================*//**
+ * Tell whether a symbol name is part of a comma separated list
+ *//*=========================================================================*/
+int is_kept(const char* name, const char* keep)
+{
+    size_t len = strlen(name);
+
+    while (*keep)
+    {
+        const char* end = strchr(keep, ',');
+        if (!end)
+            end = keep + strlen(keep);
+        if ((size_t)(end - keep) == len && strncmp(name, keep, len) == 0)
+            return 1;
+        keep = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+/**
+ * \} gc
+ * \} gbld
+ */
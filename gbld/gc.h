@@ -0,0 +1,20 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup gc
+ * \{
+ */
+
+#ifndef GC_H
+#define GC_H
+
+#include "lists.h"
+
+int collect_sections(const char* keep, int* discarded_bytes);
+
+#endif
+
+/**
+ * \} gc
+ * \} gbld
+ */
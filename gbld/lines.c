@@ -0,0 +1,235 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup lines Line table
+ * With -g, the source line tables of the objects (written by gbas -g) are
+ * merged into a file next to the ROM, with the extension .lines, so that a
+ * profiler or a debugger can charge the addresses it samples to source
+ * lines. The file lists the source files, then the address of the first
+ * byte of each line, sorted by bank and address:
+ *
+ *     [files]
+ *     0 hello.s
+ *     [lines]
+ *     00:0150 0 12
+ *
+ * The lines of the sections discarded, folded or compressed are left out.
+ * \addtogroup lines
+ * \{
+ */
+
+#include "lines.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+#include "../common/objfile.h"
+#include "../common/gbmmap.h"
+#include "lists.h"
+
+#define MAX_FILE_NAME   256
+
+typedef struct line_s
+{
+    int file_id;    /**< object file */
+    int section_id;
+    int offset;     /**< in the section, then address once relocated */
+    int bank;       /**< once relocated */
+    int name;       /**< index of the source file in names */
+    int line;
+} line_t;
+
+static line_t* table = NULL;
+static int     num_lines = 0;
+static char**  names = NULL;
+static int     num_names = 0;
+
+static int find_name(const char* name);
+static int compare_section(const void* a, const void* b);
+static int compare_address(const void* a, const void* b);
+
+/*========================================================================*//**
+ * Read the lines block of the object file being read, if it has one
+ *
+ * \param file_id: id of the object file
+ *//*=========================================================================*/
+void read_lines(int file_id)
+{
+    block_header_t* header = find_block(lines);
+    char name[MAX_FILE_NAME];
+    int last_file = -1, last_name = 0;
+    int i;
+
+    if (!header)
+        return;
+
+    table = (line_t*)mrealloc(table, sizeof(line_t)
+                                     * (num_lines + header->num_entries + 1));
+    for (i = 0; i < header->num_entries; ++i)
+    {
+        line_entry_t* entry = read_line_entry();
+        line_t* l = table + num_lines++;
+
+        /* The lines of an object mostly come from the same file */
+        if (entry->file != last_file)
+        {
+            read_line_file(entry->file, name, sizeof(name));
+            last_file = entry->file;
+            last_name = find_name(name);
+        }
+        l->file_id = file_id;
+        l->section_id = entry->section_id;
+        l->offset = entry->offset;
+        l->bank = 0;
+        l->name = last_name;
+        l->line = entry->line;
+        free(entry);
+    }
+    free(header);
+}
+
+/*========================================================================*//**
+ * Read the lines block of an object file whose other blocks are restored
+ * from the link state
+ *
+ * \param file_id: id of the object file
+ * \param name: name of the object file
+ *//*=========================================================================*/
+void load_lines(int file_id, const char* name)
+{
+    FILE* file;
+    long size;
+
+    if (!(file = fopen(name, "rb")))
+    {
+        ccerr(F, "unable to open \"%s\"", name);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    set_infile(file);
+    read_obj_header(size);
+    read_lines(file_id);
+    fclose(file);
+}
+
+/*========================================================================*//**
+ * Relocate the lines read and write them, sorted by address
+ *
+ * \param name: name of the file to write
+ *//*=========================================================================*/
+void write_lines(const char* name)
+{
+    FILE* file;
+    section_entry_t* sect = NULL;
+    int i, n = 0;
+
+    /* Relocate the lines section by section */
+    qsort(table, num_lines, sizeof(line_t), &compare_section);
+    for (i = 0; i < num_lines; ++i)
+    {
+        line_t* l = table + i;
+
+        if (i == 0 || l->file_id != l[-1].file_id
+            || l->section_id != l[-1].section_id)
+        {
+            list_t* lsect = get_section_node(l->file_id, l->section_id);
+            sect = NULL;
+            if (lsect && !(lsect->flags & (SECT_DISCARDED | SECT_FOLDED
+                                           | SECT_COMPRESSED)))
+                sect = (section_entry_t*)lsect->data;
+        }
+        if (!sect || l->offset >= sect->data_size)
+            continue;
+
+        table[n] = *l;
+        table[n].offset = sect->offset + l->offset;
+        if (get_space(sect->offset) == rom_n)
+            table[n].bank = sect->bank_num + 1;
+        else
+            table[n].bank = sect->bank_num;
+        ++n;
+    }
+    num_lines = n;
+    qsort(table, num_lines, sizeof(line_t), &compare_address);
+
+    if (!(file = fopen(name, "w")))
+    {
+        ccerr(E, "unable to open \"%s\"", name);
+        return;
+    }
+    fprintf(file, "[files]\n");
+    for (i = 0; i < num_names; ++i)
+        fprintf(file, "%d %s\n", i, names[i]);
+    fprintf(file, "[lines]\n");
+    for (i = 0; i < num_lines; ++i)
+        fprintf(file, "%02X:%04X %d %d\n", table[i].bank, table[i].offset,
+                table[i].name, table[i].line);
+    fclose(file);
+}
+
+void free_lines()
+{
+    int i;
+
+    for (i = 0; i < num_names; ++i)
+        free(names[i]);
+    free(names);
+    free(table);
+    names = NULL;
+    num_names = 0;
+    table = NULL;
+    num_lines = 0;
+}
+
+/*========================================================================*//**
+ * Index of a source file name, added if it is new
+ *//*=========================================================================*/
+int find_name(const char* name)
+{
+    int i;
+
+    for (i = 0; i < num_names; ++i)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    names = (char**)mrealloc(names, sizeof(char*) * (num_names + 1));
+    names[num_names] = (char*)mmalloc(strlen(name) + 1);
+    strcpy(names[num_names], name);
+    return num_names++;
+}
+
+int compare_section(const void* a, const void* b)
+{
+    const line_t* la = (const line_t*)a;
+    const line_t* lb = (const line_t*)b;
+
+    if (la->file_id != lb->file_id)
+        return la->file_id < lb->file_id ? -1 : 1;
+    if (la->section_id != lb->section_id)
+        return la->section_id < lb->section_id ? -1 : 1;
+    if (la->offset != lb->offset)
+        return la->offset < lb->offset ? -1 : 1;
+    return 0;
+}
+
+int compare_address(const void* a, const void* b)
+{
+    const line_t* la = (const line_t*)a;
+    const line_t* lb = (const line_t*)b;
+
+    if (la->bank != lb->bank)
+        return la->bank < lb->bank ? -1 : 1;
+    if (la->offset != lb->offset)
+        return la->offset < lb->offset ? -1 : 1;
+    return la->line - lb->line;
+}
+
+/**
+ * \} lines
+ * \} gbld
+ */
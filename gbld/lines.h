@@ -0,0 +1,21 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup lines
+ * \{
+ */
+
+#ifndef LINES_H
+#define LINES_H
+
+void read_lines(int file_id);
+void load_lines(int file_id, const char* name);
+void write_lines(const char* name);
+void free_lines();
+
+#endif
+
+/**
+ * \} lines
+ * \} gbld
+ */
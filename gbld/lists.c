@@ -59,6 +59,85 @@ list_t* list_at(list_t* list, unsigned index)
     return elem;
 }
 
+/*========================================================================*//**
+ * Order the sections by file, then by id in their file
+ *//*=========================================================================*/
+int list_compare_section(const void* a, const void* b)
+{
+    const list_t* la = *(list_t**)a;
+    const list_t* lb = *(list_t**)b;
+
+    if (la->file_id != lb->file_id)
+        return la->file_id - lb->file_id;
+    return ((section_entry_t*)la->data)->id - ((section_entry_t*)lb->data)->id;
+}
+
+/*========================================================================*//**
+ * Order the symbols by file, then by id in their file
+ *//*=========================================================================*/
+int list_compare_symbol(const void* a, const void* b)
+{
+    const list_t* la = *(list_t**)a;
+    const list_t* lb = *(list_t**)b;
+
+    if (la->file_id != lb->file_id)
+        return la->file_id - lb->file_id;
+    return ((symbol_entry_t*)la->data)->sym_id
+           - ((symbol_entry_t*)lb->data)->sym_id;
+}
+
+/*========================================================================*//**
+ * Binary search of a section in sections sorted by list_compare_section()
+ *
+ * \return index of the section, -1 if it does not exist
+ *//*=========================================================================*/
+int list_find_section(list_t** sorted, int count, int file_id, int sect_id)
+{
+    int lo = 0, hi = count - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const list_t* l = sorted[mid];
+        int id = ((section_entry_t*)l->data)->id;
+
+        if (l->file_id == file_id && id == sect_id)
+            return mid;
+        if (l->file_id < file_id || (l->file_id == file_id && id < sect_id))
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+/*========================================================================*//**
+ * Binary search of a symbol in symbols sorted by list_compare_symbol()
+ *
+ * \return index of the symbol, -1 if it does not exist
+ *//*=========================================================================*/
+int list_find_symbol(list_t** sorted, int count, int file_id, int sym_id)
+{
+    int lo = 0, hi = count - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const list_t* l = sorted[mid];
+        int id = ((symbol_entry_t*)l->data)->sym_id;
+
+        if (l->file_id == file_id && id == sym_id)
+            return mid;
+        if (l->file_id < file_id || (l->file_id == file_id && id < sym_id))
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
 /**
  * \} lists
  * \} gbld
@@ -5,9 +5,20 @@
  * \{
  */
 
+#ifndef LISTS_H
+#define LISTS_H
+
 #include "../common/objfile.h"
 
 #define SECT_TREATED    1   /**< Section treated flag */
+#define SECT_DISCARDED  2   /**< Section discarded by --gc-sections */
+#define SECT_FOLDED     4   /**< Section folded into an identical one by
+                             * --fold-sections */
+#define SECT_SHARED     8   /**< Section identical sections are folded into */
+#define SECT_CONSTANTS  16  /**< Empty section holding the constants defined
+                             * by the linker, never allocated */
+#define SECT_COMPRESSED 32  /**< Section stored compressed, whose data no
+                             * longer matches its source lines */
 #define RELOC_TREATED   1   /**< Relocation treated flag */
 
 typedef struct list_s
@@ -34,6 +45,19 @@ void    list_add(list_t** list, int file_id, void* data, int flags);
 void    list_free(list_t* list);
 list_t* list_at(list_t* list, unsigned index);
 
+/* Arrays of sections and symbols sorted for binary search */
+int     list_compare_section(const void* a, const void* b);
+int     list_compare_symbol(const void* a, const void* b);
+int     list_find_section(list_t** sorted, int count, int file_id,
+                          int sect_id);
+int     list_find_symbol(list_t** sorted, int count, int file_id, int sym_id);
+
+/* Defined in main.c */
+section_entry_t* get_section(int file_id, unsigned sect_id);
+list_t*          get_section_node(int file_id, unsigned sect_id);
+
+#endif
+
 /**
  * \} lists
  * \} gbld
@@ -13,32 +13,59 @@
 #include "../common/options.h"
 #include "../common/utils.h"
 #include "../common/objfile.h"
+#include "../common/timing.h"
 #include "../common/gbmmap.h"
 #include "version.h"
 #include "map.h"
 #include "rom.h"
 #include "lists.h"
+#include "farcall.h"
+#include "gc.h"
+#include "state.h"
+#include "archive.h"
+#include "fold.h"
+#include "profile.h"
+#include "compress.h"
+#include "lines.h"
 
 const char* const pgm = "gbld";
 
 static FILE*  infile = NULL;
+static int    lazy_data = 0;        /**< Section data is read once the unused
+                                     * sections are discarded */
+static char** input_paths = NULL;   /**< File holding each object, by id, for
+                                     * the data read lazily */
+static int    num_input_paths = 0;
 
 void help();
 void             version();
 void             on_fatal_error(int from_program);
-section_entry_t* get_section(int file_id, unsigned sect_id);
 void             write_section(section_entry_t* sect);
+void             load_inputs(const char* state_name, int patching);
+void             load_object(int file_id, const char* name);
+void             read_object(int file_id, const char* name,
+                             const char* path, long end);
+void             load_section_data();
+int              load_archive_members(int file_id);
+int              is_defined(const char* name);
+int              has_archives();
+void             reset_link();
+char*            get_debug_name(const char* output_name, const char* ext);
+int              outputs_exist(const char* sym_name, const char* lines_name);
+void             check_duplicate_symbols();
+void             link_extern_symbols();
+int              is_constants_section(int file_id, int sect_id);
 
 int main(int argc, char** argv)
 {
-    int i, file_id = 0;
-    unsigned numsect = 0, numsyms = 0, numrelocs = 0;
     list_t* list;
-    sourcefile_t* file = NULL;
     char* output_name = NULL;
+    char* sym_name = NULL;
+    char* lines_name = NULL;
+    char* state_name = NULL;
     FILE* outfile = NULL;
-    list_t* psyms1, * psyms2;
     int gen_debug = 0;
+    int patching = 0;
 
 
     esetprogram(pgm);
@@ -49,216 +76,142 @@ int main(int argc, char** argv)
     if (errors())
         return EXIT_FAILURE;
 
+    /* Check the ROMs given instead of linking */
+    if (get_option("--verify")->set)
+    {
+        sourcefile_t* file;
+
+        file_first();
+        while ((file = file_next()))
+            verify_rom(file->name);
+        return errors() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     output_name = (char*)mmalloc(strlen(get_option("-o")->value.str) + 1);
     strcpy(output_name, get_option("-o")->value.str);
+    sym_name = get_debug_name(output_name, ".sym");
+    lines_name = get_debug_name(output_name, ".lines");
 
     gen_debug = get_option("-g")->set;
+    if (get_option("--incremental")->set)
+        state_name = get_option("--incremental")->value.str;
 
     init_rom();
-
-    file_first();
-    while ((file = file_next()))
+    init_map();
+
+    /* The members taken from archives depend on the undefined symbols of
+     * all the files, the previous ROM is only patched without archives */
+    if (state_name && !has_archives())
+        patching = load_state(state_name, file_count())
+                   && load_rom(output_name) && check_state_rom();
+
+    /* Nothing to link if no input changed since the previous link */
+    if (patching && inputs_unchanged()
+        && outputs_exist(gen_debug ? sym_name : NULL,
+                         gen_debug ? lines_name : NULL))
     {
-        size_t fsize;
-        char* filename;
-        esetfile(file->name);
-        if (! (infile = fopen(file->name, "rb")))
-        {
-            ccerr(F, "unable to open \"%s\"", file->name);
-            continue;
-        }
-
-        fseek(infile, 0, SEEK_END);
-        fsize = ftell(infile);
-        fseek(infile, 0, SEEK_SET);
-
-        set_infile(infile);
-        read_obj_header();
-
-        filename = (char*)mmalloc(strlen(file->name) + 1);
-        strcpy(filename, file->name);
-        list_add(&lfiles, file_id, filename, 0);
-
-        while (ftell(infile) < fsize)
-        {
-            block_header_t* header= read_block_header();
-            init_map();
-
-            if (header->type == sections)
-            {
-                section_entry_t* sect;
-#ifndef NDEBUG
-                printf("New sections block with %d entries\n", header->num_entries);
-#endif
-                for (i = 0; i < header->num_entries; ++i)
-                {
-                    unsigned k;
-                    sect = read_section_entry();
-                    list_add(&lsections, file_id, sect, 0);
-                    ++numsect;
-#ifndef NDEBUG
-                    printf("  * Section %d\n", sect->id);
-                    printf("    - Type:      %s\n", sect->type == org ? ".org" : "");
-                    printf("    - Offset:    %04x\n", sect->offset);
-                    printf("    - Bank:      %d\n", sect->bank_num);
-                    printf("    - Data size: %d\n", sect->data_size);
-                    for (k = 0; k < sect->data_size; ++k)
-                    {
-                        if (k && (k % 16) == 0)
-                            printf("\n");
-                        else if (k && (k % 8) == 0)
-                            printf(" ");
-                        printf("%02X ", sect->data[k]);
-
-                    }
-                    printf("\n");
-#endif
-                }
-            }
-            else if (header->type == symbols)
-            {
-                symbol_entry_t* sym;
-#ifndef NDEBUG
-                printf("New symbols block with %d entries\n", header->num_entries);
-#endif
-                for (i = 0; i < header->num_entries; ++i)
-                {
-                    sym = read_symbol_entry();
-                    list_add(&lsymbols, file_id, sym, file_id);
-                    ++numsyms;
-#ifndef NDEBUG
-                    printf("  * Symbol %d\n", sym->sym_id);
-                    printf("    - ID:         %s\n", sym->id);
-                    printf("    - In section: %d\n", sym->section_id);
-                    printf("    - Offset:     %d\n", sym->offset);
-                    printf("    - Type:       %c\n", ".GE"[sym->type]);
-                    printf("\n");
-#endif
-                }
-            }
-            else if (header->type == relocations)
-            {
-                reloc_entry_t* reloc;
-#ifndef NDEBUG
-                printf("New relocations block with %d entries\n", header->num_entries);
-#endif
-                for (i = 0; i < header->num_entries; ++i)
-                {
-                    reloc = read_reloc_entry();
-                    ++numrelocs;
-                    list_add(&lrelocations, file_id, reloc, 0);
-#ifndef NDEBUG
-                    printf("  * Relocation\n");
-                    printf("    - Symbol: %d\n", reloc->sym_id);
-                    printf("    - Section: %d\n", reloc->section_id);
-                    printf("    - Offset: %d\n", reloc->offset);
-#endif
-                }
-            }
-        }
-
-        fclose(infile);
-        ++file_id;
+        printf("%s is up to date\n", output_name);
+        free_rom();
+        free_map();
+        free_state();
+        free(output_name);
+        free(sym_name);
+        free(lines_name);
+        return EXIT_SUCCESS;
     }
 
-    /* Search for duplicate global symbols */
-    psyms1 = lsymbols;
-    while (psyms1)
+    while (1)
     {
-        psyms2 = psyms1->next;
-        while (psyms2)
-        {
-            if (psyms1->file_id == psyms2->file_id)
-            {
-                psyms2 = psyms2->next;
-                continue;
-            }
-            if (((symbol_entry_t*)(psyms1->data))->type != _global
-                || ((symbol_entry_t*)(psyms2->data))->type != _global)
-            {
-                psyms2 = psyms2->next;
-                continue;
-            }
-            if (strcmp((const char*)((symbol_entry_t*)(psyms1->data))->id,
-                       (const char*)((symbol_entry_t*)(psyms2->data))->id)
-                == 0)
-            {
-                ccerr(E, "duplicate symbol '%s'",
-                    ((symbol_entry_t*)(psyms2->data))->id);
-            }
-
-            psyms2 = psyms2->next;
-        }
-        psyms1 = psyms1->next;
+        timing_start("object load");
+        lazy_data = get_option("--gc-sections")->set && !patching;
+        load_inputs(state_name, patching);
+        timing_start("symbol resolution");
+        check_duplicate_symbols();
+        link_extern_symbols();
+
+        /* Patch the previous ROM if the layout did not change, otherwise
+         * link everything again */
+        if (!patching || errors() || validate_patch())
+            break;
+        reset_link();
+        patching = 0;
     }
 
-    /* .org allocation */
-    list = lsections;
-    while (list)
+    if (patching)
     {
-        list_t* sfile = list_at(lfiles, list->file_id);
-        section_entry_t* sect = (section_entry_t*)list->data;
-        esetfile(sfile->data);
-
-        if (sect->type != org)
-        {
-            list = list->next;
-            continue;
-        }
-
-        sect->offset = allocate(sfile->data, sect);
-        list->flags = SECT_TREATED;
-
-        list = list->next;
+        timing_start("allocation");
+        allocate_preserved();
     }
-
-    TODO("rom/ram/wram/vram + offset");
-    TODO("rom/ram/wram/vram");
-
-    /* link extern symbols */
-    list = lsymbols;
-    while(list)
+    else
     {
-        list_t* sfile = list_at(lfiles, list->file_id);
-        symbol_entry_t* sym = (symbol_entry_t*)(list->data);
-        list_t* tsyms = lsymbols; /* target symbols list */
-        symbol_entry_t* tsym;     /* target symbol */
+        /* Discard the sections which are never referenced */
+        if (get_option("--gc-sections")->set && !errors())
+        {
+            int bytes, count;
+            timing_start("garbage collection");
+            count = collect_sections(get_option("--keep=")->value.str, &bytes);
+            if (count)
+                printf("Discarded %d unused section%s, %d bytes reclaimed\n",
+                       count, count == 1 ? "" : "s", bytes);
+        }
+        if (lazy_data)
+        {
+            timing_start("object load");
+            load_section_data();
+        }
 
-        if (sym->type != _extern)
+        /* Keep a single copy of identical sections */
+        if (get_option("--fold-sections")->set && !errors())
         {
-            list = list->next;
-            continue;
+            int bytes, count;
+            timing_start("section folding");
+            count = fold_sections(&bytes);
+            if (count)
+                printf("Folded %d identical section%s, %d bytes reclaimed\n",
+                       count, count == 1 ? "" : "s", bytes);
         }
 
-        esetfile((char*)sfile->data);
-        while (tsyms)
+        /* .org allocation */
+        timing_start("allocation");
+        list = lsections;
+        while (list)
         {
-            tsym = (symbol_entry_t*)(tsyms->data);
-            if (list->file_id == tsyms->file_id || tsym->type != _global)
+            list_t* sfile = list_at(lfiles, list->file_id);
+            section_entry_t* sect = (section_entry_t*)list->data;
+            esetfile(sfile->data);
+
+            if (sect->type != org
+                || (list->flags & (SECT_DISCARDED | SECT_CONSTANTS)))
             {
-                tsyms = tsyms->next;
+                list = list->next;
                 continue;
             }
 
-            if (strcmp((char*)sym->id, (char*)tsym->id) == 0)
-                break;
+            sect->offset = allocate(sfile->data, sect);
+            list->flags = SECT_TREATED;
 
-            tsyms = tsyms->next;
+            list = list->next;
         }
 
-        if (tsyms == NULL)
-            err(E, "symbol '%s' unsolved", sym->id);
-        else
-        {
-            list->flags = tsyms->file_id; /* flag = target file id */
-            sym->section_id = tsym->section_id;
-            sym->offset = tsym->offset;
-        }
+        /* Place the sections called the most first, after the profile of
+         * the previous ROM */
+        if (get_option("--profile=")->set && !errors()
+            && load_profile(get_option("--profile=")->value.str, sym_name))
+            allocate_profiled(lsections, lfiles);
 
-        list = list->next;
+        /* Floating ROM sections allocation */
+        allocate_floating(lsections, lfiles, 0);
+        place_folded_sections();
+
+        if (get_option("--profile=")->set && !errors())
+            print_bank_switches();
     }
 
+    TODO("ram/wram/vram + offset");
+    TODO("ram/wram/vram");
+
     /* relocs */
+    timing_start("relocation");
     list = lrelocations;
     while (list)
     {
@@ -272,6 +225,14 @@ int main(int argc, char** argv)
 
         esetfile((char*)lfile->data);
 
+        /* Folded sections are not written, their copy is relocated */
+        if (get_section_node(list->file_id, reloc->section_id)->flags
+            & (SECT_DISCARDED | SECT_FOLDED))
+        {
+            list = list->next;
+            continue;
+        }
+
         /* search for target symbol among symbols created in the same file */
         while (target_syms)
         {
@@ -296,40 +257,101 @@ int main(int argc, char** argv)
             symbol_sect = get_section(target_syms->file_id, target_sym->section_id);
 
 
-        target_addr = symbol_sect->offset + target_sym->offset;
-        if (reloc->flags == relative)
+        target_addr = symbol_sect->offset + target_sym->offset + reloc->addend;
+        switch (reloc->flags)
+        {
+        case relative:
         {
             int jr = target_addr - (reloc_sect->offset + reloc->offset + 1);
             reloc_sect->data[reloc->offset] = jr;
-            if (jr > 128 || jr < -127)
+            /* Two switchable banks are never mapped at the same time */
+            if (get_space(reloc_sect->offset) == rom_n
+                && get_space(symbol_sect->offset) == rom_n
+                && reloc_sect->bank_num != symbol_sect->bank_num)
+                err(E, "relative jump to '%s' in another ROM bank",
+                    target_sym->id);
+            else if (jr > 127 || jr < -128)
                 err(E, "relative jump to '%s' out of reach", target_sym->id);
+            break;
         }
-        else
-        {
+        case absolute:
+        case call_address:
+            /* Calls and jumps to another switchable bank go through a
+             * trampoline in ROM 0 */
+            if (is_far_call(reloc_sect, symbol_sect, reloc->flags))
+            {
+                if (reloc->addend != 0)
+                    err(E, "far call to '%s' with an offset",
+                        target_sym->id);
+                else
+                    target_addr = far_call((char*)lfile->data, reloc_sect,
+                                           reloc->offset, symbol_sect,
+                                           target_addr,
+                                           (char*)target_sym->id);
+            }
             reloc_sect->data[reloc->offset] = target_addr & 0xFF;
             reloc_sect->data[reloc->offset + 1] = (target_addr >> 8) & 0xFF;
+            break;
+        case low_byte:
+            reloc_sect->data[reloc->offset] = target_addr & 0xFF;
+            break;
+        case high_byte:
+            reloc_sect->data[reloc->offset] = (target_addr >> 8) & 0xFF;
+            break;
+        case bank_byte:
+            if (get_space(symbol_sect->offset) == rom_n)
+                reloc_sect->data[reloc->offset] = symbol_sect->bank_num + 1;
+            else
+                reloc_sect->data[reloc->offset] = symbol_sect->bank_num;
+            break;
+        case hram_byte:
+            if (target_addr < 0xFF00 || target_addr > 0xFFFF)
+                err(E, "'%s' is not in high RAM", target_sym->id);
+            reloc_sect->data[reloc->offset] = target_addr & 0xFF;
+            break;
         }
 
         list = list->next;
     }
 
-    /* Write sections to rom banks */
+    if (state_name && !errors())
+        capture_links();
+
+    if (get_option("--print-memory-usage")->set && !errors())
+        print_memory_usage();
+
+    if (get_option("--print-far-calls")->set && !errors())
+        print_far_calls();
+
+    /* Write sections straight into the output file */
+    timing_start("ROM write");
+    if (!errors())
+        open_rom(output_name);
     list = lsections;
     while (list && !errors())
     {
-        write_section((section_entry_t*)(list->data));
+        if (list->flags & (SECT_DISCARDED | SECT_FOLDED))
+        {
+            free(((section_entry_t*)list->data)->data);
+            ((section_entry_t*)list->data)->data = NULL;
+        }
+        else
+            write_section((section_entry_t*)(list->data));
         list = list->next;
     }
 
     if (!errors())
     {
-        if ( ! (outfile = fopen(output_name, "wb")) )
-            ccerr(F, "unable to open \"%s\"", output_name);
-
         fix_rom();
-        for (i = 0; i < get_num_rom_banks(); ++i)
-            fwrite(get_rom_bank(i), ROM_BANK_SIZE, 1, outfile);
-        fclose(outfile);
+        if (state_name)
+            save_state(state_name);
+        close_rom();
+
+        timing_start("map and symbol files");
+        if (get_option("-Map=")->set)
+            write_map(get_option("-Map=")->value.str, output_name, 0);
+        if (get_option("--map-json=")->set)
+            write_map(get_option("--map-json=")->value.str, output_name, 1);
     }
 
     /* Write sym file */
@@ -338,31 +360,18 @@ int main(int argc, char** argv)
         symbol_entry_t* syms;
         section_entry_t* sect;
         int bank_num;
-        char* p = output_name;
-
-        while (*p)
-            ++p;
-        while (*p != '.' && p != output_name)
-            --p;
-        if (*p == '.')
-            *p = 0;
-        output_name = (char*)mrealloc(output_name, strlen(output_name) + 4);
-        p = output_name;
-        while (*p != 0)
-            ++p;
-        *p++ = '.';
-        *p++ = 's';
-        *p++ = 'y';
-        *p++ = 'm';
+
         list = lsymbols;
 
-        if ( ! (outfile = fopen(output_name, "w")) )
-            ccerr(F, "unable to open \"%s\"", output_name);
+        if ( ! (outfile = fopen(sym_name, "w")) )
+            ccerr(F, "unable to open \"%s\"", sym_name);
 
         while (list && !errors())
         {
             syms = (symbol_entry_t*)(list->data);
-            if (syms->type != _extern)
+            if (syms->type != _extern
+                && !(get_section_node(list->file_id, syms->section_id)->flags
+                     & SECT_DISCARDED))
             {
                 sect = get_section(list->file_id, syms->section_id);
                 if (get_space(sect->offset) == rom_n)
@@ -378,14 +387,516 @@ int main(int argc, char** argv)
         fclose(outfile);
     }
 
+    /* Write line table */
+    if (!errors() && gen_debug)
+        write_lines(lines_name);
+
+    if (get_option("-ftime-report")->set)
+        timing_report(pgm);
+
     free_rom();
     free_map();
+    free_far_calls();
+    free_archives();
+    free_folded_sections();
+    free_profile();
+    free_state();
+    free_lines();
     list_free(lfiles);
     list_free(lsections);
     list_free(lsymbols);
     list_free(lrelocations);
+    free(output_name);
+    free(sym_name);
+    free(lines_name);
 
-    return EXIT_SUCCESS;
+    return errors() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*========================================================================*//**
+ * Name of a debug file of a ROM: the name of the ROM with another extension
+ *
+ * \param output_name: name of the ROM
+ * \param ext: extension of the debug file, as ".sym"
+ *//*=========================================================================*/
+char* get_debug_name(const char* output_name, const char* ext)
+{
+    const char* p = strrchr(output_name, '.');
+    size_t len = p ? (size_t)(p - output_name) : strlen(output_name);
+    char* name = (char*)mmalloc(len + strlen(ext) + 1);
+
+    memcpy(name, output_name, len);
+    strcpy(name + len, ext);
+    return name;
+}
+
+
+
+
+/*========================================================================*//**
+ * Tell whether the files written by the previous link along with the ROM
+ * are still there
+ *
+ * \param sym_name: name of the symbol file, NULL if not written
+ * \param lines_name: name of the line table, NULL if not written
+ *//*=========================================================================*/
+int outputs_exist(const char* sym_name, const char* lines_name)
+{
+    const char* names[4];
+    int i;
+
+    names[0] = sym_name;
+    names[1] = lines_name;
+    names[2] = get_option("-Map=")->set ? get_option("-Map=")->value.str
+                                        : NULL;
+    names[3] = get_option("--map-json=")->set
+               ? get_option("--map-json=")->value.str : NULL;
+    for (i = 0; i < 4; ++i)
+    {
+        FILE* file;
+        if (!names[i])
+            continue;
+        if (!(file = fopen(names[i], "r")))
+            return 0;
+        fclose(file);
+    }
+    return 1;
+}
+
+/*========================================================================*//**
+ * Load the input files. When patching, the unchanged files are restored from
+ * the link state instead of being read.
+ *
+ * \param state_name: name of the link state file, NULL if not incremental
+ * \param patching: nonzero if the previous ROM may be patched
+ *//*=========================================================================*/
+void load_inputs(const char* state_name, int patching)
+{
+    sourcefile_t* file;
+    int file_id = 0;
+
+    file_first();
+    while ((file = file_next()))
+    {
+        int unchanged;
+        esetfile(file->name);
+        if (file->type == A)
+        {
+            open_archive(file->name);
+            continue;
+        }
+        unchanged = state_name ? hash_input(file_id, file->name) : 0;
+        if (patching && unchanged)
+        {
+            restore_object(file_id);
+            if (get_option("-g")->set)
+                load_lines(file_id, file->name);
+        }
+        else
+            load_object(file_id, file->name);
+        ++file_id;
+    }
+
+    file_id = load_archive_members(file_id);
+    init_far_calls(file_id);
+    if (patching)
+        restore_generated(file_id);
+}
+
+/*========================================================================*//**
+ * Forget everything loaded, before linking again from scratch
+ *//*=========================================================================*/
+void reset_link()
+{
+    free_rom();
+    free_map();
+    free_far_calls();
+    free_archives();
+    free_lines();
+    list_free(lfiles);
+    list_free(lsections);
+    list_free(lsymbols);
+    list_free(lrelocations);
+    lfiles = NULL;
+    lsections = NULL;
+    lsymbols = NULL;
+    lrelocations = NULL;
+    reset_capture();
+    init_rom();
+    init_map();
+}
+
+/*========================================================================*//**
+ * Read the sections, symbols and relocations of an object file
+ *//*=========================================================================*/
+void load_object(int file_id, const char* name)
+{
+    long fsize;
+    esetfile(name);
+    if (! (infile = fopen(name, "rb")))
+    {
+        ccerr(F, "unable to open \"%s\"", name);
+        return;
+    }
+
+    fseek(infile, 0, SEEK_END);
+    fsize = ftell(infile);
+    fseek(infile, 0, SEEK_SET);
+
+    read_object(file_id, name, name, fsize);
+    fclose(infile);
+}
+
+/*========================================================================*//**
+ * Read an object file from the current position of the input file: its
+ * symbols first, then its sections, relocations and, with -g, source lines.
+ * The data of the sections is left unread if the unused sections will be
+ * discarded, except for the compressed ones.
+ *
+ * \param file_id: id given to the object file
+ * \param name: name of the object file
+ * \param path: name of the input file, an archive for a member
+ * \param end: offset of the end of the object file in the input file
+ *//*=========================================================================*/
+void read_object(int file_id, const char* name, const char* path, long end)
+{
+    static const block_type_t order[] = { symbols, sections, relocations };
+    int i, b;
+    char* filename;
+    block_header_t* header;
+
+    set_infile(infile);
+    read_obj_header(end);
+
+    filename = (char*)mmalloc(strlen(name) + 1);
+    strcpy(filename, name);
+    list_add(&lfiles, file_id, filename, 0);
+
+    if (lazy_data)
+    {
+        input_paths = (char**)mrealloc(input_paths,
+                                       sizeof(char*) * (file_id + 1));
+        while (num_input_paths <= file_id)
+            input_paths[num_input_paths++] = NULL;
+        input_paths[file_id] = strcpy((char*)mmalloc(strlen(path) + 1), path);
+    }
+
+    for (b = 0; b < 3; ++b)
+    {
+        if ((header = find_block(order[b])) == NULL)
+            continue;
+
+        if (header->type == sections)
+        {
+            section_entry_t* sect;
+#ifndef NDEBUG
+            printf("New sections block with %d entries\n", header->num_entries);
+#endif
+            for (i = 0; i < header->num_entries; ++i)
+            {
+                unsigned k;
+                if (lazy_data)
+                {
+                    sect = read_section_header();
+                    if (sect->flags & SECTION_LZ)
+                        read_section_data(sect);
+                }
+                else
+                    sect = read_section_entry();
+                list_add(&lsections, file_id, sect, 0);
+                capture_section(sect);
+#ifndef NDEBUG
+                printf("  * Section %d\n", sect->id);
+                printf("    - Type:      %s\n", sect->type == org ? ".org" : "");
+                printf("    - Offset:    %04x\n", sect->offset);
+                printf("    - Bank:      %d\n", sect->bank_num);
+                printf("    - Data size: %d\n", sect->data_size);
+                for (k = 0; sect->data && k < sect->data_size; ++k)
+                {
+                    if (k && (k % 16) == 0)
+                        printf("\n");
+                    else if (k && (k % 8) == 0)
+                        printf(" ");
+                    printf("%02X ", sect->data[k]);
+
+                }
+                printf("\n");
+#endif
+            }
+        }
+        else if (header->type == symbols)
+        {
+            symbol_entry_t* sym;
+#ifndef NDEBUG
+            printf("New symbols block with %d entries\n", header->num_entries);
+#endif
+            for (i = 0; i < header->num_entries; ++i)
+            {
+                sym = read_symbol_entry();
+                list_add(&lsymbols, file_id, sym, file_id);
+#ifndef NDEBUG
+                printf("  * Symbol %d\n", sym->sym_id);
+                printf("    - ID:         %s\n", sym->id);
+                printf("    - In section: %d\n", sym->section_id);
+                printf("    - Offset:     %d\n", sym->offset);
+                printf("    - Type:       %c\n", ".GE"[sym->type]);
+                printf("\n");
+#endif
+            }
+        }
+        else if (header->type == relocations)
+        {
+            reloc_entry_t* reloc;
+#ifndef NDEBUG
+            printf("New relocations block with %d entries\n", header->num_entries);
+#endif
+            for (i = 0; i < header->num_entries; ++i)
+            {
+                reloc = read_reloc_entry();
+                list_add(&lrelocations, file_id, reloc, 0);
+#ifndef NDEBUG
+                printf("  * Relocation\n");
+                printf("    - Symbol: %d\n", reloc->sym_id);
+                printf("    - Section: %d\n", reloc->section_id);
+                printf("    - Offset: %d\n", reloc->offset);
+                printf("    - Kind: %d\n", reloc->flags);
+                printf("    - Addend: %d\n", reloc->addend);
+#endif
+            }
+        }
+        free(header);
+    }
+
+    if (get_option("-g")->set)
+        read_lines(file_id);
+
+    compress_sections(file_id);
+}
+
+/*========================================================================*//**
+ * Read the data of the sections left unread by read_object, unless they have
+ * been discarded
+ *//*=========================================================================*/
+void load_section_data()
+{
+    list_t* list;
+    int file_id = -1;
+
+    infile = NULL;
+    for (list = lsections; list; list = list->next)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+
+        if (sect->data || !sect->data_pos
+            || (list->flags & SECT_DISCARDED))
+            continue;
+
+        /* The sections of a file follow each other in the list */
+        if (list->file_id != file_id)
+        {
+            if (infile)
+                fclose(infile);
+            file_id = list->file_id;
+            esetfile(input_paths[file_id]);
+            if (!(infile = fopen(input_paths[file_id], "rb")))
+                ccerr(F, "unable to open \"%s\"", input_paths[file_id]);
+            set_infile(infile);
+        }
+        read_section_data(sect);
+    }
+    if (infile)
+        fclose(infile);
+    infile = NULL;
+
+    for (file_id = 0; file_id < num_input_paths; ++file_id)
+        free(input_paths[file_id]);
+    free(input_paths);
+    input_paths = NULL;
+    num_input_paths = 0;
+}
+
+/*========================================================================*//**
+ * Read the archive members defining the symbols still undefined, then the
+ * members defining the symbols these ones need, and so on
+ *
+ * \param file_id: id given to the first member read
+ * \return id following the one of the last member read
+ *//*=========================================================================*/
+int load_archive_members(int file_id)
+{
+    list_t* list;
+    int first = 0;
+
+    while (first < file_id)
+    {
+        int last = file_id;
+
+        /* Only the files read in the previous pass can add undefined
+         * symbols */
+        for (list = lsymbols; list; list = list->next)
+        {
+            symbol_entry_t* sym = (symbol_entry_t*)list->data;
+            char* name;
+            const char* path;
+            long end;
+
+            if (list->file_id < first || list->file_id >= last
+                || sym->type != _extern || is_defined((char*)sym->id))
+                continue;
+            if ((infile = archive_member((char*)sym->id, &name, &path, &end)))
+            {
+                esetfile(name);
+                read_object(file_id++, name, path, end);
+                free(name);
+            }
+        }
+        first = last;
+    }
+
+    infile = NULL;
+    return file_id;
+}
+
+/*========================================================================*//**
+ * Tell whether a global symbol has been loaded
+ *//*=========================================================================*/
+int is_defined(const char* name)
+{
+    list_t* list;
+
+    for (list = lsymbols; list; list = list->next)
+    {
+        symbol_entry_t* sym = (symbol_entry_t*)list->data;
+        if (sym->type == _global && strcmp((char*)sym->id, name) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*========================================================================*//**
+ * Tell whether archives are among the input files
+ *//*=========================================================================*/
+int has_archives()
+{
+    sourcefile_t* file;
+
+    file_first();
+    while ((file = file_next()))
+    {
+        if (file->type == A)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*========================================================================*//**
+ * Report the global symbols defined in several files
+ *//*=========================================================================*/
+void check_duplicate_symbols()
+{
+    list_t* psyms1, * psyms2;
+
+    psyms1 = lsymbols;
+    while (psyms1)
+    {
+        psyms2 = psyms1->next;
+        while (psyms2)
+        {
+            if (psyms1->file_id == psyms2->file_id)
+            {
+                psyms2 = psyms2->next;
+                continue;
+            }
+            if (((symbol_entry_t*)(psyms1->data))->type != _global
+                || ((symbol_entry_t*)(psyms2->data))->type != _global)
+            {
+                psyms2 = psyms2->next;
+                continue;
+            }
+            if (strcmp((const char*)((symbol_entry_t*)(psyms1->data))->id,
+                       (const char*)((symbol_entry_t*)(psyms2->data))->id)
+                == 0)
+            {
+                ccerr(E, "duplicate symbol '%s'",
+                    ((symbol_entry_t*)(psyms2->data))->id);
+            }
+
+            psyms2 = psyms2->next;
+        }
+        psyms1 = psyms1->next;
+    }
+}
+
+/*========================================================================*//**
+ * Resolve the external symbols to the global symbols of the other files
+ *//*=========================================================================*/
+void link_extern_symbols()
+{
+    list_t* list;
+
+    list = lsymbols;
+    while(list)
+    {
+        list_t* sfile = list_at(lfiles, list->file_id);
+        symbol_entry_t* sym = (symbol_entry_t*)(list->data);
+        list_t* tsyms = lsymbols; /* target symbols list */
+        symbol_entry_t* tsym;     /* target symbol */
+
+        if (sym->type != _extern)
+        {
+            list = list->next;
+            continue;
+        }
+
+        esetfile((char*)sfile->data);
+        while (tsyms)
+        {
+            tsym = (symbol_entry_t*)(tsyms->data);
+            /* A file only refers to its own globals for the size symbols of
+             * its compressed sections, defined by the linker */
+            if (tsym->type != _global || (tsyms->file_id == list->file_id
+                && !is_constants_section(tsyms->file_id, tsym->section_id)))
+            {
+                tsyms = tsyms->next;
+                continue;
+            }
+
+            if (strcmp((char*)sym->id, (char*)tsym->id) == 0)
+                break;
+
+            tsyms = tsyms->next;
+        }
+
+        if (tsyms == NULL)
+            err(E, "symbol '%s' unsolved", sym->id);
+        else
+        {
+            list->flags = tsyms->file_id; /* flag = target file id */
+            sym->section_id = tsym->section_id;
+            sym->offset = tsym->offset;
+        }
+
+        list = list->next;
+    }
+}
+
+/*========================================================================*//**
+ * Tell if a section of a file is the one holding the constants the linker
+ * defines for it
+ *//*=========================================================================*/
+int is_constants_section(int file_id, int sect_id)
+{
+    list_t* list;
+
+    for (list = lsections; list; list = list->next)
+    {
+        if (list->file_id == file_id
+            && ((section_entry_t*)list->data)->id == sect_id)
+            return (list->flags & SECT_CONSTANTS) != 0;
+    }
+    return 0;
 }
 
 
@@ -398,7 +909,35 @@ void help()
     puts("  --help      Display this information");
     puts("  --version   Display linker version information");
     puts("  -o <file>   Place the output into <file>");
-    puts("  -g          Generate debug information file");
+    puts("  -g          Generate the symbol and line table files");
+    puts("  -ftime-report");
+    puts("              Display the time and memory spent in each phase");
+    puts("  -mcartridge=<type>");
+    puts("              Set the cartridge type (rom, mbc1, mbc5+ram...)");
+    puts("  -mrom-size=<KB>");
+    puts("              Set the ROM size, from 32 to 8192 KB");
+    puts("  -mram-size=<KB>");
+    puts("              Set the external RAM size: 0, 8, 32, 64 or 128 KB");
+    puts("  --print-memory-usage");
+    puts("              Display the usage of each ROM bank");
+    puts("  --gc-sections");
+    puts("              Discard the sections which are never referenced");
+    puts("  --keep=<symbol>[,<symbol>...]");
+    puts("              Keep the sections defining these symbols");
+    puts("  --fold-sections");
+    puts("              Keep a single copy of identical sections");
+    puts("  --profile=<file>");
+    puts("              Place the functions called the most after a profile");
+    puts("              of the previous output");
+    puts("  --incremental <file>");
+    puts("              Keep the link state in <file> and patch the previous");
+    puts("              output when only the contents of objects changed");
+    puts("  -Map=<file> Write a map of the memory to <file>");
+    puts("  --map-json=<file>");
+    puts("              Write the map of the memory to <file> in JSON");
+    puts("  --print-far-calls");
+    puts("              List the calls and jumps between switchable banks");
+    puts("  --verify    Check the logo, size and checksums of the ROMs given");
     exit(EXIT_SUCCESS);
 }
 
@@ -422,6 +961,12 @@ void on_fatal_error(int from_program)
 {
     free_rom();
     free_map();
+    free_far_calls();
+    free_archives();
+    free_folded_sections();
+    free_profile();
+    free_state();
+    free_lines();
     list_free(lfiles);
     list_free(lsections);
     list_free(lsymbols);
@@ -430,43 +975,39 @@ void on_fatal_error(int from_program)
 }
 
 section_entry_t* get_section(int file_id, unsigned sect_id)
+{
+    list_t* lsect = get_section_node(file_id, sect_id);
+    if (lsect != NULL)
+        return (section_entry_t*)(lsect->data);
+    return NULL;
+}
+
+list_t* get_section_node(int file_id, unsigned sect_id)
 {
     list_t* lsect = lsections;
-    section_entry_t* sect;
     while (lsect)
     {
-        if (lsect->file_id == file_id)
-        {
-            sect = (section_entry_t*)(lsect->data);
-            if (sect->id == sect_id)
-                break;
-        }
+        if (lsect->file_id == file_id
+            && ((section_entry_t*)(lsect->data))->id == sect_id)
+            break;
         lsect = lsect->next;
     }
-    if (lsect != NULL)
-        return sect;
-    return NULL;
+    return lsect;
 }
 
 void write_section(section_entry_t* sect)
 {
-    unsigned char* src = sect->data, * dest;
-    unsigned count = sect->data_size;
-    if (sect->offset == ALLOC_FAILED)
+    /* Sections restored from the link state are already in the ROM */
+    if (sect->offset == ALLOC_FAILED || !sect->data)
         return;
-    if (sect->type == org)
-    {
-        unsigned offset = sect->offset % ROM_BANK_SIZE;
-        dest = get_rom_from_org(sect->offset) + offset;
-    }
-    else
-    {
-        TODO("write non org sections");
-        return;
-    }
 
-    while(count--)
-        *dest++ = *src++;
+    /* Sections outside of the ROM hold no data */
+    if (get_space(sect->offset) == rom_0)
+        write_rom(0, sect->offset % ROM_BANK_SIZE, sect->data,
+                  sect->data_size);
+    else if (get_space(sect->offset) == rom_n)
+        write_rom(sect->bank_num + 1, sect->offset % ROM_BANK_SIZE,
+                  sect->data, sect->data_size);
 
     free(sect->data);
     sect->data = NULL;
@@ -14,14 +14,26 @@
 #include "../common/utils.h"
 #include "../common/errors.h"
 #include "../common/gbmmap.h"
+#include "rom.h"
 
+/** Allocated block of a slot. The blocks of a slot never overlap and are
+ * kept in an AVL tree ordered by address. Each node also holds the bounds of
+ * its subtree and the biggest free gap between the blocks of its subtree, so
+ * that overlaps are found in O(log n) and subtrees too full for a block are
+ * skipped when searching for a gap. */
 typedef struct alloc_s
 {
     int             address;
     int             size;
     char*           filename;
-    struct alloc_s* prev;
-    struct alloc_s* next;
+    char            sectname[16];
+    int             height;     /**< height of the subtree */
+    int             first;      /**< lowest address of the subtree */
+    int             last;       /**< end address of the subtree */
+    int             max_gap;    /**< biggest gap between two blocks of the
+                                 * subtree */
+    struct alloc_s* left;
+    struct alloc_s* right;
 } alloc_t;
 
 typedef struct slot_s
@@ -29,9 +41,18 @@ typedef struct slot_s
     char     name[16];
     int      address;
     int      size;
+    int      used;
     alloc_t* allocs;
 } slot_t;
 
+/** Symbol listed in the map file */
+typedef struct map_sym_s
+{
+    int         slot;       /**< index of the slot of the symbol */
+    int         address;
+    const char* name;
+} map_sym_t;
+
 static slot_t*  slot_rom_0 = NULL;
 static slot_t** slot_rom_n = NULL;
 static slot_t** slot_vram = NULL;
@@ -45,163 +66,125 @@ static slot_t*  slot_io = NULL;
 static slot_t*  slot_hram = NULL;
 static slot_t*  slot_ie = NULL;
 
-static void    free_allocs(slot_t* slot);
-static void    add_alloc(const char* filename, char* sectname, slot_t* slot,
+static int num_rom_n;   /**< Number of switchable ROM slots */
+static int num_vram;    /**< Number of VRAM slots */
+static int num_ram;     /**< Number of external RAM slots */
+static int num_wram_n;  /**< Number of switchable WRAM slots */
+
+static slot_t* new_slot(gbspace_t space, const char* name);
+static void    free_slot(slot_t* slot);
+static void    free_allocs(alloc_t* alloc);
+static int     add_alloc(const char* filename, char* sectname, slot_t* slot,
                          int address, int size);
+static void    reserve(slot_t* slot, char* name, int address, int size);
 static slot_t* get_slot_by_address(int address);
+static slot_t* get_section_slot(section_entry_t* sect);
+static int     find_gap(slot_t* slot, int size, int align, int* address);
+static void    search_gap(alloc_t* alloc, int* start, int size, int align,
+                          int* best, int* address);
+static void    fit_gap(int start, int end, int size, int align, int* best,
+                       int* address);
+static alloc_t* find_overlap(alloc_t* alloc, int address, int size);
+static alloc_t* insert_alloc(alloc_t* root, alloc_t* alloc);
+static alloc_t* balance(alloc_t* alloc);
+static alloc_t* rotate_left(alloc_t* alloc);
+static alloc_t* rotate_right(alloc_t* alloc);
+static void     update_alloc(alloc_t* alloc);
+static int     is_floating(list_t* list, int banked);
+static int     compare_floating(const void* a, const void* b);
+static slot_t* get_slot(int index);
+static int     count_allocs(alloc_t* alloc);
+static void    list_allocs(alloc_t* alloc, alloc_t** allocs, int* count);
+static map_sym_t* collect_map_symbols(int* count);
+static int     compare_map_symbol(const void* a, const void* b);
+static void    write_json_string(FILE* file, const char* str);
 
 void init_map()
 {
-    unsigned i;
+    int i;
+    char name[16];
     free_map();
 
-    slot_rom_0 = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_rom_0->address = mmap_addressof(rom_0);
-    slot_rom_0->size = mmap_get_section_size(rom_0);
-    slot_rom_0->allocs = NULL;
-    strcpy(slot_rom_0->name, "ROM 0");
+    num_rom_n = get_num_rom_banks() - 1;
+    num_vram = get_num_vram_banks();
+    num_ram = get_num_ram_banks();
+    num_wram_n = get_num_wram_banks() - 1;
 
-    slot_rom_n = (slot_t**)mmalloc(sizeof(slot_t*) * get_num_rom_banks() - 1);
-    for (i = 0; i < get_num_rom_banks() - 1; ++i)
+    slot_rom_0 = new_slot(rom_0, "ROM 0");
+
+    slot_rom_n = (slot_t**)mmalloc(sizeof(slot_t*) * num_rom_n);
+    for (i = 0; i < num_rom_n; ++i)
     {
-        slot_rom_n[i] = (slot_t*)mmalloc(sizeof(slot_t));
-        slot_rom_n[i]->address = mmap_addressof(rom_n);
-        slot_rom_n[i]->size = mmap_addressof(rom_n);
-        slot_rom_n[i]->allocs = NULL;
-        sprintf(slot_rom_n[i]->name, "ROM %d", i + 1);
+        sprintf(name, "ROM %d", i + 1);
+        slot_rom_n[i] = new_slot(rom_n, name);
+        if (!mmap_rom_bank_mappable(i + 1))
+            slot_rom_n[i]->size = 0;
     }
 
-    slot_vram = (slot_t**)mmalloc(sizeof(slot_t*) * get_num_vram_banks());
-    for (i = 0; i < get_num_vram_banks(); ++i)
+    slot_vram = (slot_t**)mmalloc(sizeof(slot_t*) * num_vram);
+    for (i = 0; i < num_vram; ++i)
     {
-        slot_vram[i] = (slot_t*)malloc(sizeof(slot_t));
-        slot_vram[i]->address = mmap_addressof(vram);
-        slot_vram[i]->size = mmap_get_section_size(vram);
-        slot_vram[i]->allocs = NULL;
-        sprintf(slot_vram[i]->name, "VRAM %d", i);
+        sprintf(name, "VRAM %d", i);
+        slot_vram[i] = new_slot(vram, name);
     }
 
-    slot_ram = (slot_t**)mmalloc(sizeof(slot_t*) * get_num_ram_banks());
-    for (i = 0; i < get_num_ram_banks(); ++i)
+    slot_ram = (slot_t**)mmalloc(sizeof(slot_t*) * num_ram);
+    for (i = 0; i < num_ram; ++i)
     {
-        slot_ram[i] = (slot_t*)malloc(sizeof(slot_t));
-        slot_ram[i]->address = mmap_addressof(ram);
-        slot_ram[i]->size = mmap_get_section_size(ram);
-        slot_ram[i]->allocs = NULL;
-        sprintf(slot_ram[i]->name, "RAM %d", i);
+        sprintf(name, "RAM %d", i);
+        slot_ram[i] = new_slot(ram, name);
     }
 
-    slot_wram_0 = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_wram_0->address = mmap_addressof(wram_0);
-    slot_wram_0->size = mmap_get_section_size(wram_0);
-    slot_wram_0->allocs = NULL;
-    strcpy(slot_wram_0->name, "WRAM 0");
+    slot_wram_0 = new_slot(wram_0, "WRAM 0");
 
-    slot_wram_n = (slot_t**)mmalloc(sizeof(slot_t*) * get_num_wram_banks()-1);
-    for (i = 0; i < get_num_wram_banks()-1; ++i)
+    slot_wram_n = (slot_t**)mmalloc(sizeof(slot_t*) * num_wram_n);
+    for (i = 0; i < num_wram_n; ++i)
     {
-        slot_wram_n[i] = (slot_t*)malloc(sizeof(slot_t));
-        slot_wram_n[i]->address = mmap_addressof(wram_n);
-        slot_wram_n[i]->size = mmap_get_section_size(wram_n);
-        slot_wram_n[i]->allocs = NULL;
-        sprintf(slot_wram_n[i]->name, "WRAM %d", i+1);
+        sprintf(name, "WRAM %d", i + 1);
+        slot_wram_n[i] = new_slot(wram_n, name);
     }
 
-    slot_echo = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_echo->address = mmap_addressof(echo);
-    slot_echo->size = mmap_get_section_size(echo);
-    slot_echo->allocs = NULL;
-    strcpy(slot_echo->name, "ECHO");
-
-    slot_oam = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_oam->address = mmap_addressof(oam);
-    slot_oam->size = mmap_get_section_size(oam);
-    slot_oam->allocs = NULL;
-    strcpy(slot_oam->name, "OAM");
-
-    slot_unusable = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_unusable->address = mmap_addressof(unusable);
-    slot_unusable->size = mmap_get_section_size(unusable);
-    slot_unusable->allocs = NULL;
-    strcpy(slot_unusable->name, "UNUSABLE");
-
-    slot_io = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_io->address = mmap_addressof(io);
-    slot_io->size = mmap_get_section_size(io);
-    slot_io->allocs = NULL;
-    strcpy(slot_io->name, "IO");
-
-    slot_hram = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_hram->address = mmap_addressof(hram);
-    slot_hram->size = mmap_get_section_size(hram);
-    slot_hram->allocs = NULL;
-    strcpy(slot_hram->name, "HRAM");
-
-    slot_ie = (slot_t*)mmalloc(sizeof(slot_t));
-    slot_ie->address = mmap_addressof(ie);
-    slot_ie->size = mmap_get_section_size(ie);
-    slot_ie->allocs = NULL;
-    strcpy(slot_ie->name, "IE");
+    slot_echo = new_slot(echo, "ECHO");
+    slot_oam = new_slot(oam, "OAM");
+    slot_unusable = new_slot(unusable, "UNUSABLE");
+    slot_io = new_slot(io, "IO");
+    slot_hram = new_slot(hram, "HRAM");
+    slot_ie = new_slot(ie, "IE");
 }
 
 void free_map()
 {
-    unsigned i;
+    int i;
 
     if (!slot_rom_0)
         return;
 
-    free_allocs(slot_rom_0);
-    free(slot_rom_0);
-
-    for (i = 0; i < get_num_rom_banks() - 1; ++i)
-    {
-        free_allocs(slot_rom_n[i]);
-        free(slot_rom_n[i]);
-        free(slot_rom_n);
-    }
-
-    for (i = 0; i < get_num_vram_banks(); ++i)
-    {
-        free_allocs(slot_vram[i]);
-        free(slot_vram[i]);
-        free(slot_vram);
-    }
-
-    for (i = 0; i < get_num_ram_banks(); ++i)
-    {
-        free_allocs(slot_ram[i]);
-        free(slot_ram[i]);
-        free(slot_ram);
-    }
+    free_slot(slot_rom_0);
 
-    free_allocs(slot_wram_0);
-    free(slot_wram_0);
+    for (i = 0; i < num_rom_n; ++i)
+        free_slot(slot_rom_n[i]);
+    free(slot_rom_n);
 
-    for (i = 0; i < get_num_wram_banks() - 1; ++i)
-    {
-        free_allocs(slot_wram_n[i]);
-        free(slot_wram_n[i]);
-        free(slot_wram_n);
-    }
-
-    free_allocs(slot_echo);
-    free(slot_echo);
+    for (i = 0; i < num_vram; ++i)
+        free_slot(slot_vram[i]);
+    free(slot_vram);
 
-    free_allocs(slot_oam);
-    free(slot_oam);
+    for (i = 0; i < num_ram; ++i)
+        free_slot(slot_ram[i]);
+    free(slot_ram);
 
-    free_allocs(slot_unusable);
-    free(slot_unusable);
+    free_slot(slot_wram_0);
 
-    free_allocs(slot_io);
-    free(slot_io);
+    for (i = 0; i < num_wram_n; ++i)
+        free_slot(slot_wram_n[i]);
+    free(slot_wram_n);
 
-    free_allocs(slot_hram);
-    free(slot_hram);
-
-    free_allocs(slot_ie);
-    free(slot_ie);
+    free_slot(slot_echo);
+    free_slot(slot_oam);
+    free_slot(slot_unusable);
+    free_slot(slot_io);
+    free_slot(slot_hram);
+    free_slot(slot_ie);
 
     slot_rom_0 = NULL;
     slot_rom_n = NULL;
@@ -218,93 +201,625 @@ void free_map()
 }
 
 /*========================================================================*//**
+ * Allocate a section in the memory map. A .org section is allocated at its
+ * address, a floating ROM section is placed in the bank whose smallest
+ * suitable free gap fits it best. Floating sections without a bank
+ * constraint go to a switchable bank, or to ROM 0 if none can hold them.
+ *
  * \param filename: name of the file in which the section has been created
+ * \param sect: the section to allocate. The bank number of a floating section
+ * is updated to the index of the switchable bank it has been placed in.
+ * \return address of the section, ALLOC_FAILED if it could not be placed
  *//*=========================================================================*/
 unsigned allocate(const char* filename, section_entry_t* sect)
 {
     char buf[16];
     if (sect->type == org)
     {
+        slot_t* slot = get_slot_by_address(sect->offset);
         sprintf(buf, ".org $%x", sect->offset);
-        add_alloc(filename, buf, get_slot_by_address(sect->offset),
-                  sect->offset, sect->data_size);
+        if (!slot || !add_alloc(filename, buf, slot, sect->offset,
+                                sect->data_size))
+            return ALLOC_FAILED;
         return sect->offset;
     }
+    else if (sect->type == rom)
+    {
+        slot_t* best = NULL;
+        int best_addr = 0, best_left = -1;
+        int i, left, addr;
+
+        if (sect->bank_num != ANY_BANK && sect->bank_num > num_rom_n)
+        {
+            ccerr(E, "%s: ROM bank %d does not exist on this cartridge",
+                  filename, sect->bank_num);
+            return ALLOC_FAILED;
+        }
+
+        if (sect->bank_num > 0 && !mmap_rom_bank_mappable(sect->bank_num))
+        {
+            ccerr(E, "%s: ROM bank %d cannot be mapped on this cartridge",
+                  filename, sect->bank_num);
+            return ALLOC_FAILED;
+        }
+
+        if (sect->bank_num == ANY_BANK)
+        {
+            for (i = 0; i < num_rom_n; ++i)
+            {
+                left = find_gap(slot_rom_n[i], sect->data_size, sect->align,
+                                &addr);
+                if (left >= 0 && (best_left < 0 || left < best_left))
+                {
+                    best = slot_rom_n[i];
+                    best_addr = addr;
+                    best_left = left;
+                    sect->bank_num = i;
+                }
+            }
+        }
+        else if (sect->bank_num > 0)
+        {
+            i = sect->bank_num - 1;
+            if (find_gap(slot_rom_n[i], sect->data_size, sect->align,
+                         &best_addr) >= 0)
+            {
+                best = slot_rom_n[i];
+                sect->bank_num = i;
+            }
+        }
+
+        if (!best && sect->bank_num <= 0)
+        {
+            if (find_gap(slot_rom_0, sect->data_size, sect->align,
+                         &best_addr) >= 0)
+            {
+                best = slot_rom_0;
+                sect->bank_num = 0;
+            }
+        }
+
+        if (!best)
+        {
+            ccerr(E, "%s: not enough ROM space left for a section of %d "
+                  "bytes", filename, sect->data_size);
+            return ALLOC_FAILED;
+        }
+
+        sprintf(buf, ".rom");
+        add_alloc(filename, buf, best, best_addr, sect->data_size);
+        return best_addr;
+    }
 
     return ALLOC_FAILED;
 }
 
-void free_allocs(slot_t* slot)
+/*========================================================================*//**
+ * Place the floating sections not placed yet, biggest first, in the ROM
+ * banks. The sections bound to a bank are placed before the others.
+ *
+ * \param sections: list of all sections
+ * \param files: list of the file names
+ * \param banked: nonzero to place only the sections bound to a bank
+ *//*=========================================================================*/
+void allocate_floating(list_t* sections, list_t* files, int banked)
 {
-    alloc_t* cur = slot->allocs;
-    alloc_t* next;
-    while (cur)
+    list_t** floating;
+    list_t*  list;
+    int count = 0, i;
+
+    for (list = sections; list; list = list->next)
+    {
+        if (is_floating(list, banked))
+            ++count;
+    }
+
+    if (!count)
+        return;
+
+    floating = (list_t**)mmalloc(sizeof(list_t*) * count);
+    count = 0;
+    for (list = sections; list; list = list->next)
     {
-        next = cur->next;
-        free(cur->filename);
-        free(cur);
-        cur = next;
+        if (is_floating(list, banked))
+            floating[count++] = list;
     }
+
+    qsort(floating, count, sizeof(list_t*), &compare_floating);
+    reserve_header();
+
+    for (i = 0; i < count; ++i)
+    {
+        section_entry_t* sect = (section_entry_t*)floating[i]->data;
+        const char* filename = list_at(files, floating[i]->file_id)->data;
+        esetfile(filename);
+        sect->offset = allocate(filename, sect);
+        floating[i]->flags |= SECT_TREATED;
+    }
+
+    free(floating);
+}
+
+/*========================================================================*//**
+ * Place a floating ROM section in a given bank if it fits. Nothing is
+ * reported if it does not.
+ *
+ * \param filename: name of the file in which the section has been created
+ * \param sect: the section. Its bank number is updated to the index of the
+ * switchable bank it has been placed in.
+ * \param bank: 0 for ROM 0, the number of a switchable bank otherwise
+ * \return address of the section, ALLOC_FAILED if it does not fit
+ *//*=========================================================================*/
+unsigned allocate_in_bank(const char* filename, section_entry_t* sect,
+                          int bank)
+{
+    char buf[16] = ".rom";
+    slot_t* slot;
+    int addr;
+
+    if (bank < 0 || bank > num_rom_n)
+        return ALLOC_FAILED;
+    slot = bank ? slot_rom_n[bank - 1] : slot_rom_0;
+    if (find_gap(slot, sect->data_size, sect->align, &addr) < 0)
+        return ALLOC_FAILED;
+
+    add_alloc(filename, buf, slot, addr, sect->data_size);
+    sect->bank_num = bank ? bank - 1 : 0;
+    return addr;
+}
+
+/*========================================================================*//**
+ * \param bank: 0 for ROM 0, the number of a switchable bank otherwise
+ * \return number of free bytes of a ROM bank
+ *//*=========================================================================*/
+int get_rom_free(int bank)
+{
+    slot_t* slot;
+
+    if (bank < 0 || bank > num_rom_n)
+        return 0;
+    slot = bank ? slot_rom_n[bank - 1] : slot_rom_0;
+    return slot->size - slot->used;
 }
 
-void add_alloc(const char* filename, char* sectname, slot_t* slot, int address,
-               int size)
+/*========================================================================*//**
+ * Keep floating sections out of the cartridge header, except for the parts
+ * already defined by .org sections
+ *//*=========================================================================*/
+void reserve_header()
+{
+    reserve(slot_rom_0, "header", ROM_HEADER_ADDRESS, ROM_HEADER_SIZE);
+}
+
+/*========================================================================*//**
+ * Record a section already placed, at its address and bank
+ *
+ * \param filename: name of the file in which the section has been created
+ * \param sect: the section. The bank number of a section in a switchable
+ * bank is the index of this bank.
+ *//*=========================================================================*/
+void allocate_fixed(const char* filename, section_entry_t* sect)
 {
-    alloc_t* alloc = (alloc_t*)mmalloc(sizeof(alloc_t));
-    alloc_t* elem;
-    int inserted = 0;
+    slot_t* slot = get_section_slot(sect);
 
-    if (address + size > slot->address + slot->size)
+    if (slot)
     {
-        ccerr(E, "%s: %s: section '%s' bounds exceeded",
-              filename, sectname, slot->name);
-        free(alloc);
+        char buf[16];
+        if (sect->type == org)
+            sprintf(buf, ".org $%x", sect->offset);
+        else
+            sprintf(buf, ".rom");
+        add_alloc(filename, buf, slot, sect->offset, sect->data_size);
+    }
+}
+
+/*========================================================================*//**
+ * Print the usage of each ROM bank
+ *//*=========================================================================*/
+void print_memory_usage()
+{
+    int i;
+
+    printf("%-16s %10s %10s %9s\n", "Memory region", "Used", "Size", "Used %");
+    for (i = -1; i < num_rom_n; ++i)
+    {
+        slot_t* slot = i < 0 ? slot_rom_0 : slot_rom_n[i];
+        if (!slot->size)
+            continue;
+        printf("%-16s %10d %10d %8.2f%%\n", slot->name, slot->used,
+               slot->size, 100.0 * slot->used / slot->size);
+    }
+}
+
+/*========================================================================*//**
+ * Write the map file: for each slot, its usage, the sections allocated in it
+ * with their symbols, and its free gaps
+ *
+ * \param name: name of the map file
+ * \param output_name: name of the ROM
+ * \param json: nonzero to write the map in JSON
+ *//*=========================================================================*/
+void write_map(const char* name, const char* output_name, int json)
+{
+    FILE*       file;
+    map_sym_t*  syms;
+    alloc_t**   allocs = NULL;
+    slot_t*     slot;
+    int         num_syms, max_allocs = 0;
+    int         i, num_slots = 0;
+
+    if (!(file = fopen(name, "w")))
+    {
+        ccerr(E, "unable to open \"%s\"", name);
         return;
     }
 
-    alloc->address = address;
-    alloc->size = size;
-    alloc->filename = (char*)mmalloc(strlen(filename)+1);
-    strcpy(alloc->filename, filename);
+    syms = collect_map_symbols(&num_syms);
 
-    if (slot->allocs == NULL)
+    if (json)
     {
-        alloc->prev = NULL;
-        alloc->next = NULL;
-        slot->allocs = alloc;
-        inserted = 1;
+        fprintf(file, "{\n  \"output\": ");
+        write_json_string(file, output_name);
+        fprintf(file, ",\n  \"slots\": [");
     }
+    else
+        fprintf(file, "Memory map of %s\n", output_name);
 
-    elem = slot->allocs;
-    while (!inserted && elem->next && address > elem->address)
+    for (i = 0; (slot = get_slot(i)); ++i)
     {
-        if (elem->next == NULL && address > elem->address)
+        int num_allocs, j, k, n, gap, largest = 0, gaps = 0;
+        int end = slot->address + slot->size;
+        int free_bytes = slot->size - slot->used;
+        double frag;
+
+        if (!slot->size)
+            continue;
+
+        num_allocs = count_allocs(slot->allocs);
+        if (num_allocs > max_allocs)
+        {
+            max_allocs = num_allocs;
+            allocs = (alloc_t**)mrealloc(allocs, sizeof(alloc_t*) * max_allocs);
+        }
+        num_allocs = 0;
+        list_allocs(slot->allocs, allocs, &num_allocs);
+
+        /* Free gaps, and fragmentation as the part of the free space which
+         * is not in the biggest gap */
+        for (j = 0, gap = slot->address; j <= num_allocs; ++j)
         {
-            /* insert at the end of the list */
-            alloc->next = NULL;
-            elem->next = alloc;
-            alloc->prev = elem;
+            int next = j < num_allocs ? allocs[j]->address : end;
+            if (next > gap)
+            {
+                ++gaps;
+                if (next - gap > largest)
+                    largest = next - gap;
+            }
+            if (j < num_allocs)
+                gap = allocs[j]->address + allocs[j]->size;
+        }
+        frag = free_bytes ? 1.0 - (double)largest / free_bytes : 0.0;
 
-            inserted = 1;
-            break;
+        if (json)
+        {
+            fprintf(file, "%s\n    {\n      \"name\": ",
+                    num_slots++ ? "," : "");
+            write_json_string(file, slot->name);
+            fprintf(file, ",\n      \"start\": %d,\n      \"size\": %d,\n"
+                    "      \"used\": %d,\n      \"free\": %d,\n"
+                    "      \"largest_gap\": %d,\n"
+                    "      \"fragmentation\": %.4f,\n"
+                    "      \"sections\": [", slot->address, slot->size,
+                    slot->used, free_bytes, largest, frag);
+        }
+        else
+        {
+            fprintf(file, "\n%-10s $%04X-$%04X  %d bytes, %d used (%.2f%%), "
+                    "%d free\n", slot->name, slot->address, end - 1,
+                    slot->size, slot->used, 100.0 * slot->used / slot->size,
+                    free_bytes);
+            fprintf(file, "%-10s %d free gap%s, largest %d bytes, "
+                    "fragmentation %.2f%%\n", "", gaps, gaps == 1 ? "" : "s",
+                    largest, 100.0 * frag);
+            if (num_allocs)
+                fprintf(file, "\n  %-7s %-7s %s\n", "Address", "Size",
+                        "File / Section / Symbols");
+        }
+
+        /* Sections and gaps in the order of the addresses */
+        for (j = 0, k = 0, gap = slot->address; j <= num_allocs; ++j)
+        {
+            int next = j < num_allocs ? allocs[j]->address : end;
+            alloc_t* alloc = j < num_allocs ? allocs[j] : NULL;
+
+            if (!json && next > gap && num_allocs)
+                fprintf(file, "  $%04X   %-7d (free)\n", gap, next - gap);
+            if (!alloc)
+                break;
+
+            if (json)
+            {
+                fprintf(file, "%s\n        {\n          \"address\": %d,\n"
+                        "          \"size\": %d,\n          \"file\": ",
+                        j ? "," : "", alloc->address, alloc->size);
+                write_json_string(file, alloc->filename);
+                fprintf(file, ",\n          \"section\": ");
+                write_json_string(file, alloc->sectname);
+                fprintf(file, ",\n          \"symbols\": [");
+            }
+            else
+                fprintf(file, "  $%04X   %-7d %s%s%s\n", alloc->address,
+                        alloc->size, alloc->filename,
+                        *alloc->filename ? " " : "", alloc->sectname);
+
+            /* Symbols of the section */
+            while (k < num_syms && (syms[k].slot < i
+                   || (syms[k].slot == i && syms[k].address < alloc->address)))
+                ++k;
+            for (n = 0; k < num_syms && syms[k].slot == i
+                 && syms[k].address < alloc->address + alloc->size; ++k, ++n)
+            {
+                if (json)
+                {
+                    fprintf(file, "%s\n            { \"name\": ",
+                            n ? "," : "");
+                    write_json_string(file, syms[k].name);
+                    fprintf(file, ", \"address\": %d }", syms[k].address);
+                }
+                else
+                    fprintf(file, "  %-7s %-7s   $%04X %s\n", "", "",
+                            syms[k].address, syms[k].name);
+            }
+
+            if (json)
+                fprintf(file, "\n          ]\n        }");
+            gap = alloc->address + alloc->size;
+        }
+
+        if (json)
+        {
+            fprintf(file, "\n      ],\n      \"gaps\": [");
+            for (j = 0, n = 0, gap = slot->address; j <= num_allocs; ++j)
+            {
+                int next = j < num_allocs ? allocs[j]->address : end;
+                if (next > gap)
+                    fprintf(file, "%s\n        { \"address\": %d, "
+                            "\"size\": %d }", n++ ? "," : "", gap, next - gap);
+                if (j < num_allocs)
+                    gap = allocs[j]->address + allocs[j]->size;
+            }
+            fprintf(file, "\n      ]\n    }");
         }
-        elem = elem->next;
     }
 
-    if (!inserted)
+    if (json)
+        fprintf(file, "\n  ]\n}\n");
+
+    free(allocs);
+    free(syms);
+    fclose(file);
+}
+
+/*========================================================================*//**
+ * Get a slot by its index, in the order of the memory map
+ *
+ * \return the slot, NULL after the last one
+ *//*=========================================================================*/
+slot_t* get_slot(int index)
+{
+    if (index-- == 0)
+        return slot_rom_0;
+    if (index < num_rom_n)
+        return slot_rom_n[index];
+    index -= num_rom_n;
+    if (index < num_vram)
+        return slot_vram[index];
+    index -= num_vram;
+    if (index < num_ram)
+        return slot_ram[index];
+    index -= num_ram;
+    if (index-- == 0)
+        return slot_wram_0;
+    if (index < num_wram_n)
+        return slot_wram_n[index];
+    index -= num_wram_n;
+
+    switch (index)
     {
-        /* Insert before the first element with a higher address */
-        alloc->prev = elem->prev;
-        elem->prev = alloc;
-        alloc->next = elem;
+    case 0:     return slot_echo;
+    case 1:     return slot_oam;
+    case 2:     return slot_unusable;
+    case 3:     return slot_io;
+    case 4:     return slot_hram;
+    case 5:     return slot_ie;
+    default:    return NULL;
+    }
+}
+
+int count_allocs(alloc_t* alloc)
+{
+    if (!alloc)
+        return 0;
+    return 1 + count_allocs(alloc->left) + count_allocs(alloc->right);
+}
 
-        if (elem->prev != NULL)
-            elem->prev->next = elem;
+/*========================================================================*//**
+ * List the blocks of a tree in the order of their addresses
+ *//*=========================================================================*/
+void list_allocs(alloc_t* alloc, alloc_t** allocs, int* count)
+{
+    if (!alloc)
+        return;
+    list_allocs(alloc->left, allocs, count);
+    allocs[(*count)++] = alloc;
+    list_allocs(alloc->right, allocs, count);
+}
+
+/*========================================================================*//**
+ * Collect the symbols of the sections allocated, sorted by slot and address
+ *//*=========================================================================*/
+map_sym_t* collect_map_symbols(int* count)
+{
+    list_t*    list;
+    map_sym_t* syms;
+    int        n = 0;
+
+    for (list = lsymbols; list; list = list->next)
+        ++n;
+    syms = (map_sym_t*)mmalloc(sizeof(map_sym_t) * (n + 1));
+
+    n = 0;
+    for (list = lsymbols; list; list = list->next)
+    {
+        symbol_entry_t* sym = (symbol_entry_t*)list->data;
+        list_t* lsect;
+        section_entry_t* sect;
+        slot_t* slot;
+        int i;
+
+        if (sym->type == _extern)
+            continue;
+        lsect = get_section_node(list->file_id, sym->section_id);
+        if (!lsect || (lsect->flags & (SECT_DISCARDED | SECT_CONSTANTS)))
+            continue;
+        sect = (section_entry_t*)lsect->data;
+        if (sect->offset == ALLOC_FAILED)
+            continue;
+
+        slot = get_section_slot(sect);
+        for (i = 0; slot && get_slot(i) != slot; ++i)
+            ;
+        if (!slot)
+            continue;
+
+        syms[n].slot = i;
+        syms[n].address = sect->offset + sym->offset;
+        syms[n++].name = (const char*)sym->id;
+    }
+
+    qsort(syms, n, sizeof(map_sym_t), &compare_map_symbol);
+    *count = n;
+    return syms;
+}
+
+int compare_map_symbol(const void* a, const void* b)
+{
+    const map_sym_t* sa = (const map_sym_t*)a;
+    const map_sym_t* sb = (const map_sym_t*)b;
+
+    if (sa->slot != sb->slot)
+        return sa->slot - sb->slot;
+    if (sa->address != sb->address)
+        return sa->address - sb->address;
+    return strcmp(sa->name, sb->name);
+}
+
+void write_json_string(FILE* file, const char* str)
+{
+    fputc('"', file);
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*str);
         else
-            slot->allocs = elem;
+            fputc(*str, file);
     }
+    fputc('"', file);
+}
+
+slot_t* new_slot(gbspace_t space, const char* name)
+{
+    slot_t* slot = (slot_t*)mmalloc(sizeof(slot_t));
+    slot->address = mmap_addressof(space);
+    slot->size = mmap_get_section_size(space);
+    slot->used = 0;
+    slot->allocs = NULL;
+    strcpy(slot->name, name);
+    return slot;
+}
+
+void free_slot(slot_t* slot)
+{
+    free_allocs(slot->allocs);
+    free(slot);
+}
 
-    TODO("Check for overlapping sections or full sections");
+void free_allocs(alloc_t* alloc)
+{
+    if (!alloc)
+        return;
+    free_allocs(alloc->left);
+    free_allocs(alloc->right);
+    free(alloc->filename);
+    free(alloc);
+}
+
+/*========================================================================*//**
+ * Add a block to the allocations of a slot
+ *
+ * \return 1 on success, 0 if the block exceeds the slot or overlaps a block
+ * already allocated
+ *//*=========================================================================*/
+int add_alloc(const char* filename, char* sectname, slot_t* slot, int address,
+              int size)
+{
+    alloc_t* alloc;
+
+    if (address < slot->address || address + size > slot->address + slot->size)
+    {
+        ccerr(E, "%s: %s: section '%s' bounds exceeded",
+              filename, sectname, slot->name);
+        return 0;
+    }
+
+    if (size <= 0)
+        return 1;
+
+    if ((alloc = find_overlap(slot->allocs, address, size)))
+    {
+        ccerr(E, "%s: %s overlaps %s%s%s", filename, sectname,
+              alloc->filename, *alloc->filename ? ": " : "", alloc->sectname);
+        return 0;
+    }
+
+    alloc = (alloc_t*)mmalloc(sizeof(alloc_t));
+    alloc->address = address;
+    alloc->size = size;
+    alloc->filename = (char*)mmalloc(strlen(filename)+1);
+    strcpy(alloc->filename, filename);
+    strncpy(alloc->sectname, sectname, sizeof(alloc->sectname) - 1);
+    alloc->sectname[sizeof(alloc->sectname) - 1] = 0;
+    alloc->left = NULL;
+    alloc->right = NULL;
+    update_alloc(alloc);
+
+    slot->allocs = insert_alloc(slot->allocs, alloc);
+    slot->used += size;
+    return 1;
+}
+
+/*========================================================================*//**
+ * Allocate the parts of a range of a slot which are still free
+ *//*=========================================================================*/
+void reserve(slot_t* slot, char* name, int address, int size)
+{
+    int end = address + size;
+    alloc_t* alloc;
+
+    while (address < end)
+    {
+        alloc = find_overlap(slot->allocs, address, end - address);
+        if (!alloc)
+        {
+            add_alloc("", name, slot, address, end - address);
+            break;
+        }
+        if (alloc->address > address)
+            add_alloc("", name, slot, address, alloc->address - address);
+        address = alloc->address + alloc->size;
+    }
 }
 
 slot_t* get_slot_by_address(int address)
@@ -337,6 +852,233 @@ slot_t* get_slot_by_address(int address)
         return NULL;
 }
 
+/*========================================================================*//**
+ * Get the slot of a section placed. The bank number of a section in a
+ * switchable bank is the index of this bank.
+ *//*=========================================================================*/
+slot_t* get_section_slot(section_entry_t* sect)
+{
+    if (get_space(sect->offset) == rom_n)
+        return sect->bank_num < num_rom_n ? slot_rom_n[sect->bank_num] : NULL;
+    return get_slot_by_address(sect->offset);
+}
+
+/*========================================================================*//**
+ * Find the smallest free gap of a slot able to hold a block of data
+ *
+ * \param slot: the slot to search
+ * \param size: size of the block
+ * \param align: alignment of the block, 0 or 1 meaning none
+ * \param address: receives the address of the block in the gap found
+ * \return number of bytes of the gap left unused, -1 if no gap fits
+ *//*=========================================================================*/
+int find_gap(slot_t* slot, int size, int align, int* address)
+{
+    int start = slot->address;
+    int best = -1;
+
+    if (align < 1)
+        align = 1;
+
+    if (slot->size - slot->used < size)
+        return -1;
+
+    search_gap(slot->allocs, &start, size, align, &best, address);
+    if (best != 0)
+        fit_gap(start, slot->address + slot->size, size, align, &best,
+                address);
+
+    return best;
+}
+
+/*========================================================================*//**
+ * Search the gaps of a subtree, in address order, skipping the subtrees
+ * whose gaps are all too small
+ *
+ * \param alloc: root of the subtree
+ * \param start: end of the block preceding the subtree, updated to the end
+ * of the subtree
+ *//*=========================================================================*/
+void search_gap(alloc_t* alloc, int* start, int size, int align, int* best,
+                int* address)
+{
+    if (!alloc || *best == 0)
+        return;
+
+    if (alloc->max_gap < size && alloc->first - *start < size)
+    {
+        *start = alloc->last;
+        return;
+    }
+
+    search_gap(alloc->left, start, size, align, best, address);
+    fit_gap(*start, alloc->address, size, align, best, address);
+    *start = alloc->address + alloc->size;
+    search_gap(alloc->right, start, size, align, best, address);
+}
+
+/*========================================================================*//**
+ * Keep a gap if the block fits in it and it is smaller than the best one
+ *//*=========================================================================*/
+void fit_gap(int start, int end, int size, int align, int* best, int* address)
+{
+    int addr = (start + align - 1) & ~(align - 1);
+
+    if (addr + size <= end && (*best < 0 || end - start - size < *best))
+    {
+        *best = end - start - size;
+        *address = addr;
+    }
+}
+
+/*========================================================================*//**
+ * Find a block of a subtree overlapping a range, the lowest one if several
+ * do
+ *//*=========================================================================*/
+alloc_t* find_overlap(alloc_t* alloc, int address, int size)
+{
+    alloc_t* found = NULL;
+
+    while (alloc)
+    {
+        if (address + size <= alloc->address)
+            alloc = alloc->left;
+        else if (address >= alloc->address + alloc->size)
+            alloc = alloc->right;
+        else
+        {
+            found = alloc;
+            alloc = alloc->left;
+        }
+    }
+
+    return found;
+}
+
+alloc_t* insert_alloc(alloc_t* root, alloc_t* alloc)
+{
+    if (!root)
+        return alloc;
+
+    if (alloc->address < root->address)
+        root->left = insert_alloc(root->left, alloc);
+    else
+        root->right = insert_alloc(root->right, alloc);
+
+    return balance(root);
+}
+
+alloc_t* balance(alloc_t* alloc)
+{
+    int hl, hr;
+
+    update_alloc(alloc);
+    hl = alloc->left ? alloc->left->height : 0;
+    hr = alloc->right ? alloc->right->height : 0;
+
+    if (hl > hr + 1)
+    {
+        alloc_t* l = alloc->left;
+        if ((l->right ? l->right->height : 0) > (l->left ? l->left->height : 0))
+            alloc->left = rotate_left(l);
+        return rotate_right(alloc);
+    }
+    if (hr > hl + 1)
+    {
+        alloc_t* r = alloc->right;
+        if ((r->left ? r->left->height : 0) > (r->right ? r->right->height : 0))
+            alloc->right = rotate_right(r);
+        return rotate_left(alloc);
+    }
+
+    return alloc;
+}
+
+alloc_t* rotate_left(alloc_t* alloc)
+{
+    alloc_t* r = alloc->right;
+    alloc->right = r->left;
+    r->left = alloc;
+    update_alloc(alloc);
+    update_alloc(r);
+    return r;
+}
+
+alloc_t* rotate_right(alloc_t* alloc)
+{
+    alloc_t* l = alloc->left;
+    alloc->left = l->right;
+    l->right = alloc;
+    update_alloc(alloc);
+    update_alloc(l);
+    return l;
+}
+
+/*========================================================================*//**
+ * Compute the height, bounds and biggest gap of a subtree from the ones of
+ * its children
+ *//*=========================================================================*/
+void update_alloc(alloc_t* alloc)
+{
+    alloc_t* l = alloc->left;
+    alloc_t* r = alloc->right;
+    int hl = l ? l->height : 0;
+    int hr = r ? r->height : 0;
+
+    alloc->height = (hl > hr ? hl : hr) + 1;
+    alloc->first = l ? l->first : alloc->address;
+    alloc->last = r ? r->last : alloc->address + alloc->size;
+    alloc->max_gap = 0;
+    if (l)
+    {
+        alloc->max_gap = l->max_gap;
+        if (alloc->address - l->last > alloc->max_gap)
+            alloc->max_gap = alloc->address - l->last;
+    }
+    if (r)
+    {
+        if (r->max_gap > alloc->max_gap)
+            alloc->max_gap = r->max_gap;
+        if (r->first - (alloc->address + alloc->size) > alloc->max_gap)
+            alloc->max_gap = r->first - (alloc->address + alloc->size);
+    }
+}
+
+/*========================================================================*//**
+ * Tell whether a section is a floating ROM section still to be placed
+ *
+ * \param banked: nonzero to only accept the sections bound to a bank
+ *//*=========================================================================*/
+int is_floating(list_t* list, int banked)
+{
+    section_entry_t* sect = (section_entry_t*)list->data;
+
+    return sect->type == rom
+           && !(list->flags & (SECT_DISCARDED | SECT_FOLDED | SECT_TREATED))
+           && (!banked || sect->bank_num != ANY_BANK);
+}
+
+/*========================================================================*//**
+ * Sort floating sections: the ones bound to a bank first, then by decreasing
+ * size and by decreasing alignment. Sections of the same size keep their link
+ * order.
+ *//*=========================================================================*/
+int compare_floating(const void* a, const void* b)
+{
+    const section_entry_t* sa = (*(list_t**)a)->data;
+    const section_entry_t* sb = (*(list_t**)b)->data;
+
+    if ((sa->bank_num == ANY_BANK) != (sb->bank_num == ANY_BANK))
+        return sa->bank_num == ANY_BANK ? 1 : -1;
+    if (sa->data_size != sb->data_size)
+        return sb->data_size - sa->data_size;
+    if (sa->align != sb->align)
+        return sb->align - sa->align;
+    if ((*(list_t**)a)->file_id != (*(list_t**)b)->file_id)
+        return (*(list_t**)a)->file_id - (*(list_t**)b)->file_id;
+    return sa->id - sb->id;
+}
+
 /**
  * \} Map
  * \} gbld
@@ -5,13 +5,27 @@
  * \{
  */
 
+#ifndef MAP_H
+#define MAP_H
+
 #include "../common/objfile.h"
+#include "lists.h"
 
 #define  ALLOC_FAILED   0x10000
 
 void     init_map();
 void     free_map();
 unsigned allocate(const char* filename, section_entry_t* sect);
+void     allocate_floating(list_t* sections, list_t* files, int banked);
+unsigned allocate_in_bank(const char* filename, section_entry_t* sect,
+                          int bank);
+int      get_rom_free(int bank);
+void     allocate_fixed(const char* filename, section_entry_t* sect);
+void     reserve_header();
+void     print_memory_usage();
+void     write_map(const char* name, const char* output_name, int json);
+
+#endif
 
 /**
  * \} Map
@@ -0,0 +1,581 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup profile Profile-guided placement
+ * A profile counts the calls made while running a previous build of the
+ * ROM. Its addresses are those of the .sym file of this build, so they are
+ * turned into symbol names and then into the sections now defining them.
+ * The most called sections per byte go to ROM 0, where they can be reached
+ * from any bank. The other sections which call each other are gathered in
+ * clusters, each cluster being placed in a single switchable bank. The
+ * remaining sections are placed as usual.
+ * \addtogroup profile
+ * \{
+ */
+
+#include "profile.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+#include "../common/gbmmap.h"
+#include "map.h"
+
+/** Room left in ROM 0 for the trampolines of the far calls */
+#define ROM_0_MARGIN    0x400
+
+/** Symbol of the .sym file of the profiled ROM */
+typedef struct old_sym_s
+{
+    int   bank;
+    int   address;
+    char* name;
+} old_sym_t;
+
+/** Calls from a section to another one. The caller is NULL when the
+ * profile only gives the number of calls to a function. */
+typedef struct edge_s
+{
+    list_t* from;
+    list_t* to;
+    int     old_from;   /**< banks of the caller and the callee in the */
+    int     old_to;     /**< profiled ROM */
+    long    count;
+    int     line;       /**< line of the profile, to sort the edges */
+} edge_t;
+
+static edge_t*    edges = NULL;
+static int        num_edges = 0;
+static old_sym_t* old_syms = NULL;
+static int        num_old_syms = 0;
+static list_t**   sorted_symbols = NULL;
+static int        num_symbols = 0;
+static list_t**   candidates = NULL;    /**< sections placed by the profile */
+static long*      weights = NULL;
+static int*       leaders = NULL;       /**< clusters, as a union-find */
+static int*       cluster_sizes = NULL;
+static int        num_candidates = 0;
+
+static int      read_sym_file(const char* name);
+static list_t*  find_section_at(int bank, int address, int* found);
+static int      parse_address(const char* str, int* bank, int* address);
+static int      find_candidate(list_t* sect);
+static int      find_leader(int i);
+static int      bank_of(list_t* sect);
+static long     count_switches(int old);
+static int      compare_old_sym(const void* a, const void* b);
+static int      compare_symbol(const void* a, const void* b);
+static int      compare_candidate(const void* a, const void* b);
+static int      compare_density(const void* a, const void* b);
+static int      compare_edge(const void* a, const void* b);
+static int      compare_cluster(const void* a, const void* b);
+
+/*========================================================================*//**
+ * Read a profile. Each line gives a number of calls, either to a function,
+ * or from a call site to a function:
+ *
+ *     <bank>:<address> <count>
+ *     <bank>:<address> <bank>:<address> <count>
+ *
+ * Lines starting with ';' or '#' are comments. External symbols must have
+ * been linked.
+ *
+ * \param name: name of the profile
+ * \param sym_name: name of the .sym file of the profiled ROM
+ * \return 1 on success, 0 if the files cannot be read
+ *//*=========================================================================*/
+int load_profile(const char* name, const char* sym_name)
+{
+    FILE* file;
+    char line[256], a[32], b[32];
+    list_t* list;
+    int i, line_num = 0;
+
+    if (!read_sym_file(sym_name))
+        return 0;
+    if (!(file = fopen(name, "r")))
+    {
+        ccerr(E, "unable to open \"%s\"", name);
+        return 0;
+    }
+
+    for (list = lsymbols; list; list = list->next)
+        ++num_symbols;
+    sorted_symbols = (list_t**)mmalloc(sizeof(list_t*) * (num_symbols + 1));
+    for (i = 0, list = lsymbols; list; list = list->next)
+        sorted_symbols[i++] = list;
+    qsort(sorted_symbols, num_symbols, sizeof(list_t*), &compare_symbol);
+
+    while (fgets(line, sizeof(line), file))
+    {
+        edge_t edge;
+        int from_bank, from_addr, to_bank, to_addr, found = 1;
+        long count;
+
+        ++line_num;
+        if (line[0] == ';' || line[0] == '#' || sscanf(line, "%31s", a) < 1)
+            continue;
+
+        memset(&edge, 0, sizeof(edge_t));
+        edge.old_from = -1;
+        if (sscanf(line, "%31s %31s %ld", a, b, &count) == 3
+            && parse_address(a, &from_bank, &from_addr)
+            && parse_address(b, &to_bank, &to_addr))
+        {
+            edge.from = find_section_at(from_bank, from_addr, &found);
+            edge.old_from = from_bank;
+        }
+        else if (sscanf(line, "%31s %ld", a, &count) != 2
+                 || !parse_address(a, &to_bank, &to_addr))
+        {
+            ccerr(E, "%s:%d: invalid profile entry", name, line_num);
+            continue;
+        }
+
+        /* Calls made or received by functions removed since the profile
+         * was taken are ignored */
+        edge.to = find_section_at(to_bank, to_addr, &found);
+        edge.old_to = to_bank;
+        edge.count = count;
+        edge.line = line_num;
+        if (!found || count <= 0)
+            continue;
+
+        if ((num_edges & (num_edges - 1)) == 0)
+            edges = (edge_t*)mrealloc(edges, sizeof(edge_t)
+                                      * (num_edges ? num_edges * 2 : 16));
+        edges[num_edges++] = edge;
+    }
+
+    fclose(file);
+    return 1;
+}
+
+/*========================================================================*//**
+ * Place the sections of the profile in ROM 0 or in the switchable bank of
+ * their cluster. The sections bound to a bank are placed first.
+ *
+ * \param sections: list of all sections
+ * \param files: list of the file names
+ *//*=========================================================================*/
+void allocate_profiled(list_t* sections, list_t* files)
+{
+    list_t*  list;
+    int*     order;
+    int      i, j, num_order, max_cluster = 0;
+
+    allocate_floating(sections, files, 1);
+    reserve_header();
+
+    /* The candidates are the floating sections without a bank */
+    for (list = sections; list; list = list->next)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+        if (sect->type == rom && sect->bank_num == ANY_BANK
+            && !(list->flags & (SECT_DISCARDED | SECT_FOLDED | SECT_TREATED)))
+            ++num_candidates;
+    }
+    candidates = (list_t**)mmalloc(sizeof(list_t*) * (num_candidates + 1));
+    weights = (long*)mmalloc(sizeof(long) * (num_candidates + 1));
+    leaders = (int*)mmalloc(sizeof(int) * (num_candidates + 1));
+    cluster_sizes = (int*)mmalloc(sizeof(int) * (num_candidates + 1));
+    order = (int*)mmalloc(sizeof(int) * (num_candidates + 1));
+    for (i = 0, list = sections; list; list = list->next)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+        if (sect->type == rom && sect->bank_num == ANY_BANK
+            && !(list->flags & (SECT_DISCARDED | SECT_FOLDED | SECT_TREATED)))
+            candidates[i++] = list;
+    }
+    qsort(candidates, num_candidates, sizeof(list_t*), &compare_candidate);
+
+    /* Weight of a section: the calls it makes or receives from other
+     * sections */
+    memset(weights, 0, sizeof(long) * num_candidates);
+    for (i = 0; i < num_edges; ++i)
+    {
+        int from = find_candidate(edges[i].from);
+        int to = find_candidate(edges[i].to);
+
+        if (edges[i].from == edges[i].to)
+            continue;
+        if (from >= 0)
+            weights[from] += edges[i].count;
+        if (to >= 0)
+            weights[to] += edges[i].count;
+    }
+
+    /* The most called sections per byte go to ROM 0 */
+    for (i = num_order = 0; i < num_candidates; ++i)
+    {
+        if (weights[i] > 0)
+            order[num_order++] = i;
+    }
+    qsort(order, num_order, sizeof(int), &compare_density);
+    for (i = 0; i < num_order; ++i)
+    {
+        list_t* node = candidates[order[i]];
+        section_entry_t* sect = (section_entry_t*)node->data;
+
+        if (get_rom_free(0) - sect->data_size < ROM_0_MARGIN)
+            continue;
+        esetfile(list_at(files, node->file_id)->data);
+        sect->offset = allocate_in_bank(list_at(files, node->file_id)->data,
+                                        sect, 0);
+        if (sect->offset != ALLOC_FAILED)
+            node->flags |= SECT_TREATED;
+    }
+
+    /* Clusters of the remaining sections, joined along the most frequent
+     * calls while they fit in a bank */
+    for (i = 1; i < get_num_rom_banks(); ++i)
+    {
+        if (get_rom_free(i) > max_cluster)
+            max_cluster = get_rom_free(i);
+    }
+    for (i = 0; i < num_candidates; ++i)
+    {
+        leaders[i] = i;
+        cluster_sizes[i] = ((section_entry_t*)candidates[i]->data)->data_size;
+    }
+    qsort(edges, num_edges, sizeof(edge_t), &compare_edge);
+    for (i = 0; i < num_edges; ++i)
+    {
+        int from = find_candidate(edges[i].from);
+        int to = find_candidate(edges[i].to);
+
+        if (from < 0 || to < 0 || (candidates[from]->flags & SECT_TREATED)
+            || (candidates[to]->flags & SECT_TREATED))
+            continue;
+        from = find_leader(from);
+        to = find_leader(to);
+        if (from == to || cluster_sizes[from] + cluster_sizes[to] > max_cluster)
+            continue;
+        leaders[to] = from;
+        cluster_sizes[from] += cluster_sizes[to];
+        weights[from] += weights[to];
+    }
+
+    /* The heaviest clusters first, each one in the bank with the most free
+     * space. The sections which do not fit are left to allocate_floating. */
+    for (i = num_order = 0; i < num_candidates; ++i)
+    {
+        if (find_leader(i) == i && !(candidates[i]->flags & SECT_TREATED)
+            && weights[i] > 0)
+            order[num_order++] = i;
+    }
+    qsort(order, num_order, sizeof(int), &compare_cluster);
+    for (i = 0; i < num_order; ++i)
+    {
+        int bank = 0, k;
+
+        for (k = 1; k < get_num_rom_banks(); ++k)
+        {
+            if (get_rom_free(k) >= cluster_sizes[order[i]]
+                && (!bank || get_rom_free(k) > get_rom_free(bank)))
+                bank = k;
+        }
+        if (!bank)
+            continue;
+
+        for (j = 0; j < num_candidates; ++j)
+        {
+            list_t* node = candidates[j];
+            section_entry_t* sect = (section_entry_t*)node->data;
+
+            if (find_leader(j) != order[i] || (node->flags & SECT_TREATED))
+                continue;
+            esetfile(list_at(files, node->file_id)->data);
+            sect->offset = allocate_in_bank(list_at(files, node->file_id)->data,
+                                            sect, bank);
+            if (sect->offset != ALLOC_FAILED)
+                node->flags |= SECT_TREATED;
+        }
+    }
+
+    free(order);
+}
+
+/*========================================================================*//**
+ * Print the number of bank switches estimated from the profile, with the
+ * layout of the profiled ROM and with the new one. Only the calls between
+ * two different switchable banks switch banks.
+ *//*=========================================================================*/
+void print_bank_switches()
+{
+    long before = count_switches(1), after = count_switches(0);
+
+    printf("Estimated bank switches: %ld, %ld with the profiled layout "
+           "(%ld saved)\n", after, before, before - after);
+}
+
+void free_profile()
+{
+    int i;
+
+    for (i = 0; i < num_old_syms; ++i)
+        free(old_syms[i].name);
+    free(old_syms);
+    free(edges);
+    free(sorted_symbols);
+    free(candidates);
+    free(weights);
+    free(leaders);
+    free(cluster_sizes);
+    old_syms = NULL;
+    edges = NULL;
+    sorted_symbols = NULL;
+    candidates = NULL;
+    weights = NULL;
+    leaders = NULL;
+    cluster_sizes = NULL;
+    num_old_syms = 0;
+    num_edges = 0;
+    num_symbols = 0;
+    num_candidates = 0;
+}
+
+/*========================================================================*//**
+ * Read the symbols of the profiled ROM, as written by gbld -g
+ *//*=========================================================================*/
+int read_sym_file(const char* name)
+{
+    FILE* file;
+    char line[256], id[64];
+    int bank, address;
+
+    if (!(file = fopen(name, "r")))
+    {
+        ccerr(E, "unable to open \"%s\", the symbols of the profiled ROM",
+              name);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "%x:%x %63s", &bank, &address, id) != 3)
+            continue;
+        if ((num_old_syms & (num_old_syms - 1)) == 0)
+            old_syms = (old_sym_t*)mrealloc(old_syms, sizeof(old_sym_t)
+                                    * (num_old_syms ? num_old_syms * 2 : 16));
+        old_syms[num_old_syms].bank = bank;
+        old_syms[num_old_syms].address = address;
+        old_syms[num_old_syms].name = (char*)mmalloc(strlen(id) + 1);
+        strcpy(old_syms[num_old_syms++].name, id);
+    }
+
+    fclose(file);
+    qsort(old_syms, num_old_syms, sizeof(old_sym_t), &compare_old_sym);
+    return 1;
+}
+
+/*========================================================================*//**
+ * Find the section now holding the function found at an address of the
+ * profiled ROM: the last symbol of the .sym file before this address
+ *
+ * \param found: set to 0 if the function no longer exists
+ * \return the section, NULL if it is not found
+ *//*=========================================================================*/
+list_t* find_section_at(int bank, int address, int* found)
+{
+    int lo = 0, hi = num_old_syms - 1, sym = -1;
+    const char* name;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const old_sym_t* s = old_syms + mid;
+
+        if (s->bank < bank || (s->bank == bank && s->address <= address))
+        {
+            if (s->bank == bank)
+                sym = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    if (sym < 0)
+    {
+        *found = 0;
+        return NULL;
+    }
+
+    /* Global symbols are sorted before local ones of the same name */
+    name = old_syms[sym].name;
+    lo = 0;
+    hi = num_symbols - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp((char*)((symbol_entry_t*)sorted_symbols[mid]->data)
+                         ->id, name);
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    if (lo < num_symbols)
+    {
+        list_t* node = sorted_symbols[lo];
+        symbol_entry_t* s = (symbol_entry_t*)node->data;
+        list_t* sect;
+
+        if (strcmp((char*)s->id, name) == 0 && s->type != _extern
+            && (sect = get_section_node(node->file_id, s->section_id))
+            && !(sect->flags & SECT_DISCARDED))
+            return sect;
+    }
+
+    *found = 0;
+    return NULL;
+}
+
+int parse_address(const char* str, int* bank, int* address)
+{
+    char end;
+    return sscanf(str, "%x:%x%c", bank, address, &end) == 2;
+}
+
+/*========================================================================*//**
+ * \return index of a section among the candidates, -1 if it is not one
+ *//*=========================================================================*/
+int find_candidate(list_t* sect)
+{
+    int lo = 0, hi = num_candidates - 1;
+
+    while (sect && lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int cmp = compare_candidate(candidates + mid, &sect);
+
+        if (cmp == 0)
+            return candidates[mid] == sect ? mid : -1;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+int find_leader(int i)
+{
+    while (leaders[i] != i)
+        i = leaders[i] = leaders[leaders[i]];
+    return i;
+}
+
+/*========================================================================*//**
+ * \return bank of a section placed: 0 for ROM 0, the number of its
+ * switchable bank otherwise
+ *//*=========================================================================*/
+int bank_of(list_t* sect)
+{
+    section_entry_t* s = (section_entry_t*)sect->data;
+
+    if (s->offset == ALLOC_FAILED || get_space(s->offset) != rom_n)
+        return 0;
+    return s->bank_num + 1;
+}
+
+/*========================================================================*//**
+ * \param old: nonzero to count the bank switches of the profiled layout
+ *//*=========================================================================*/
+long count_switches(int old)
+{
+    long count = 0;
+    int i;
+
+    for (i = 0; i < num_edges; ++i)
+    {
+        int from, to;
+
+        if (!edges[i].from)
+            continue;
+        from = old ? edges[i].old_from : bank_of(edges[i].from);
+        to = old ? edges[i].old_to : bank_of(edges[i].to);
+        if (from > 0 && to > 0 && from != to)
+            count += edges[i].count;
+    }
+
+    return count;
+}
+
+int compare_old_sym(const void* a, const void* b)
+{
+    const old_sym_t* sa = (const old_sym_t*)a;
+    const old_sym_t* sb = (const old_sym_t*)b;
+
+    if (sa->bank != sb->bank)
+        return sa->bank - sb->bank;
+    return sa->address - sb->address;
+}
+
+int compare_symbol(const void* a, const void* b)
+{
+    const symbol_entry_t* sa = (*(list_t**)a)->data;
+    const symbol_entry_t* sb = (*(list_t**)b)->data;
+    int cmp = strcmp((char*)sa->id, (char*)sb->id);
+
+    if (cmp)
+        return cmp;
+    if ((sa->type == _global) != (sb->type == _global))
+        return sa->type == _global ? -1 : 1;
+    return (sa->type == _extern) - (sb->type == _extern);
+}
+
+int compare_candidate(const void* a, const void* b)
+{
+    const list_t* la = *(list_t**)a;
+    const list_t* lb = *(list_t**)b;
+
+    if (la->file_id != lb->file_id)
+        return la->file_id - lb->file_id;
+    return ((section_entry_t*)la->data)->id
+           - ((section_entry_t*)lb->data)->id;
+}
+
+/*========================================================================*//**
+ * Order the candidates by calls per byte, the densest first
+ *//*=========================================================================*/
+int compare_density(const void* a, const void* b)
+{
+    int ia = *(const int*)a, ib = *(const int*)b;
+    double da = (double)weights[ia]
+                / (((section_entry_t*)candidates[ia]->data)->data_size + 1);
+    double db = (double)weights[ib]
+                / (((section_entry_t*)candidates[ib]->data)->data_size + 1);
+
+    if (da != db)
+        return da > db ? -1 : 1;
+    return ia - ib;
+}
+
+int compare_edge(const void* a, const void* b)
+{
+    const edge_t* ea = (const edge_t*)a;
+    const edge_t* eb = (const edge_t*)b;
+
+    if (ea->count != eb->count)
+        return ea->count > eb->count ? -1 : 1;
+    return ea->line - eb->line;
+}
+
+int compare_cluster(const void* a, const void* b)
+{
+    int ia = *(const int*)a, ib = *(const int*)b;
+
+    if (weights[ia] != weights[ib])
+        return weights[ia] > weights[ib] ? -1 : 1;
+    return ia - ib;
+}
+
+/**
+ * \} profile
+ * \} gbld
+ */
@@ -0,0 +1,23 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup profile
+ * \{
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "lists.h"
+
+int  load_profile(const char* name, const char* sym_name);
+void allocate_profiled(list_t* sections, list_t* files);
+void print_bank_switches();
+void free_profile();
+
+#endif
+
+/**
+ * \} profile
+ * \} gbld
+ */
@@ -8,13 +8,25 @@
 
 #include "rom.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../common/utils.h"
 #include "../common/gbmmap.h"
+#include "../common/errors.h"
 
-#define header_address          0x0104
-#define header_size             76
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+#define header_address          ROM_HEADER_ADDRESS
+#define header_size             ROM_HEADER_SIZE
 #define header_title            48
 #define header_gb_type          63
 #define header_cartrige_type    67
@@ -23,8 +35,9 @@
 #define header_checksum         73
 #define header_glob_checksum_hi 74
 #define header_glob_checksum_lo 75
+#define header_logo_size        48
 
-static unsigned char rom_header[76] =
+static unsigned char rom_header[header_size] =
 {
     0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
     0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
@@ -47,92 +60,353 @@ static unsigned char rom_header[76] =
     0x00, 0x00                  /* Global checksum */
 };
 
-static unsigned char* rombanks[MAX_ROM_BANKS];
-static unsigned char dummy[ROM_BANK_SIZE];
-static int max_rom_bank;
+static unsigned char* rom = NULL;       /**< image of the whole ROM */
+static long           rom_size = 0;
+static unsigned       rom_sum = 0;      /**< sum of all the bytes of the ROM */
+static int            rom_mapped = 0;
+#ifndef _WIN32
+static int            rom_fd = -1;
+#endif
+static char*          rom_name = NULL;
+
+static int  map_rom(const char* name, int create);
+static void put_bytes(unsigned char* dest, const unsigned char* src,
+                      unsigned size);
 
 void init_rom()
 {
-    unsigned i;
-    for (i = 0; i < MAX_ROM_BANKS; ++i)
-        rombanks[i] = NULL;
-    rombanks[0] = (unsigned char*)mmalloc(ROM_BANK_SIZE);
-    rombanks[1] = (unsigned char*)mmalloc(ROM_BANK_SIZE);
-    memset(rombanks[0], 0, ROM_BANK_SIZE);
-    memset(rombanks[1], 0, ROM_BANK_SIZE);
-    max_rom_bank = 1;
+    rom = NULL;
+    rom_size = (long)get_num_rom_banks() * ROM_BANK_SIZE;
+    rom_sum = 0;
 }
 
+/*========================================================================*//**
+ * Release the ROM image without writing it
+ *//*=========================================================================*/
 void free_rom()
 {
-    int i;
-    for (i = 0; i < max_rom_bank; ++i)
-        free(rombanks[i]);
+#ifndef _WIN32
+    if (rom_mapped)
+    {
+        munmap(rom, rom_size);
+        close(rom_fd);
+        rom_fd = -1;
+    }
+    else
+#endif
+        free(rom);
+    rom = NULL;
+    rom_mapped = 0;
+    free(rom_name);
+    rom_name = NULL;
 }
 
-unsigned char* get_rom_from_org(int org)
+/*========================================================================*//**
+ * Create the output file with the size of the cartridge and map it, so that
+ * the sections are written straight into it. Does nothing if the previous
+ * ROM has been loaded to be patched.
+ *
+ * \param name: name of the output file
+ *//*=========================================================================*/
+void open_rom(const char* name)
 {
-    if (org > 0x8000)
-        return dummy;
-    return rombanks[org / ROM_BANK_SIZE];
+    if (rom)
+        return;
+
+    if (!map_rom(name, 1))
+    {
+        /* Files which cannot be mapped are written by close_rom */
+        rom = (unsigned char*)mmalloc(rom_size);
+        memset(rom, 0, rom_size);
+        rom_name = (char*)mmalloc(strlen(name) + 1);
+        strcpy(rom_name, name);
+    }
+    rom_sum = 0;
+}
+
+/*========================================================================*//**
+ * Write the ROM image to its file if it is not mapped, and release it
+ *//*=========================================================================*/
+void close_rom()
+{
+    if (!rom_mapped && rom && rom_name)
+    {
+        FILE* file;
+
+        if (!(file = fopen(rom_name, "wb")))
+            ccerr(F, "unable to open \"%s\"", rom_name);
+        if (fwrite(rom, rom_size, 1, file) != 1)
+            ccerr(E, "unable to write \"%s\"", rom_name);
+        fclose(file);
+    }
+    free_rom();
 }
 
 unsigned char* get_rom_bank(int bank)
 {
-    if (bank < MAX_ROM_BANKS)
+    if (rom && bank >= 0 && bank < get_num_rom_banks())
+        return rom + (long)bank * ROM_BANK_SIZE;
+    return NULL;
+}
+
+/*========================================================================*//**
+ * Copy data into a ROM bank, keeping the global checksum up to date
+ *
+ * \param bank: number of the bank
+ * \param offset: offset of the data in the bank
+ *//*=========================================================================*/
+void write_rom(int bank, unsigned offset, const unsigned char* data,
+               unsigned size)
+{
+    unsigned char* dest = get_rom_bank(bank);
+
+    if (!dest || offset >= ROM_BANK_SIZE)
+        return;
+    if (size > ROM_BANK_SIZE - offset)
+        size = ROM_BANK_SIZE - offset;
+    put_bytes(dest + offset, data, size);
+}
+
+/*========================================================================*//**
+ * Map a previously linked ROM, to be patched in place
+ *
+ * \return 1 on success, 0 if the file cannot be read or does not have the
+ * size of the current cartridge
+ *//*=========================================================================*/
+int load_rom(const char* name)
+{
+    FILE* file;
+    long size;
+
+    if (!(file = fopen(name, "rb")))
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size != rom_size)
     {
-        if (!rombanks[bank])
+        fclose(file);
+        return 0;
+    }
+
+    if (map_rom(name, 0))
+        fclose(file);
+    else
+    {
+        rom = (unsigned char*)mmalloc(rom_size);
+        rom_name = (char*)mmalloc(strlen(name) + 1);
+        strcpy(rom_name, name);
+        if (fread(rom, rom_size, 1, file) != 1)
         {
-            rombanks[bank] = (unsigned char*)mmalloc(ROM_BANK_SIZE);
-            memset(rombanks[bank], 0, ROM_BANK_SIZE);
+            fclose(file);
+            free_rom();
+            return 0;
         }
-        if (bank > max_rom_bank)
-            max_rom_bank = bank;
-        
-        return rombanks[bank];
+        fclose(file);
     }
-    return NULL;
+
+    /* The global checksum of the previous ROM is the sum of all its other
+     * bytes */
+    rom_sum = (rom[header_address + header_glob_checksum_hi] << 8)
+              + rom[header_address + header_glob_checksum_lo]
+              + rom[header_address + header_glob_checksum_hi]
+              + rom[header_address + header_glob_checksum_lo];
+    return 1;
 }
 
 void fix_rom()
 {
-    unsigned int i, j;
+    unsigned int i;
     unsigned char checksum = 0;
-    unsigned int global_checksum = 0;
+    unsigned int global_checksum;
     cartridge_t cart = get_cartridge();
+    unsigned char* bank0 = get_rom_bank(0);
     
     rom_header[header_gb_type] = cart.gb_type;
     rom_header[header_cartrige_type] = cart.cart_type;
     rom_header[header_rom_size] = cart.rom_size;
     rom_header[header_ram_size] = cart.ram_size;
     memcpy(rom_header+header_title, cart.title, 11);
-    memcpy(rombanks[0]+header_address, rom_header, header_size);
-    
-    for (i = header_address+header_title; i<header_address+header_checksum; ++i)
-        checksum -= rombanks[0][i] + 1;
-    rombanks[0][header_address+header_checksum] = checksum;
+    for (i = header_title; i < header_checksum; ++i)
+        checksum -= rom_header[i] + 1;
+    rom_header[header_checksum] = checksum;
+
+    /* The global checksum does not include its own bytes */
+    put_bytes(bank0 + header_address, rom_header, header_glob_checksum_hi);
+    global_checksum = rom_sum - bank0[header_address+header_glob_checksum_hi]
+                      - bank0[header_address+header_glob_checksum_lo];
+    rom_header[header_glob_checksum_hi] = (global_checksum >> 8) & 0xFF;
+    rom_header[header_glob_checksum_lo] = global_checksum & 0xFF;
+    put_bytes(bank0 + header_address + header_glob_checksum_hi,
+              rom_header + header_glob_checksum_hi, 2);
+}
+
+/*========================================================================*//**
+ * Check the logo, the size, the header checksum and the global checksum of a
+ * ROM
+ *
+ * \param name: name of the ROM file
+ * \return 1 if the ROM is valid, 0 otherwise. The errors are reported.
+ *//*=========================================================================*/
+int verify_rom(const char* name)
+{
+    FILE* file;
+    unsigned char* data;
+    unsigned char* header;
+    unsigned char checksum = 0;
+    unsigned global_checksum, stored;
+    long size;
+    int i, ok = 1, mapped = 0;
+
+    esetfile(name);
+    if (!(file = fopen(name, "rb")))
+    {
+        ccerr(E, "unable to open \"%s\"", name);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < header_address + header_size)
+    {
+        fclose(file);
+        ccerr(E, "not a ROM, %ld bytes only", size);
+        return 0;
+    }
+
+#ifndef _WIN32
+    data = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                                fileno(file), 0);
+    mapped = (void*)data != MAP_FAILED;
+#endif
+    if (!mapped)
+    {
+        data = (unsigned char*)mmalloc(size);
+        if (fread(data, size, 1, file) != 1)
+            ccerr(F, "unable to read \"%s\"", name);
+    }
+    header = data + header_address;
 
-    for (i = 0; i <= max_rom_bank; ++i)
+    if (memcmp(header, rom_header, header_logo_size) != 0)
     {
-        if (rombanks[i] == NULL)
-            continue;
-        for (j = 0; j < ROM_BANK_SIZE; ++j)
+        ccerr(E, "invalid logo");
+        ok = 0;
+    }
+
+    if (header[header_rom_size] > _8M
+        || size != 0x8000L << header[header_rom_size])
+    {
+        ccerr(E, "size of %ld bytes, the header declares %ld", size,
+              header[header_rom_size] > _8M
+              ? 0L : 0x8000L << header[header_rom_size]);
+        ok = 0;
+    }
+
+    for (i = header_title; i < header_checksum; ++i)
+        checksum -= header[i] + 1;
+    if (checksum != header[header_checksum])
+    {
+        ccerr(E, "header checksum is $%02X, expected $%02X",
+              header[header_checksum], checksum);
+        ok = 0;
+    }
+
+    stored = (header[header_glob_checksum_hi] << 8)
+             | header[header_glob_checksum_lo];
+    global_checksum = (sum_bytes(data, size) - header[header_glob_checksum_hi]
+                       - header[header_glob_checksum_lo]) & 0xFFFF;
+    if (global_checksum != stored)
+    {
+        ccerr(E, "global checksum is $%04X, expected $%04X", stored,
+              global_checksum);
+        ok = 0;
+    }
+
+#ifndef _WIN32
+    if (mapped)
+        munmap(data, size);
+    else
+#endif
+        free(data);
+    fclose(file);
+    return ok;
+}
+
+/*========================================================================*//**
+ * Sum of a block of bytes, 16 bytes at a time with SSE2
+ *//*=========================================================================*/
+unsigned long sum_bytes(const unsigned char* data, long size)
+{
+    unsigned long sum = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+
+    /* psadbw adds the 8 bytes of each half of a block into a 64 bits
+     * lane */
+    for (; size >= 16; size -= 16, data += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(
+                  _mm_loadu_si128((const __m128i*)data), zero));
+    sum = (unsigned long)(unsigned)_mm_cvtsi128_si32(acc)
+          + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+    while (size--)
+        sum += *data++;
+    return sum;
+}
+
+/*========================================================================*//**
+ * Map a file holding the whole ROM
+ *
+ * \param create: nonzero to create the file, filled with zeros, 0 to map the
+ * existing one
+ * \return 1 on success, 0 if the file could not be mapped
+ *//*=========================================================================*/
+int map_rom(const char* name, int create)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    int fd;
+    void* p;
+
+    if (create)
+    {
+        /* Truncating first leaves a file of zeros without writing them */
+        if ((fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+            ccerr(F, "unable to open \"%s\"", name);
+        if (ftruncate(fd, rom_size) < 0)
         {
-            if (i == 0 && (j == header_address+header_glob_checksum_hi
-                           || j == header_address+header_glob_checksum_lo))
-            {
-                continue;
-            }
-            global_checksum += rombanks[i][j];
+            close(fd);
+            return 0;
         }
-        
-        global_checksum &= 0xFFFF;
     }
-    
-    rombanks[0][header_address+header_glob_checksum_lo]
-        = global_checksum & 0xFF;
-    rombanks[0][header_address+header_glob_checksum_hi]
-        = (global_checksum >> 8) & 0xFF;
+    else if ((fd = open(name, O_RDWR)) < 0)
+        return 0;
+
+    p = mmap(NULL, rom_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+
+    rom = (unsigned char*)p;
+    rom_fd = fd;
+    rom_mapped = 1;
+    return 1;
+#endif
+}
+
+void put_bytes(unsigned char* dest, const unsigned char* src, unsigned size)
+{
+    while (size--)
+    {
+        rom_sum += *src - *dest;
+        *dest++ = *src++;
+    }
 }
 
 /**
@@ -8,11 +8,20 @@
 #ifndef ROM_H
 #define ROM_H
 
+#define ROM_HEADER_ADDRESS  0x0104  /**< Cartridge header, written by fix_rom */
+#define ROM_HEADER_SIZE     76
+
 void           init_rom();
 void           free_rom();
-unsigned char* get_rom_from_org(int org);
+void           open_rom(const char* name);
+void           close_rom();
 unsigned char* get_rom_bank(int bank);
+void           write_rom(int bank, unsigned offset, const unsigned char* data,
+                         unsigned size);
+int            load_rom(const char* name);
 void           fix_rom();
+int            verify_rom(const char* name);
+unsigned long  sum_bytes(const unsigned char* data, long size);
 
 #endif
 
@@ -0,0 +1,827 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \defgroup state Incremental link state
+ * The state of a link is saved with the ROM: a hash of each input file (the
+ * hash of the inputs in the header of an object which has one), the
+ * placement of every section, the symbols, the sections each file refers to
+ * and the far call trampolines. On the next link, the unchanged files are
+ * restored from the state instead of being read. If the changed files kept
+ * the shape of their sections, their global symbols, their references and
+ * their far calls, nothing moves: their sections are written over the
+ * previous ROM and only their relocations are applied. Otherwise everything
+ * is linked again.
+ * \addtogroup state
+ * \{
+ */
+
+#include "state.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/utils.h"
+#include "../common/errors.h"
+#include "../common/options.h"
+#include "../common/files.h"
+#include "../common/gbmmap.h"
+#include "lists.h"
+#include "map.h"
+#include "rom.h"
+#include "farcall.h"
+
+#define STATE_SIGNATURE "gbld-state"
+#define STATE_VERSION   1
+
+typedef struct state_section_s
+{
+    int file;
+    int id;
+    int type;
+    int bank_req;   /**< bank number read from the object file */
+    int align;
+    int size;
+    int offset;
+    int bank;       /**< bank number after allocation */
+    int flags;
+} state_section_t;
+
+typedef struct state_symbol_s
+{
+    int  file;
+    int  sym_id;
+    int  type;
+    int  section;
+    int  offset;
+    char name[32];
+} state_symbol_t;
+
+/** Sorted reference of a file to a section (ref) or to a trampoline (use) */
+typedef struct state_ref_s
+{
+    int file;
+    int a;
+    int b;
+} state_ref_t;
+
+typedef struct state_far_s
+{
+    int      caller_bank;
+    int      target_bank;
+    int      target_addr;
+    unsigned address;
+} state_far_t;
+
+typedef struct array_s
+{
+    void*  data;
+    int    count;
+    int    capacity;
+    size_t size;
+} array_t;
+
+static int           loaded = 0;        /**< a state has been read */
+static unsigned long config_hash;
+static unsigned long rom_hash;
+static int           num_inputs;        /**< number of input files recorded */
+static array_t       files = { NULL, 0, 0, sizeof(char*) };
+static array_t       hashes = { NULL, 0, 0, sizeof(unsigned long) };
+static array_t       sections_rec = { NULL, 0, 0, sizeof(state_section_t) };
+static array_t       symbols_rec = { NULL, 0, 0, sizeof(state_symbol_t) };
+static array_t       refs = { NULL, 0, 0, sizeof(state_ref_t) };
+static array_t       uses = { NULL, 0, 0, sizeof(state_ref_t) };
+static array_t       fars = { NULL, 0, 0, sizeof(state_far_t) };
+
+static array_t       input_hashes = { NULL, 0, 0, sizeof(unsigned long) };
+static array_t       restored = { NULL, 0, 0, sizeof(int) };
+static array_t       captured = { NULL, 0, 0, sizeof(int) };
+static array_t       linked_refs = { NULL, 0, 0, sizeof(state_ref_t) };
+static array_t       linked_uses = { NULL, 0, 0, sizeof(state_ref_t) };
+
+static void*         push(array_t* array);
+static void*         at(array_t* array, int index);
+static void          clear(array_t* array);
+static unsigned long hash_contents(unsigned long hash, FILE* file);
+static unsigned long hash_config();
+static unsigned long hash_rom();
+static int           compare_ref(const void* a, const void* b);
+static void          collect_refs(int file_id, array_t* out);
+static void          collect_uses(int file_id, array_t* out);
+static int           same_refs(array_t* recorded, array_t* current,
+                               int file_id);
+static list_t*       find_symbol(int file_id, int sym_id);
+
+/*========================================================================*//**
+ * Read the state of the previous link
+ *
+ * \param name: name of the state file
+ * \param inputs: number of input files of the current link
+ * \return 1 if the previous ROM may be patched, 0 if the state is missing or
+ * was saved with other options or another list of files
+ *//*=========================================================================*/
+int load_state(const char* name, int inputs)
+{
+    FILE* file;
+    char  line[512], word[16];
+    int   version;
+
+    free_state();
+    if (!(file = fopen(name, "r")))
+        return 0;
+
+    if (!fgets(line, sizeof(line), file)
+        || sscanf(line, STATE_SIGNATURE " %d", &version) != 1
+        || version != STATE_VERSION)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "%15s", word) != 1)
+            continue;
+
+        if (strcmp(word, "config") == 0)
+            sscanf(line, "%*s %lx", &config_hash);
+        else if (strcmp(word, "rom") == 0)
+            sscanf(line, "%*s %lx", &rom_hash);
+        else if (strcmp(word, "inputs") == 0)
+            sscanf(line, "%*s %d", &num_inputs);
+        else if (strcmp(word, "file") == 0)
+        {
+            unsigned long hash;
+            int n = 0;
+            char* p;
+            sscanf(line, "%*s %lx %n", &hash, &n);
+            p = line + n;
+            p[strcspn(p, "\r\n")] = 0;
+            *(char**)push(&files) = (char*)mmalloc(strlen(p) + 1);
+            strcpy(*(char**)at(&files, files.count - 1), p);
+            *(unsigned long*)push(&hashes) = hash;
+        }
+        else if (strcmp(word, "section") == 0)
+        {
+            state_section_t* s = (state_section_t*)push(&sections_rec);
+            sscanf(line, "%*s %d %d %d %d %d %d %x %d %d", &s->file, &s->id,
+                   &s->type, &s->bank_req, &s->align, &s->size, &s->offset,
+                   &s->bank, &s->flags);
+        }
+        else if (strcmp(word, "symbol") == 0)
+        {
+            state_symbol_t* s = (state_symbol_t*)push(&symbols_rec);
+            memset(s->name, 0, sizeof(s->name));
+            sscanf(line, "%*s %d %d %d %d %d %31s", &s->file, &s->sym_id,
+                   &s->type, &s->section, &s->offset, s->name);
+        }
+        else if (strcmp(word, "ref") == 0)
+        {
+            state_ref_t* r = (state_ref_t*)push(&refs);
+            sscanf(line, "%*s %d %d %d", &r->file, &r->a, &r->b);
+        }
+        else if (strcmp(word, "use") == 0)
+        {
+            state_ref_t* r = (state_ref_t*)push(&uses);
+            sscanf(line, "%*s %d %d %x", &r->file, &r->a, &r->b);
+        }
+        else if (strcmp(word, "far") == 0)
+        {
+            state_far_t* f = (state_far_t*)push(&fars);
+            sscanf(line, "%*s %d %d %x %x", &f->caller_bank, &f->target_bank,
+                   &f->target_addr, &f->address);
+        }
+    }
+
+    fclose(file);
+    loaded = 1;
+
+    return num_inputs == inputs && config_hash == hash_config();
+}
+
+/*========================================================================*//**
+ * Check that the ROM loaded is the one produced by the previous link
+ *//*=========================================================================*/
+int check_state_rom()
+{
+    return loaded && rom_hash == hash_rom();
+}
+
+/*========================================================================*//**
+ * Save the state of the link, after the ROM has been written
+ *
+ * \param name: name of the state file
+ *//*=========================================================================*/
+void save_state(const char* name)
+{
+    FILE*    file;
+    list_t*  list;
+    int      i;
+
+    if (!(file = fopen(name, "w")))
+    {
+        ccerr(E, "unable to open \"%s\"", name);
+        return;
+    }
+
+    fprintf(file, "%s %d\n", STATE_SIGNATURE, STATE_VERSION);
+    fprintf(file, "config %08lx\n", hash_config());
+    fprintf(file, "rom %08lx\n", hash_rom());
+    fprintf(file, "inputs %d\n", input_hashes.count);
+
+    for (i = 0, list = lfiles; list; list = list->next, ++i)
+    {
+        unsigned long hash = i < input_hashes.count
+                             ? *(unsigned long*)at(&input_hashes, i) : 0;
+        fprintf(file, "file %08lx %s\n", hash, (char*)list->data);
+    }
+
+    for (i = 0, list = lsections; list; list = list->next, ++i)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+        int bank_req = i < captured.count ? *(int*)at(&captured, i)
+                                          : sect->bank_num;
+        fprintf(file, "section %d %d %d %d %d %d %04x %d %d\n",
+                list->file_id, sect->id, sect->type, bank_req, sect->align,
+                sect->data_size, sect->offset, sect->bank_num,
+                list->flags & (SECT_DISCARDED | SECT_FOLDED | SECT_SHARED
+                               | SECT_CONSTANTS));
+    }
+
+    for (list = lsymbols; list; list = list->next)
+    {
+        symbol_entry_t* sym = (symbol_entry_t*)list->data;
+        if (sym->type == _extern)
+            continue;
+        fprintf(file, "symbol %d %d %d %d %d %s\n", list->file_id,
+                sym->sym_id, sym->type, sym->section_id, sym->offset,
+                sym->id);
+    }
+
+    /* The references of the files restored are the recorded ones */
+    for (i = 0; i < refs.count; ++i)
+    {
+        state_ref_t* r = (state_ref_t*)at(&refs, i);
+        if (r->file < restored.count && *(int*)at(&restored, r->file))
+            fprintf(file, "ref %d %d %d\n", r->file, r->a, r->b);
+    }
+    for (i = 0; i < linked_refs.count; ++i)
+    {
+        state_ref_t* r = (state_ref_t*)at(&linked_refs, i);
+        fprintf(file, "ref %d %d %d\n", r->file, r->a, r->b);
+    }
+    for (i = 0; i < uses.count; ++i)
+    {
+        state_ref_t* r = (state_ref_t*)at(&uses, i);
+        if (r->file < restored.count && *(int*)at(&restored, r->file))
+            fprintf(file, "use %d %d %04x\n", r->file, r->a, r->b);
+    }
+    for (i = 0; i < linked_uses.count; ++i)
+    {
+        state_ref_t* r = (state_ref_t*)at(&linked_uses, i);
+        fprintf(file, "use %d %d %04x\n", r->file, r->a, r->b);
+    }
+
+    for (i = 0; ; ++i)
+    {
+        int caller_bank, target_bank, target_addr;
+        unsigned address;
+        if (!get_trampoline(i, &caller_bank, &target_bank, &target_addr,
+                            &address))
+            break;
+        fprintf(file, "far %d %d %04x %04x\n", caller_bank, target_bank,
+                target_addr, address);
+    }
+
+    fclose(file);
+}
+
+/*========================================================================*//**
+ * Record the sections and the trampolines the files read refer to. Must be
+ * called after the relocations, while the sections still hold their data.
+ *//*=========================================================================*/
+void capture_links()
+{
+    array_t cur = { NULL, 0, 0, sizeof(state_ref_t) };
+    int f, i;
+
+    linked_refs.count = 0;
+    linked_uses.count = 0;
+    for (f = 0; f < input_hashes.count; ++f)
+    {
+        if (*(int*)at(&restored, f))
+            continue;
+        collect_refs(f, &cur);
+        for (i = 0; i < cur.count; ++i)
+            memcpy(push(&linked_refs), at(&cur, i), cur.size);
+        collect_uses(f, &cur);
+        for (i = 0; i < cur.count; ++i)
+            memcpy(push(&linked_uses), at(&cur, i), cur.size);
+    }
+
+    clear(&cur);
+}
+
+void free_state()
+{
+    int i;
+
+    for (i = 0; i < files.count; ++i)
+        free(*(char**)at(&files, i));
+    clear(&files);
+    clear(&hashes);
+    clear(&sections_rec);
+    clear(&symbols_rec);
+    clear(&refs);
+    clear(&uses);
+    clear(&fars);
+    clear(&input_hashes);
+    clear(&restored);
+    clear(&captured);
+    clear(&linked_refs);
+    clear(&linked_uses);
+    loaded = 0;
+}
+
+/*========================================================================*//**
+ * Hash an input file
+ *
+ * \param file_id: index of the file in the list of inputs
+ * \param name: name of the file
+ * \return 1 if the file is the one recorded with this index and did not
+ * change since the previous link
+ *//*=========================================================================*/
+int hash_input(int file_id, const char* name)
+{
+    unsigned long hash = HASH_INIT;
+    FILE* file;
+
+    while (input_hashes.count <= file_id)
+        *(unsigned long*)push(&input_hashes) = 0;
+    while (restored.count <= file_id)
+        *(int*)push(&restored) = 0;
+    *(int*)at(&restored, file_id) = 0;
+
+    if (!(file = fopen(name, "rb")))
+        return 0;
+    /* An object carrying the hash of its inputs is not read any further */
+    if (!read_obj_hash(file, &hash))
+    {
+        fseek(file, 0, SEEK_SET);
+        hash = hash_contents(HASH_INIT, file);
+    }
+    fclose(file);
+    *(unsigned long*)at(&input_hashes, file_id) = hash;
+
+    return loaded && file_id < num_inputs && file_id < files.count
+           && strcmp(*(char**)at(&files, file_id), name) == 0
+           && *(unsigned long*)at(&hashes, file_id) == hash;
+}
+
+/*========================================================================*//**
+ * Hash every input file, which must not include archives
+ *
+ * \return 1 if they are all the ones of the previous link and did not
+ * change since, the previous ROM being then the result of the link
+ *//*=========================================================================*/
+int inputs_unchanged()
+{
+    sourcefile_t* file;
+    int file_id = 0;
+    int unchanged = loaded;
+
+    file_first();
+    while ((file = file_next()))
+        unchanged = hash_input(file_id++, file->name) && unchanged;
+    return unchanged;
+}
+
+/*========================================================================*//**
+ * Record the bank number of a section as read from its object file, before
+ * allocation. Must be called for each section, in the order of the sections
+ * list.
+ *//*=========================================================================*/
+void capture_section(section_entry_t* sect)
+{
+    *(int*)push(&captured) = sect->bank_num;
+}
+
+void reset_capture()
+{
+    clear(&captured);
+}
+
+/*========================================================================*//**
+ * Add the sections and symbols recorded for a file, already placed, instead
+ * of reading the file
+ *//*=========================================================================*/
+void restore_object(int file_id)
+{
+    char* filename;
+    int i;
+
+    filename = *(char**)at(&files, file_id);
+    list_add(&lfiles, file_id, strcpy((char*)mmalloc(strlen(filename) + 1),
+                                      filename), 0);
+    if (file_id < restored.count)
+        *(int*)at(&restored, file_id) = 1;
+
+    for (i = 0; i < sections_rec.count; ++i)
+    {
+        state_section_t* s = (state_section_t*)at(&sections_rec, i);
+        section_entry_t* sect;
+
+        if (s->file != file_id)
+            continue;
+        sect = (section_entry_t*)mmalloc(sizeof(section_entry_t));
+        sect->id = s->id;
+        sect->type = (section_type_t)s->type;
+        sect->offset = s->offset;
+        sect->bank_num = s->bank;
+        sect->align = s->align;
+        sect->data_size = s->size;
+        sect->flags = 0;
+        sect->data = NULL;
+        sect->data_pos = 0;
+        list_add(&lsections, file_id, sect, s->flags | SECT_TREATED);
+        *(int*)push(&captured) = s->bank_req;
+    }
+
+    for (i = 0; i < symbols_rec.count; ++i)
+    {
+        state_symbol_t* s = (state_symbol_t*)at(&symbols_rec, i);
+        symbol_entry_t* sym;
+
+        if (s->file != file_id)
+            continue;
+        sym = (symbol_entry_t*)mmalloc(sizeof(symbol_entry_t));
+        memset(sym, 0, sizeof(symbol_entry_t));
+        sym->sym_id = s->sym_id;
+        strcpy((char*)sym->id, s->name);
+        sym->hash = hash_name(s->name);
+        sym->section_id = s->section;
+        sym->offset = s->offset;
+        sym->type = (sym_type_t)s->type;
+        list_add(&lsymbols, file_id, sym, file_id);
+    }
+}
+
+/*========================================================================*//**
+ * Restore the files generated by the linker and the far call trampolines
+ *
+ * \param file_id: id of the first generated file
+ *//*=========================================================================*/
+void restore_generated(int file_id)
+{
+    int i;
+
+    for (i = file_id; i < files.count; ++i)
+        restore_object(i);
+
+    for (i = 0; i < fars.count; ++i)
+    {
+        state_far_t* f = (state_far_t*)at(&fars, i);
+        restore_far_call(f->caller_bank, f->target_bank, f->target_addr,
+                         f->address);
+    }
+}
+
+/*========================================================================*//**
+ * Check that the files which changed can be linked without moving anything,
+ * and give their sections the placement recorded. External symbols must
+ * have been linked.
+ *
+ * \return 1 if the previous ROM can be patched
+ *//*=========================================================================*/
+int validate_patch()
+{
+    list_t*  list;
+    array_t  cur = { NULL, 0, 0, sizeof(state_ref_t) };
+    int      f, i, ok = 1;
+
+    for (f = 0; ok && f < input_hashes.count; ++f)
+    {
+        if (*(int*)at(&restored, f))
+            continue;
+
+        /* Same sections, given the same placement */
+        i = 0;
+        for (list = lsections; ok && list; list = list->next)
+        {
+            section_entry_t* sect = (section_entry_t*)list->data;
+            state_section_t* s;
+
+            if (list->file_id != f)
+                continue;
+            while (i < sections_rec.count
+                   && ((state_section_t*)at(&sections_rec, i))->file != f)
+                ++i;
+            if (i == sections_rec.count)
+            {
+                ok = 0;
+                break;
+            }
+            s = (state_section_t*)at(&sections_rec, i++);
+            /* The copies of a folded section must stay identical */
+            if (s->id != sect->id || s->type != (int)sect->type
+                || s->bank_req != sect->bank_num || s->align != sect->align
+                || s->size != sect->data_size
+                || (s->flags & (SECT_FOLDED | SECT_SHARED)))
+            {
+                ok = 0;
+                break;
+            }
+            sect->offset = s->offset;
+            sect->bank_num = s->bank;
+            list->flags |= s->flags | SECT_TREATED;
+        }
+        while (ok && i < sections_rec.count)
+        {
+            if (((state_section_t*)at(&sections_rec, i++))->file == f)
+                ok = 0;
+        }
+
+        /* Same global symbols */
+        i = 0;
+        for (list = lsymbols; ok && list; list = list->next)
+        {
+            symbol_entry_t* sym = (symbol_entry_t*)list->data;
+            state_symbol_t* s;
+
+            if (list->file_id != f || sym->type != _global)
+                continue;
+            while (i < symbols_rec.count
+                   && (((state_symbol_t*)at(&symbols_rec, i))->file != f
+                       || ((state_symbol_t*)at(&symbols_rec, i))->type
+                          != _global))
+                ++i;
+            if (i == symbols_rec.count)
+            {
+                ok = 0;
+                break;
+            }
+            s = (state_symbol_t*)at(&symbols_rec, i++);
+            if (strcmp(s->name, (char*)sym->id) != 0
+                || s->section != sym->section_id || s->offset != sym->offset)
+                ok = 0;
+        }
+        for (; ok && i < symbols_rec.count; ++i)
+        {
+            state_symbol_t* s = (state_symbol_t*)at(&symbols_rec, i);
+            if (s->file == f && s->type == _global)
+                ok = 0;
+        }
+    }
+
+    /* Same sections referenced, so that --gc-sections keeps the same ones,
+     * and same far call trampolines used */
+    for (f = 0; ok && f < input_hashes.count; ++f)
+    {
+        if (*(int*)at(&restored, f))
+            continue;
+        collect_refs(f, &cur);
+        ok = same_refs(&refs, &cur, f);
+        if (ok)
+        {
+            collect_uses(f, &cur);
+            for (i = 0; i < cur.count; ++i)
+            {
+                if (((state_ref_t*)at(&cur, i))->b == ALLOC_FAILED)
+                    ok = 0;
+            }
+            ok = ok && same_refs(&uses, &cur, f);
+        }
+    }
+
+    clear(&cur);
+    return ok;
+}
+
+/*========================================================================*//**
+ * Record in the memory map the sections placed by the previous link
+ *//*=========================================================================*/
+void allocate_preserved()
+{
+    list_t* list;
+    int floating = 0;
+
+    for (list = lsections; list; list = list->next)
+    {
+        section_entry_t* sect = (section_entry_t*)list->data;
+        if ((list->flags & (SECT_DISCARDED | SECT_FOLDED))
+            || sect->offset == ALLOC_FAILED)
+            continue;
+        allocate_fixed((char*)list_at(lfiles, list->file_id)->data, sect);
+        floating |= sect->type == rom;
+    }
+
+    /* As allocate_floating does, keep the header free of floating sections */
+    if (floating)
+        reserve_header();
+}
+
+/*========================================================================*//**
+ * Collect the sections a file refers to through its relocations, as sorted
+ * (file, section) pairs without duplicates
+ *//*=========================================================================*/
+void collect_refs(int file_id, array_t* out)
+{
+    list_t* list;
+    int i, n = 0;
+
+    out->count = 0;
+    for (list = lrelocations; list; list = list->next)
+    {
+        reloc_entry_t* reloc = (reloc_entry_t*)list->data;
+        list_t* lsym;
+        symbol_entry_t* sym;
+        state_ref_t* r;
+
+        if (list->file_id != file_id)
+            continue;
+        if (!(lsym = find_symbol(file_id, reloc->sym_id)))
+            continue;
+        sym = (symbol_entry_t*)lsym->data;
+        r = (state_ref_t*)push(out);
+        r->file = file_id;
+        r->a = sym->type == _extern ? lsym->flags : lsym->file_id;
+        r->b = sym->section_id;
+    }
+
+    qsort(out->data, out->count, out->size, &compare_ref);
+    for (i = 0; i < out->count; ++i)
+    {
+        if (n == 0 || compare_ref(at(out, i), at(out, n - 1)) != 0)
+            memmove(at(out, n++), at(out, i), out->size);
+    }
+    out->count = n;
+}
+
+/*========================================================================*//**
+ * Collect the trampolines the far calls of a file go through, as sorted
+ * (file, 0, address) triples without duplicates. The address is
+ * ALLOC_FAILED for a far call without trampoline yet.
+ *//*=========================================================================*/
+void collect_uses(int file_id, array_t* out)
+{
+    list_t* list;
+    int i, n = 0;
+
+    out->count = 0;
+    for (list = lrelocations; list; list = list->next)
+    {
+        reloc_entry_t* reloc = (reloc_entry_t*)list->data;
+        section_entry_t* sect, * target_sect;
+        symbol_entry_t* sym;
+        list_t* lsym, * lsect;
+        state_ref_t* r;
+
+        if (list->file_id != file_id || reloc->flags != call_address)
+            continue;
+        lsect = get_section_node(file_id, reloc->section_id);
+        if (!lsect || (lsect->flags & (SECT_DISCARDED | SECT_FOLDED))
+            || !(lsym = find_symbol(file_id, reloc->sym_id)))
+            continue;
+        sect = (section_entry_t*)lsect->data;
+        sym = (symbol_entry_t*)lsym->data;
+        target_sect = get_section(sym->type == _extern ? lsym->flags
+                                                       : lsym->file_id,
+                                  sym->section_id);
+        if (!target_sect || !sect->data
+            || !is_far_call(sect, target_sect, reloc->flags))
+            continue;
+
+        r = (state_ref_t*)push(out);
+        r->file = file_id;
+        r->a = 0;
+        r->b = find_far_call(sect, reloc->offset, target_sect,
+                             target_sect->offset + sym->offset);
+    }
+
+    qsort(out->data, out->count, out->size, &compare_ref);
+    for (i = 0; i < out->count; ++i)
+    {
+        if (n == 0 || compare_ref(at(out, i), at(out, n - 1)) != 0)
+            memmove(at(out, n++), at(out, i), out->size);
+    }
+    out->count = n;
+}
+
+/*========================================================================*//**
+ * Compare the references recorded for a file with the current ones
+ *//*=========================================================================*/
+int same_refs(array_t* recorded, array_t* current, int file_id)
+{
+    int i, n = 0;
+
+    for (i = 0; i < recorded->count; ++i)
+    {
+        state_ref_t* r = (state_ref_t*)at(recorded, i);
+        if (r->file != file_id)
+            continue;
+        if (n >= current->count || compare_ref(r, at(current, n)) != 0)
+            return 0;
+        ++n;
+    }
+
+    return n == current->count;
+}
+
+int compare_ref(const void* a, const void* b)
+{
+    const state_ref_t* ra = (const state_ref_t*)a;
+    const state_ref_t* rb = (const state_ref_t*)b;
+
+    if (ra->file != rb->file)
+        return ra->file - rb->file;
+    if (ra->a != rb->a)
+        return ra->a - rb->a;
+    return ra->b - rb->b;
+}
+
+list_t* find_symbol(int file_id, int sym_id)
+{
+    list_t* list;
+
+    for (list = lsymbols; list; list = list->next)
+    {
+        if (list->file_id == file_id
+            && ((symbol_entry_t*)list->data)->sym_id == sym_id)
+            return list;
+    }
+
+    return NULL;
+}
+
+/*========================================================================*//**
+ * Continue a hash over the rest of a file
+ *//*=========================================================================*/
+unsigned long hash_contents(unsigned long hash, FILE* file)
+{
+    unsigned char buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        hash = hash_data(hash, buf, n);
+
+    return hash;
+}
+
+/*========================================================================*//**
+ * Hash the options which change the result of the link, and the profile the
+ * placement follows
+ *//*=========================================================================*/
+unsigned long hash_config()
+{
+    static const char* const skip[] = { "--incremental", "--print", NULL };
+    unsigned long hash = HASH_INIT;
+    FILE* file;
+
+    hash = hash_options(hash, GBLD, skip);
+    if (get_option("--profile=")->set
+        && (file = fopen(get_option("--profile=")->value.str, "rb")))
+    {
+        hash = hash_contents(hash, file);
+        fclose(file);
+    }
+
+    return hash;
+}
+
+unsigned long hash_rom()
+{
+    unsigned long hash = HASH_INIT;
+    int i;
+
+    for (i = 0; i < get_num_rom_banks(); ++i)
+        hash = hash_data(hash, get_rom_bank(i), ROM_BANK_SIZE);
+
+    return hash;
+}
+
+void* push(array_t* array)
+{
+    if (array->count == array->capacity)
+    {
+        array->capacity = array->capacity ? array->capacity * 2 : 16;
+        array->data = mrealloc(array->data, array->capacity * array->size);
+    }
+    return at(array, array->count++);
+}
+
+void* at(array_t* array, int index)
+{
+    return (char*)array->data + index * array->size;
+}
+
+void clear(array_t* array)
+{
+    free(array->data);
+    array->data = NULL;
+    array->count = 0;
+    array->capacity = 0;
+}
+
+/**
+ * \} state
+ * \} gbld
+ */
@@ -0,0 +1,32 @@
+/**
+ * \addtogroup gbld
+ * \{
+ * \addtogroup state
+ * \{
+ */
+
+#ifndef STATE_H
+#define STATE_H
+
+#include "../common/objfile.h"
+
+int  load_state(const char* name, int num_inputs);
+int  check_state_rom();
+void save_state(const char* name);
+void capture_links();
+void free_state();
+int  hash_input(int file_id, const char* name);
+int  inputs_unchanged();
+void capture_section(section_entry_t* sect);
+void reset_capture();
+void restore_object(int file_id);
+void restore_generated(int file_id);
+int  validate_patch();
+void allocate_preserved();
+
+#endif
+
+/**
+ * \} state
+ * \} gbld
+ */
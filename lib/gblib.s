@@ -12,3 +12,46 @@ lcd_off:
     LDH     [$40], A            ; LCD_CTRL
     RET
    
+
+.global lz_decompress
+
+;-------------------------------------------------------------------------------
+; lz_decompress
+; Decompress a section linked with compress=lz.
+; In:   HL: compressed data, DE: destination
+; Out:  HL: end of the compressed data, DE: end of the data written
+; Uses: A, B
+;
+; 10 M-cycles per byte written, plus 12 per literal run and 30 per copy.
+;-------------------------------------------------------------------------------
+lz_decompress:
+    LDI     A,  [HL]            ; token
+    AND     A
+    RET     Z                   ; $00: end of the data
+    BIT     7,  A
+    JR      NZ, lz_copy
+    LD      B,  A               ; $01-$7F: number of literal bytes
+lz_literal:
+    LDI     A,  [HL]
+    LD      [DE], A
+    INC     DE
+    DEC     B
+    JR      NZ, lz_literal
+    JR      lz_decompress
+lz_copy:
+    SUB     $7D                 ; (token & $7F) + 3 bytes to copy
+    LD      B,  A
+    LDI     A,  [HL]            ; distance - 1
+    PUSH    HL
+    CPL                         ; HL = DE - distance
+    LD      L,  A
+    LD      H,  $FF
+    ADD     HL, DE
+lz_copy_byte:
+    LDI     A,  [HL]
+    LD      [DE], A
+    INC     DE
+    DEC     B
+    JR      NZ, lz_copy_byte
+    POP     HL
+    JR      lz_decompress